@@ -0,0 +1,112 @@
+#pragma once
+
+#include "tracking.h"
+#include "rangecolumns.h"
+#include "../chebyshevfit.h"
+#include "../selectionmask.h"
+#include "../window_message_box.h"
+#include "../dpcore_global.h"
+
+#include <QMap>
+
+#include <vector>
+
+/**
+ * @brief Automatic filtering of the ranges of a tracking (Tracking::FilterMode::AUTO).
+ *
+ * Runs end to end the stages that are chained by hand in the Filter Tool, over the residuals of the ranges with
+ * an echo (tof_2w != 0, see Tracking::residualCalibration):
+ *   1. Histogram prefilter per time bin (algorithm::histPrefilterMaskSLR).
+ *   2. Polynomial postfilter over the whole pass (algorithm::histPostfilterMaskSLR).
+ *   3. Iterative clipping: the remaining ranges are fitted per time bin (ChebyshevFit), and the ranges whose fit
+ *      error is not below sigma_factor times the standard deviation of the errors are rejected, until none is
+ *      rejected or max_iterations is reached. The bins are split once, and the rejected ranges are removed from
+ *      the fits of their bins, instead of fitting the bins again.
+ *   4. Statistics of the accepted residuals (dpslr::ilrs::algorithms::calculateResidualsStats).
+ *
+ * The bins of every stage are processed in parallel. The intermediate columns are kept in the object and reused by
+ * the next run, so a single AutoFilter can process many trackings. It has no GUI dependencies.
+ */
+class DP_CORE_EXPORT AutoFilter
+{
+public:
+
+    enum ErrorEnum
+    {
+        AUTOFILTER_NOT_ENOUGH_DATA,
+        AUTOFILTER_STATS_FAILED
+    };
+
+    static const QMap<ErrorEnum, QString> ErrorListStringMap;
+
+    struct Config
+    {
+        double bin_size = 0.;               ///< Time bin (seconds) of the prefilter and fits. 0 for obj_bs.
+        bool prefilter = true;
+        double prefilter_depth = 1000.;     ///< Histogram bin width (ps).
+        unsigned prefilter_min_ph = 5;
+        unsigned prefilter_divisions = 1;
+        bool postfilter = true;
+        double postfilter_depth = 300.;     ///< The window around the pass fit is +-1.5 depth (ps).
+        unsigned fit_degree = 9;
+        double sigma_factor = 2.5;
+        unsigned max_iterations = 20;
+        double stats_bin_size = 0.;         ///< Time bin (seconds) of the statistics. 0 for the whole pass.
+        std::size_t min_ranges = 5;         ///< Minimum accepted ranges to compute the statistics.
+        int max_threads = 0;
+    };
+
+    struct Result
+    {
+        SelectionMask selection;            ///< Accepted ranges, over Tracking::ranges.
+        dpslr::ilrs::algorithms::DistStats stats_1rms;
+        dpslr::ilrs::algorithms::DistStats stats_rfrms;
+        unsigned iterations = 0;            ///< Clipping iterations done.
+    };
+
+    AutoFilter() = default;
+    explicit AutoFilter(const Config& config);
+
+    inline const Config& config() const {return this->m_config;}
+    inline void setConfig(const Config& config) {this->m_config = config;}
+
+    // Filters the ranges without changing the tracking.
+    DegorasInformation filter(const Tracking& track, Result& result);
+    // The same, with the ranges of the tracking already in columns (e.g. TrackingBinaryFile::toColumns). The ranges
+    // of the tracking are not used.
+    DegorasInformation filter(const Tracking& track, const RangeColumns& ranges, Result& result);
+    // Filters the ranges and stores the result in the tracking: DATA or NOISE flags of the ranges with an echo,
+    // stats_1rms, stats_rfrms and FilterMode::AUTO. On error, the tracking is not changed.
+    DegorasInformation process(Tracking& track);
+
+private:
+
+    // Ranges is RangeColumns or RangeRowsView.
+    template <typename Ranges>
+    DegorasInformation filterFrom(const Tracking& track, const Ranges& ranges, Result& result);
+    // Copies the candidates selected in the mask into the compact columns.
+    void compact(const SelectionMask& mask);
+    // Splits the compact columns in bins as the Filter Tool fit does.
+    void splitBins(double bin_size);
+    // One clipping iteration over the active elements (weight 1) of the compact columns. Returns the number of
+    // rejected ones.
+    std::size_t clip(std::vector<ChebyshevFit>& fits);
+
+    Config m_config;
+
+    // Candidate ranges (with an echo): index in the tracking, time (seconds of day) and residual (ps).
+    std::vector<std::size_t> m_candidates;
+    std::vector<double> m_times;
+    std::vector<double> m_resids;
+    // Selected candidates of the current stage: index in the candidates, time and residual.
+    std::vector<std::size_t> m_sel;
+    std::vector<double> m_sel_times;
+    std::vector<double> m_sel_resids;
+    std::vector<double> m_fit;
+    std::vector<std::size_t> m_offsets;
+    // Clipping weight of the compact elements: 1 active, 0 rejected.
+    std::vector<double> m_weights;
+    // Rejected elements of a bin in the current clipping iteration.
+    std::vector<double> m_rej_times;
+    std::vector<double> m_rej_resids;
+};
@@ -2,6 +2,7 @@
 
 #include "../dpcore_global.h"
 #include "meteodata.h"
+#include "epoch.h"
 
 #include <LibDegorasBase/Mathematics/units/unit_conversions.h>
 #include <LibDegorasSLR/ILRS/algorithms/data/statistics_data.h>
@@ -33,7 +34,14 @@ struct DP_CORE_EXPORT Calibration
             DATA = 2
         };
 
-        long double start_time;
+        // Flag of a stored value. Values out of the enum are UNKNOWN.
+        static inline FilterFlag flagFromInt(long long value)
+        {
+            return value == static_cast<long long>(FilterFlag::NOISE) ? FilterFlag::NOISE :
+                   value == static_cast<long long>(FilterFlag::DATA) ? FilterFlag::DATA : FilterFlag::UNKNOWN;
+        }
+
+        Epoch start_time;
         long double tof_2w;
         FilterFlag flag;
 
@@ -63,8 +71,8 @@ struct DP_CORE_EXPORT Calibration
     dpslr::ilrs::algorithms::DistStats stats_rfrms;
 
     std::vector<RangeData> ranges;
-    std::vector<long double> tA;
-    std::vector<long double> tB;
+    std::vector<Epoch> tA;
+    std::vector<Epoch> tB;
     unsigned int et_precision;
 
     explicit Calibration();
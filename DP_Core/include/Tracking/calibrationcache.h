@@ -0,0 +1,55 @@
+#pragma once
+
+#include "calibration.h"
+#include "../window_message_box.h"
+#include "../dpcore_global.h"
+
+#include <QHash>
+#include <QString>
+
+#include <memory>
+#include <mutex>
+
+/**
+ * @brief Process-wide cache of calibrations, keyed by calibration filename.
+ *
+ * Many trackings reference the same few calibrations, so every calibration is read once and shared by all the
+ * trackings that use it. A cached calibration is read again only if its file changes (modification time or
+ * size) or if it is requested from a different directory. The cache is thread safe; concurrent requests of the
+ * same calibration wait for a single read.
+ */
+class DP_CORE_EXPORT CalibrationCache
+{
+public:
+
+    using CalibrationPtr = std::shared_ptr<const Calibration>;
+
+    static CalibrationCache& instance();
+
+    CalibrationCache(const CalibrationCache&) = delete;
+    CalibrationCache& operator=(const CalibrationCache&) = delete;
+
+    // Same lookup rules as CalibrationFileManager::readCalibration. If dir_path is empty, the calibration is
+    // searched in the historical calibrations.
+    DegorasInformation calibration(const QString& cal_name, const QString& dir_path, CalibrationPtr& calib);
+
+    void invalidate(const QString& cal_name);
+    void clear();
+    std::size_t size() const;
+
+private:
+
+    struct Slot
+    {
+        std::mutex mutex;
+        QString path;
+        qint64 mtime = 0;
+        qint64 size = -1;
+        CalibrationPtr calib;
+    };
+
+    CalibrationCache() = default;
+
+    mutable std::mutex m_mutex;
+    QHash<QString, std::shared_ptr<Slot>> m_slots;
+};
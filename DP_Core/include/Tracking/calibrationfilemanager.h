@@ -5,6 +5,7 @@
 #include "../dpcore_global.h"
 
 class QFile;
+class QLockFile;
 
 class DP_CORE_EXPORT CalibrationFileManager
 {
@@ -13,15 +14,24 @@ public:
     {
         CALIBFILE_NOT_OPEN,
         CALIBFILE_INVALID,
-        CALIB_NOT_FOUND
+        CALIB_NOT_FOUND,
+        CALIB_MANIFEST_LOCKED
     };
 
     static const QMap<ErrorEnum, QString> ErrorListStringMap;
 
     static DegorasInformation readCalibration(const QString& cal_name, const QString &dir_path, Calibration& calib);
     static DegorasInformation readCalibration(const QString& cal_name, Calibration& calib);
-    static DegorasInformation readCalibrationDir(const QString& dir, std::vector<Calibration>& calibs);
+    // The files are read in parallel, using up to max_threads (0 for the ideal thread count).
+    static DegorasInformation readCalibrationDir(const QString& dir, std::vector<Calibration>& calibs,
+                                                int max_threads = 0);
+    // The latest calibrations are taken from a small manifest in the historical calibrations dir, which is kept
+    // updated by writeCalibration and rebuilt from the directory tree only when it is missing or stale. All the
+    // writers of the manifest take a lock file next to it.
     static DegorasInformation readLastCalib(Calibration &calib);
+    // Latest calibration of a station (0 for any) and configuration (empty for any).
+    static DegorasInformation readLastCalib(Calibration &calib, unsigned int station_id, const QString& cfg_id);
+    static DegorasInformation rebuildLatestManifest();
     static DegorasInformation writeCalibration(const Calibration& calib, const QString& dest_dir,
                                               const QString& dest_file = "" );
     static QString calibrationFilename(const Calibration &calib);
@@ -32,4 +42,12 @@ public:
 
 private:
     static DegorasInformation readCalibrationFromFile(const QString &filepath, Calibration& calib);
+    static DegorasInformation loadLatestManifest(const QString& hist_calpath, QJsonObject& manifest);
+    // The manifest is only saved if save is true, which requires holding the lock.
+    static DegorasInformation rebuildLatestManifest(const QString& hist_calpath, QJsonObject& manifest,
+                                                    bool save = true);
+    static DegorasInformation saveLatestManifest(const QString& hist_calpath, const QJsonObject& manifest);
+    static DegorasInformation updateLatestManifest(const QString& hist_calpath, const Calibration& calib,
+                                                   const QString& relative_path);
+    static DegorasInformation lockLatestManifest(const QString& hist_calpath, QLockFile& lock);
 };
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "tracking.h"
+#include "rangecolumns.h"
+#include "../densitycluster.h"
+#include "../selectionmask.h"
+#include "../window_message_box.h"
+#include "../dpcore_global.h"
+
+#include <QMap>
+
+#include <vector>
+
+/**
+ * @brief Signal extraction by density clustering of the residuals of a tracking.
+ *
+ * The ranges with an echo are clustered in the (time, residual) plane (algorithm::densityClusters), so the signal
+ * is found as the dense groups of points, whatever its shape: several reflectors, a drifting bias, or a weak return
+ * in heavy daylight noise, where a histogram of a time bin has no clear peak. The clusters with at least
+ * min_cluster_fraction of the points of the largest one are accepted.
+ *
+ * The neighbourhood is an ellipse, with the time and residual radii given or derived from the tracking: a fraction
+ * of obj_bs in time and a multiple of et_precision in residual. The minimum neighbours of a core point, if not
+ * given, is derived from the noise level: the points expected in a neighbourhood if all the points were spread
+ * uniformly over the pass, plus kNoiseSigmas times its square root, so a region needs a significant excess of
+ * points over the noise to be a cluster.
+ *
+ * The residuals are computed with Tracking::residualCalibration. It has no GUI dependencies.
+ */
+class DP_CORE_EXPORT DensityFilter
+{
+public:
+
+    enum ErrorEnum
+    {
+        DENSITYFILTER_INVALID_RADIUS,
+        DENSITYFILTER_NO_CLUSTERS
+    };
+
+    static const QMap<ErrorEnum, QString> ErrorListStringMap;
+
+    // Defaults of the neighbourhood.
+    static constexpr double kTimeRadiusBins = 0.1;          ///< Time radius, in obj_bs.
+    static constexpr double kResidRadiusPrecisions = 10.;   ///< Residual radius, in et_precision.
+    static constexpr double kNoiseSigmas = 5.;
+    static constexpr std::size_t kMinPoints = 4;            ///< Lowest derived min_points.
+
+    struct Config
+    {
+        double time_radius = 0.;            ///< Neighbourhood radius in time (seconds). 0 for the default.
+        double resid_radius = 0.;           ///< Neighbourhood radius in residual (ps). 0 for the default.
+        std::size_t min_points = 0;         ///< Neighbours of a core point, itself included. 0 for the default.
+        double min_cluster_fraction = 0.1;  ///< Smallest accepted cluster, relative to the largest one.
+        int max_threads = 0;
+    };
+
+    struct Result
+    {
+        SelectionMask selection;            ///< Accepted ranges, over Tracking::ranges.
+        algorithm::DensityClusters clusters;    ///< Clusters over Tracking::ranges (noise without an echo).
+        double time_radius = 0.;            ///< Radii and min_points used.
+        double resid_radius = 0.;
+        std::size_t min_points = 0;
+    };
+
+    DensityFilter() = default;
+    explicit DensityFilter(const Config& config);
+
+    inline const Config& config() const {return this->m_config;}
+    inline void setConfig(const Config& config) {this->m_config = config;}
+
+    // Filters the ranges without changing the tracking.
+    DegorasInformation filter(const Tracking& track, Result& result);
+    // The same, with the ranges of the tracking already in columns (e.g. TrackingBinaryFile::toColumns). The ranges
+    // of the tracking are not used.
+    DegorasInformation filter(const Tracking& track, const RangeColumns& ranges, Result& result);
+    // Filters the ranges and stores the DATA or NOISE flags of the ranges with an echo. On error, the tracking is
+    // not changed.
+    DegorasInformation process(Tracking& track);
+
+private:
+
+    // Ranges is RangeColumns or RangeRowsView.
+    template <typename Ranges>
+    DegorasInformation filterFrom(const Tracking& track, const Ranges& ranges, Result& result);
+
+    Config m_config;
+
+    // Time (seconds of day) of every range, and residual (ps), NaN without an echo.
+    std::vector<double> m_times;
+    std::vector<double> m_resids;
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "../dpcore_global.h"
+
+#include <QString>
+
+#include <charconv>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * @brief Exact fixed-point time, stored as integer picoseconds.
+ *
+ * Used for the range start times and the event timer epochs, which are seconds of the day with picosecond
+ * resolution. Parsing and formatting work directly on the decimal text, so a value read and written again is
+ * bit-exact on every compiler, whatever the size of long double. The same type is used for time intervals.
+ * The range is about +-106 days, enough for passes that cross midnight.
+ */
+class DP_CORE_EXPORT Epoch
+{
+public:
+
+    static constexpr std::int64_t kPicosecondsPerSecond = 1000000000000LL;
+    static constexpr std::int64_t kPicosecondsPerDay = 86400LL * kPicosecondsPerSecond;
+    static constexpr int kMaxDecimals = 12;
+
+    constexpr Epoch() : m_ps(0) {}
+
+    static constexpr Epoch fromPicoseconds(std::int64_t picoseconds) {return Epoch(picoseconds);}
+    static constexpr Epoch fromSeconds(std::int64_t seconds) {return Epoch(seconds * kPicosecondsPerSecond);}
+    // Rounded to the nearest picosecond. Only for values that come from floating point computations.
+    static Epoch fromSeconds(long double seconds);
+    static constexpr Epoch fromDays(std::int64_t days) {return Epoch(days * kPicosecondsPerDay);}
+
+    constexpr std::int64_t picoseconds() const {return this->m_ps;}
+    constexpr std::int64_t nanoseconds() const {return floorDiv(this->m_ps, 1000);}
+    long double toSeconds() const;
+    double toSecondsDouble() const;
+
+    // Day rollover. day() is the whole number of days (floor) and timeOfDay() the remainder, in [0, 86400) s.
+    constexpr std::int64_t day() const {return floorDiv(this->m_ps, kPicosecondsPerDay);}
+    constexpr Epoch timeOfDay() const {return Epoch(this->m_ps - this->day() * kPicosecondsPerDay);}
+    constexpr Epoch addDays(std::int64_t days) const {return Epoch(this->m_ps + days * kPicosecondsPerDay);}
+
+    constexpr Epoch operator+(Epoch other) const {return Epoch(this->m_ps + other.m_ps);}
+    constexpr Epoch operator-(Epoch other) const {return Epoch(this->m_ps - other.m_ps);}
+    constexpr Epoch operator-() const {return Epoch(-this->m_ps);}
+    constexpr Epoch& operator+=(Epoch other) {this->m_ps += other.m_ps; return *this;}
+    constexpr Epoch& operator-=(Epoch other) {this->m_ps -= other.m_ps; return *this;}
+    constexpr bool operator==(Epoch other) const {return this->m_ps == other.m_ps;}
+    constexpr bool operator!=(Epoch other) const {return this->m_ps != other.m_ps;}
+    constexpr bool operator<(Epoch other) const {return this->m_ps < other.m_ps;}
+    constexpr bool operator<=(Epoch other) const {return this->m_ps <= other.m_ps;}
+    constexpr bool operator>(Epoch other) const {return this->m_ps > other.m_ps;}
+    constexpr bool operator>=(Epoch other) const {return this->m_ps >= other.m_ps;}
+
+    // Parses decimal seconds ("43200.123456789012", "-1.5", "4.32e+04"), like std::from_chars. Digits beyond the
+    // picosecond are rounded half away from zero. ec is std::errc::invalid_argument if there is no number and
+    // std::errc::result_out_of_range if it does not fit.
+    static std::from_chars_result fromChars(const char* first, const char* last, Epoch& epoch);
+    // Formats fixed-point decimal seconds with the given number of decimals (at most 12), like std::to_chars.
+    static std::to_chars_result toChars(char* first, char* last, Epoch epoch, int decimals = kMaxDecimals);
+
+    // Whole text conversions. fromString fails if there are characters after the number.
+    static bool fromString(std::string_view text, Epoch& epoch);
+    static bool fromString(const QString& text, Epoch& epoch);
+    QString toString(int decimals = kMaxDecimals) const;
+
+private:
+
+    constexpr explicit Epoch(std::int64_t picoseconds) : m_ps(picoseconds) {}
+
+    static constexpr std::int64_t floorDiv(std::int64_t a, std::int64_t b)
+    {
+        return a / b - ((a % b != 0) && ((a < 0) != (b < 0)) ? 1 : 0);
+    }
+
+    std::int64_t m_ps;
+};
+
+/**
+ * @brief Unwraps a sequence of times of day that may cross midnight.
+ *
+ * Every time that is earlier than the previous one is considered to belong to the next day.
+ */
+class DP_CORE_EXPORT DayRollover
+{
+public:
+
+    inline Epoch operator()(Epoch time_of_day)
+    {
+        if (this->m_started && time_of_day < this->m_prev)
+            this->m_offset += Epoch::fromDays(1);
+        this->m_prev = time_of_day;
+        this->m_started = true;
+        return time_of_day + this->m_offset;
+    }
+
+    inline Epoch offset() const {return this->m_offset;}
+
+private:
+
+    Epoch m_prev;
+    Epoch m_offset;
+    bool m_started = false;
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "tracking.h"
+#include "../dpcore_global.h"
+
+#include <functional>
+#include <vector>
+
+/**
+ * @brief Pairs the raw event timer epochs (tA starts, tB stops) into ranges.
+ *
+ * Both sequences are swept together once (sorted merge), so the cost is linear in the number of events. Every
+ * start takes the stops that fall inside its range gate: [start + gate_open, start + gate_close], relative to
+ * the predicted time of flight if a predictor is given. The starts are processed in chunks on a thread pool.
+ *
+ * Epochs are times of day in acquisition order. Passes that cross midnight are unwrapped before the sweep, but
+ * the ranges keep the original time of day of their start, as the tracking files do.
+ */
+class DP_CORE_EXPORT EventTimerPairing
+{
+public:
+
+    struct Config
+    {
+        // Range gate, as time of flight or, with a predictor, as offsets from the predicted time of flight.
+        Epoch gate_open;
+        Epoch gate_close;
+        // Predicted two way time of flight in picoseconds for a start epoch. Optional. Must be thread safe.
+        std::function<double(Epoch start)> predicted_tof;
+        // All the stops inside the gate produce a range (multi-stop), or only the first one.
+        bool multi_stop = true;
+        // Starts without stops produce a range with FilterFlag::UNKNOWN, like the unanswered shots of the files.
+        bool keep_empty_shots = true;
+        int max_threads = 0;
+        std::size_t chunk_size = std::size_t(1) << 16;
+    };
+
+    // Time of flight in picoseconds, pre_2w from the predictor (0 without it) and flag DATA for paired ranges.
+    static std::vector<Tracking::RangeData> pair(const std::vector<Epoch>& tA, const std::vector<Epoch>& tB,
+                                                 const Config& config);
+    // Replaces the ranges of the tracking with the pairing of its tA and tB.
+    static void processTracking(Tracking& track, const Config& config);
+
+    // Unwraps a sequence of times of day, adding a day at every rollover (a step back of more than half a day).
+    // Smaller steps back are jitter and are kept, so the result is only sorted if the input was. The first epoch is
+    // moved to the next day if it is more than half a day before reference (sequence started after midnight).
+    static std::vector<Epoch> unwrapDays(const std::vector<Epoch>& epochs, Epoch reference);
+};
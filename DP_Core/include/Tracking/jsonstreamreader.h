@@ -0,0 +1,106 @@
+#pragma once
+
+#include "epoch.h"
+#include "../dpcore_global.h"
+
+#include <QIODevice>
+#include <QJsonValue>
+#include <QString>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Pull (SAX-style) json tokenizer that reads a device through a fixed size buffer.
+ *
+ * The reader never holds more than one buffer of the input plus the current token, so big tracking and
+ * calibration files can be parsed in one pass filling the destination containers directly, without
+ * building a QJsonDocument. Small sub-trees can still be materialized with readValue().
+ *
+ * The structure is validated as it is read: a token, ',' or ':' out of place (e.g. a missing or repeated
+ * separator, or a trailing comma) gives Token::INVALID.
+ */
+class DP_CORE_EXPORT JsonStreamReader
+{
+public:
+
+    enum class Token
+    {
+        NONE,
+        BEGIN_OBJECT,
+        END_OBJECT,
+        BEGIN_ARRAY,
+        END_ARRAY,
+        KEY,
+        STRING,
+        NUMBER,
+        TRUE_VALUE,
+        FALSE_VALUE,
+        NULL_VALUE,
+        END,
+        INVALID
+    };
+
+    static constexpr std::size_t kDefaultBufferSize = 1 << 16;
+
+    explicit JsonStreamReader(QIODevice& device, std::size_t buffer_size = kDefaultBufferSize);
+
+    // Advances to the next token and returns it.
+    Token next();
+
+    inline Token token() const {return this->m_token;}
+    inline bool hasError() const {return this->m_token == Token::INVALID;}
+
+    // Unescaped text of the current KEY or STRING, or raw text of the current NUMBER.
+    // It is only valid until the next call to next().
+    inline std::string_view text() const {return this->m_text;}
+
+    double toDouble() const;
+    long long toInt() const;
+    // Exact epoch from the current NUMBER or numeric STRING.
+    bool toEpoch(Epoch& epoch) const;
+    QString toString() const;
+
+    // Skips the current value, including all the nested values if it is an object or an array.
+    bool skipValue();
+
+    // Materializes the current value. Use it only for small sub-trees.
+    QJsonValue readValue();
+
+    // Reads the current array of epochs written as numeric strings (ET data).
+    bool readEpochArray(std::vector<Epoch>& epochs);
+
+private:
+
+    bool readMore();
+    void compact(std::size_t& token_begin);
+    bool skipWhitespace();
+    Token readString();
+    Token readNumber();
+    Token readLiteral(std::string_view literal, Token token);
+    // Checks that a value can start here. The next expected element is then a separator.
+    bool beginValue();
+
+    // Next element allowed by the grammar.
+    enum class Expect
+    {
+        VALUE,          ///< After ':', ',' in an array, or at the start.
+        FIRST_VALUE,    ///< After '[': a value or ']'.
+        KEY,            ///< After ',' in an object.
+        FIRST_KEY,      ///< After '{': a key or '}'.
+        COLON,          ///< After a key.
+        SEPARATOR       ///< After a value: ',' or the end of the container (or of the input, at the top level).
+    };
+
+    QIODevice& m_device;
+    std::vector<char> m_buffer;
+    std::size_t m_pos;
+    std::size_t m_end;
+    bool m_eof;
+    std::vector<char> m_stack;
+    Expect m_expect;
+    Token m_token;
+    std::string_view m_text;
+    std::string m_scratch;
+};
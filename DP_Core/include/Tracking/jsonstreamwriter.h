@@ -0,0 +1,64 @@
+#pragma once
+
+#include "epoch.h"
+#include "../dpcore_global.h"
+
+#include <QByteArray>
+#include <QJsonValue>
+#include <QString>
+
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Json writer that appends the text directly to a byte array.
+ *
+ * Counterpart of JsonStreamReader. Values are formatted with std::to_chars, so big arrays (ranges, ET data) are
+ * written without building intermediate QJsonObject, QJsonArray or QString values. The indented format follows
+ * the layout of QJsonDocument::Indented.
+ */
+class DP_CORE_EXPORT JsonStreamWriter
+{
+public:
+
+    enum class Format
+    {
+        INDENTED,
+        COMPACT
+    };
+
+    explicit JsonStreamWriter(QByteArray& output, Format format = Format::INDENTED);
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+
+    void key(std::string_view key);
+    void key(const QString& key);
+    inline void key(const char* key) {this->key(std::string_view(key));}
+
+    void writeNull();
+    void writeBool(bool value);
+    void writeInt(long long value);
+    // Non finite values are written as null, like QJsonDocument does.
+    void writeDouble(double value);
+    void writeString(std::string_view value);
+    void writeString(const QString& value);
+    inline void writeString(const char* value) {this->writeString(std::string_view(value));}
+    // Epochs are written as fixed point strings to keep the full precision.
+    void writeEpoch(Epoch value, int decimals = Epoch::kMaxDecimals);
+    // Generic values. Use it only for small sub-trees.
+    void writeValue(const QJsonValue& value);
+
+private:
+
+    void beforeValue();
+    void newline();
+    void appendEscaped(std::string_view value);
+
+    QByteArray& m_out;
+    Format m_format;
+    std::vector<bool> m_empty;
+    bool m_after_key;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "tracking.h"
+#include "../window_message_box.h"
+#include "../dpcore_global.h"
+
+#include <QString>
+
+/**
+ * @brief Handle to a tracking file that only reads the header when opened.
+ *
+ * The metadata, stats and calibration references are available after open(). The ranges and ET data are read
+ * from the file the first time they are accessed, and can be released again to free the memory.
+ */
+class DP_CORE_EXPORT LazyTracking
+{
+public:
+
+    explicit LazyTracking(const QString& file_path, const QString& calib_path = "");
+
+    // Reads the header. The ranges are not loaded.
+    DegorasInformation open();
+    // Reads the whole tracking, if it is not loaded yet.
+    DegorasInformation load();
+    // Drops the ranges and ET data, keeping the header.
+    void release();
+
+    inline bool isOpen() const {return this->m_open;}
+    inline bool isLoaded() const {return this->m_loaded;}
+    inline const QString& filePath() const {return this->m_file_path;}
+
+    // Metadata. The ranges and ET data are empty unless the tracking is loaded.
+    inline const Tracking& header() const {return this->m_track;}
+
+    // Load the tracking on first access. If loading fails, the ranges stay empty and the errors are available
+    // in lastErrors().
+    const std::vector<Tracking::RangeData>& ranges();
+    const Tracking& tracking();
+
+    inline const DegorasInformation& lastErrors() const {return this->m_errors;}
+
+private:
+
+    QString m_file_path;
+    QString m_calib_path;
+    Tracking m_track;
+    DegorasInformation m_errors;
+    bool m_open;
+    bool m_loaded;
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "meteodata.h"
+#include "tracking.h"
+#include "../spanview.h"
+#include "../dpcore_global.h"
+
+#include <QDateTime>
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Compact time series of the temperature, pressure and humidity of a list of MeteoData samples.
+ *
+ * Times are double seconds from a reference date (by default the UTC midnight of the first sample, which is also
+ * the origin of the range start times). The values are stored in contiguous columns, without the optional
+ * fields of MeteoData, so a whole pass of shots can be interpolated in one linear walk.
+ */
+class DP_CORE_EXPORT MeteoSeries
+{
+public:
+
+    struct Samples
+    {
+        std::vector<double> temp;
+        std::vector<double> pressure;
+        std::vector<double> rel_hum;
+        // 1 if any of the samples used for the value has MeteoData::Origin::INTERPOLATED.
+        std::vector<std::uint8_t> interpolated;
+    };
+
+    MeteoSeries() = default;
+    explicit MeteoSeries(const std::vector<MeteoData>& meteo);
+    MeteoSeries(const std::vector<MeteoData>& meteo, const QDateTime& reference);
+
+    inline std::size_t size() const {return this->m_time.size();}
+    inline bool empty() const {return this->m_time.empty();}
+    inline const QDateTime& reference() const {return this->m_reference;}
+    inline SpanView<const double> times() const {return this->m_time;}
+    inline SpanView<const double> temp() const {return this->m_temp;}
+    inline SpanView<const double> pressure() const {return this->m_pressure;}
+    inline SpanView<const double> relHum() const {return this->m_rel_hum;}
+
+    // Linear interpolation for ascending times, walking the series with a cursor (O(N + M)). Times out of the
+    // series take the nearest sample. Unsorted times are still valid, but slower. The outputs must have the same
+    // size as times. With an empty series the values are NaN.
+    void interpolate(SpanView<const double> times, SpanView<double> temp, SpanView<double> pressure,
+                     SpanView<double> rel_hum, SpanView<std::uint8_t> interpolated) const;
+    Samples interpolate(SpanView<const double> times) const;
+    // Single lookup (binary search).
+    void at(double time, double& temp, double& pressure, double& rel_hum, bool& interpolated) const;
+
+    // Seconds from reference of a date.
+    double toSeconds(const QDateTime& date) const;
+    // Range start times as seconds from the UTC midnight of their day, unwrapped across midnight. They match a
+    // series built with dayReference(track.date_start).
+    static std::vector<double> rangeTimes(const std::vector<Tracking::RangeData>& ranges);
+    static QDateTime dayReference(const QDateTime& date);
+
+private:
+
+    std::size_t upperIndex(double time) const;
+    void evaluate(std::size_t upper, double time, double& temp, double& pressure, double& rel_hum,
+                  std::uint8_t& interpolated) const;
+
+    QDateTime m_reference;
+    std::vector<double> m_time;
+    std::vector<double> m_temp;
+    std::vector<double> m_pressure;
+    std::vector<double> m_rel_hum;
+    std::vector<std::uint8_t> m_interpolated;
+};
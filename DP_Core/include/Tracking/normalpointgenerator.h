@@ -0,0 +1,99 @@
+#pragma once
+
+#include "tracking.h"
+#include "rangecolumns.h"
+#include "../window_message_box.h"
+#include "../dpcore_global.h"
+
+#include <QMap>
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Generation of the ILRS normal points of a filtered tracking.
+ *
+ * The ranges flagged as DATA are grouped in bins of bin_size seconds aligned to 0h UTC of the first day of the
+ * pass (the ILRS rule), so a bin covers [k * bin_size, (k + 1) * bin_size). For every bin with enough ranges:
+ *   - The mean epoch of the ranges, and the normal point epoch, which is the epoch of the range closest to it.
+ *   - The normal point range: the range at the normal point epoch, corrected by the difference between the mean
+ *     residual and its residual (the Herstmonceux algorithm).
+ *   - The residual statistics: mean, RMS, skew, excess kurtosis and peak - mean. The peak is the center of the
+ *     highest bin of a histogram of the residuals (histCountsPrivate).
+ *   - The return rate: accepted ranges over the shots of the bin. The stats rptn and arate count the rejected
+ *     ranges with an echo.
+ *
+ * The range columns are read in a single pass, which computes the residuals (Tracking::residualCalibration) and
+ * splits the DATA ranges in bins. The bins are then processed in parallel.
+ */
+class DP_CORE_EXPORT NormalPointGenerator
+{
+public:
+
+    enum ErrorEnum
+    {
+        NORMALPOINT_INVALID_BIN_SIZE,
+        NORMALPOINT_NO_DATA
+    };
+
+    static const QMap<ErrorEnum, QString> ErrorListStringMap;
+
+    struct Config
+    {
+        double bin_size = 0.;               ///< Normal point bin (seconds). 0 for obj_bs.
+        std::size_t min_ranges = 1;         ///< Minimum accepted ranges of a bin to generate its normal point.
+        double peak_bin_width = 10.;        ///< Width (ps) of the histogram bins used to find the peak.
+        int max_threads = 0;
+    };
+
+    struct NormalPoint
+    {
+        Epoch epoch;                        ///< Epoch of the range closest to the mean epoch (unwrapped after midnight).
+        double mean_epoch = 0.;             ///< Mean epoch of the ranges (seconds since 0h of the first day).
+        double tof_2w = 0.;                 ///< Two way time of flight (ps) at the epoch.
+        double bin_start = 0.;              ///< Start of the bin (seconds since 0h of the first day).
+        std::size_t nshots = 0;             ///< Shots (ranges) in the bin.
+        std::size_t nranges = 0;            ///< Accepted (DATA) ranges in the bin.
+        double return_rate = 0.;            ///< Accepted ranges over shots (%).
+        dpslr::ilrs::algorithms::DistStats stats;   ///< Residual statistics (ps). peak is peak - mean.
+    };
+
+    NormalPointGenerator() = default;
+    explicit NormalPointGenerator(const Config& config);
+
+    inline const Config& config() const {return this->m_config;}
+    inline void setConfig(const Config& config) {this->m_config = config;}
+
+    // Generates the normal points of the tracking, in time order.
+    DegorasInformation generate(const Tracking& track, std::vector<NormalPoint>& normal_points);
+    // The same, with the ranges of the tracking already in columns (e.g. TrackingBinaryFile::toColumns). The ranges
+    // of the tracking are not used.
+    DegorasInformation generate(const Tracking& track, const RangeColumns& ranges,
+                                std::vector<NormalPoint>& normal_points);
+
+private:
+
+    // Ranges is RangeColumns or RangeRowsView.
+    template <typename Ranges>
+    DegorasInformation generateFrom(const Tracking& track, const Ranges& ranges,
+                                    std::vector<NormalPoint>& normal_points);
+    // Splits the DATA ranges in bins, computing their residuals.
+    template <typename Ranges>
+    void splitBins(const Ranges& ranges, double cal_val, std::int64_t bin_ps);
+    // Normal point of a bin. Returns false if it has not enough ranges.
+    bool normalPoint(std::size_t bin, NormalPoint& np) const;
+
+    Config m_config;
+
+    // DATA ranges, grouped by bin: time (seconds since 0h of the first day), residual and time of flight (ps), and
+    // unwrapped epoch.
+    std::vector<double> m_times;
+    std::vector<double> m_resids;
+    std::vector<double> m_tofs;
+    std::vector<Epoch> m_epochs;
+    std::vector<std::size_t> m_offsets;
+    // Per bin: start (seconds), number of shots and number of ranges with an echo.
+    std::vector<double> m_bin_starts;
+    std::vector<std::size_t> m_bin_shots;
+    std::vector<std::size_t> m_bin_echoes;
+};
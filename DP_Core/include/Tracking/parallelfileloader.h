@@ -0,0 +1,65 @@
+#pragma once
+
+#include "../window_message_box.h"
+
+#include <QStringList>
+#include <QThread>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <vector>
+
+/**
+ * @brief Reads a list of files on a thread pool.
+ *
+ * Every file is parsed into its own slot, so the results are moved into the output in the same order as the
+ * paths, whatever the order in which the threads finish. The errors are aggregated in the same order too.
+ *
+ * @param paths Files to read.
+ * @param reader Callable with signature DegorasInformation(const QString& path, T& result). It must be thread safe.
+ * @param results Output vector. Only the files read without errors are appended.
+ * @param max_threads Concurrency limit. If it is 0 or less, the ideal thread count is used.
+ * @return The errors of all the files.
+ */
+template <typename T, typename Reader>
+DegorasInformation loadFilesParallel(const QStringList& paths, Reader reader, std::vector<T>& results,
+                                     int max_threads = 0)
+{
+    const std::size_t count = static_cast<std::size_t>(paths.size());
+    std::vector<T> parsed(count);
+    std::vector<DegorasInformation> slot_errors(count);
+
+    const int threads = std::min(max_threads > 0 ? max_threads : QThread::idealThreadCount(),
+                                 static_cast<int>(count));
+
+    if (threads <= 1)
+    {
+        for (std::size_t i = 0; i < count; i++)
+            slot_errors[i] = reader(paths[static_cast<qsizetype>(i)], parsed[i]);
+    }
+    else
+    {
+        // Own pool, so the limit does not change the global one and the wait only covers these files.
+        QThreadPool pool;
+        pool.setMaxThreadCount(threads);
+        for (std::size_t i = 0; i < count; i++)
+        {
+            pool.start([&paths, &reader, &parsed, &slot_errors, i]
+            {
+                slot_errors[i] = reader(paths[static_cast<qsizetype>(i)], parsed[i]);
+            });
+        }
+        pool.waitForDone();
+    }
+
+    DegorasInformation errors;
+    results.reserve(results.size() + count);
+    for (std::size_t i = 0; i < count; i++)
+    {
+        errors.append(slot_errors[i]);
+        if (!slot_errors[i].hasError())
+            results.push_back(std::move(parsed[i]));
+    }
+
+    return errors;
+}
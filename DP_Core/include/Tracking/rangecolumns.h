@@ -0,0 +1,153 @@
+#pragma once
+
+#include "tracking.h"
+#include "../spanview.h"
+#include "../dpcore_global.h"
+
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+/**
+ * @brief Columnar (structure of arrays) storage of the ranges of a tracking.
+ *
+ * Every field of Tracking::RangeData is stored in its own contiguous column, and the filter flags are stored as
+ * one byte per range. Kernels that only need one or two fields (residuals, filters, stats, plots) can then
+ * stream just those columns, through the zero-copy span views. Code that still works with RangeData can use
+ * the conversion functions or iterate the container, which yields RangeData values.
+ */
+class DP_CORE_EXPORT RangeColumns
+{
+public:
+
+    using RangeData = Tracking::RangeData;
+    using FilterFlag = Tracking::RangeData::FilterFlag;
+
+    // Read-only adapter iterator. Dereferencing builds the RangeData of the current index.
+    class DP_CORE_EXPORT ConstIterator
+    {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = RangeData;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = RangeData;
+
+        ConstIterator(const RangeColumns* columns, std::size_t idx) : m_columns(columns), m_idx(idx) {}
+
+        inline RangeData operator*() const {return this->m_columns->at(this->m_idx);}
+        inline RangeData operator[](difference_type n) const {return this->m_columns->at(this->m_idx + n);}
+        inline ConstIterator& operator++() {this->m_idx++; return *this;}
+        inline ConstIterator operator++(int) {ConstIterator it(*this); this->m_idx++; return it;}
+        inline ConstIterator& operator--() {this->m_idx--; return *this;}
+        inline ConstIterator operator--(int) {ConstIterator it(*this); this->m_idx--; return it;}
+        inline ConstIterator& operator+=(difference_type n) {this->m_idx += n; return *this;}
+        inline ConstIterator& operator-=(difference_type n) {this->m_idx -= n; return *this;}
+        inline ConstIterator operator+(difference_type n) const {return {this->m_columns, this->m_idx + n};}
+        inline ConstIterator operator-(difference_type n) const {return {this->m_columns, this->m_idx - n};}
+        inline difference_type operator-(const ConstIterator& other) const
+        {
+            return static_cast<difference_type>(this->m_idx) - static_cast<difference_type>(other.m_idx);
+        }
+        inline bool operator==(const ConstIterator& other) const {return this->m_idx == other.m_idx;}
+        inline bool operator!=(const ConstIterator& other) const {return this->m_idx != other.m_idx;}
+        inline bool operator<(const ConstIterator& other) const {return this->m_idx < other.m_idx;}
+
+    private:
+        const RangeColumns* m_columns;
+        std::size_t m_idx;
+    };
+
+    RangeColumns() = default;
+    explicit RangeColumns(const std::vector<RangeData>& ranges);
+
+    inline std::size_t size() const {return this->m_start_time.size();}
+    inline bool empty() const {return this->m_start_time.empty();}
+    void reserve(std::size_t size);
+    void resize(std::size_t size);
+    void clear();
+
+    // Compatibility with RangeData.
+    void push_back(const RangeData& range);
+    RangeData at(std::size_t idx) const;
+    void set(std::size_t idx, const RangeData& range);
+    std::vector<RangeData> toRanges() const;
+    void fromRanges(const std::vector<RangeData>& ranges);
+    inline ConstIterator begin() const {return {this, 0};}
+    inline ConstIterator end() const {return {this, this->size()};}
+
+    inline const Epoch& startTime(std::size_t idx) const {return this->m_start_time[idx];}
+    inline double tof(std::size_t idx) const {return this->m_tof_2w[idx];}
+    inline FilterFlag flag(std::size_t idx) const {return static_cast<FilterFlag>(this->m_flags[idx]);}
+    inline void setFlag(std::size_t idx, FilterFlag flag) {this->m_flags[idx] = static_cast<std::uint8_t>(flag);}
+
+    // Zero-copy views of the columns. They are invalidated by any operation that changes the size.
+    inline SpanView<const Epoch> startTimes() const {return this->m_start_time;}
+    inline SpanView<const double> tof() const {return this->m_tof_2w;}
+    inline SpanView<const double> pre() const {return this->m_pre_2w;}
+    inline SpanView<const double> tropCorr() const {return this->m_trop_corr_2w;}
+    inline SpanView<const double> bias() const {return this->m_bias;}
+    inline SpanView<const std::uint8_t> flags() const {return this->m_flags;}
+    inline SpanView<Epoch> startTimes() {return this->m_start_time;}
+    inline SpanView<double> tof() {return this->m_tof_2w;}
+    inline SpanView<double> pre() {return this->m_pre_2w;}
+    inline SpanView<double> tropCorr() {return this->m_trop_corr_2w;}
+    inline SpanView<double> bias() {return this->m_bias;}
+    inline SpanView<std::uint8_t> flags() {return this->m_flags;}
+
+    // Residual of a range, as computed everywhere: tof_2w - pre_2w - trop_corr_2w - cal_val, with cal_val from
+    // Tracking::residualCalibration.
+    static inline double residual(double tof_2w, double pre_2w, double trop_corr_2w, double cal_val)
+    {
+        return tof_2w - pre_2w - trop_corr_2w - cal_val;
+    }
+    inline double residual(std::size_t idx, double cal_val) const
+    {
+        return residual(this->m_tof_2w[idx], this->m_pre_2w[idx], this->m_trop_corr_2w[idx], cal_val);
+    }
+
+    // Kernels over the columns.
+    // Residuals of all the ranges, as residual does. The output must have size() elements.
+    void residuals(double cal_val, SpanView<double> out) const;
+    std::vector<double> residuals(double cal_val) const;
+    std::size_t countFlag(FilterFlag flag) const;
+    void setFlags(FilterFlag flag);
+
+private:
+
+    std::vector<Epoch> m_start_time;
+    std::vector<double> m_tof_2w;
+    std::vector<double> m_pre_2w;
+    std::vector<double> m_trop_corr_2w;
+    std::vector<double> m_bias;
+    std::vector<std::uint8_t> m_flags;
+};
+
+/**
+ * @brief The per range accessors of RangeColumns over a vector of RangeData.
+ *
+ * Kernels written as templates over the ranges type run on both layouts, so Tracking::ranges does not have to be
+ * converted to columns first.
+ */
+class RangeRowsView
+{
+public:
+
+    using FilterFlag = Tracking::RangeData::FilterFlag;
+
+    explicit RangeRowsView(const std::vector<Tracking::RangeData>& ranges) : m_ranges(ranges) {}
+
+    inline std::size_t size() const {return this->m_ranges.size();}
+    inline const Epoch& startTime(std::size_t idx) const {return this->m_ranges[idx].start_time;}
+    inline double tof(std::size_t idx) const {return this->m_ranges[idx].tof_2w;}
+    inline FilterFlag flag(std::size_t idx) const {return this->m_ranges[idx].flag;}
+    inline double residual(std::size_t idx, double cal_val) const
+    {
+        const Tracking::RangeData& range = this->m_ranges[idx];
+        return RangeColumns::residual(range.tof_2w, range.pre_2w, range.trop_corr_2w, cal_val);
+    }
+
+private:
+
+    const std::vector<Tracking::RangeData>& m_ranges;
+};
@@ -3,6 +3,7 @@
 #include "../dpcore_global.h"
 #include "meteodata.h"
 #include "calibration.h"
+#include "epoch.h"
 
 #include <LibDegorasSLR/ILRS/algorithms/data/statistics_data.h>
 
@@ -10,6 +11,8 @@
 #include <QDateTime>
 #include <QJsonObject>
 
+#include <memory>
+
 dpslr::ilrs::algorithms::DistStats StatsFromJson(const QJsonObject& o);
 QJsonObject StatstoJson(const dpslr::ilrs::algorithms::DistStats &stats);
 
@@ -67,9 +70,17 @@ struct DP_CORE_EXPORT Tracking
     static inline std::array<QString,3> kFilterModeStrings{
         QStringLiteral("Raw"), QStringLiteral("Manual"), QStringLiteral("Auto")};
 
-    using OrderedCalibrations = std::map<QDateTime, Calibration>;
+    // Calibrations are shared by all the trackings that reference them (see CalibrationCache).
+    using OrderedCalibrations = std::map<QDateTime, std::shared_ptr<const Calibration>>;
     using CalibrationsBySpan = std::map<CalibrationSpan, OrderedCalibrations>;
 
+    // Calibration referenced by the tracking file, by file name.
+    struct CalibrationReference
+    {
+        QString file;
+        CalibrationSpan span;
+    };
+
     struct DP_CORE_EXPORT RangeData
     {
         enum class FilterFlag
@@ -79,7 +90,14 @@ struct DP_CORE_EXPORT Tracking
             DATA = 2
         };
 
-        long double start_time;
+        // Flag of a stored value. Values out of the enum are UNKNOWN.
+        static inline FilterFlag flagFromInt(long long value)
+        {
+            return value == static_cast<long long>(FilterFlag::NOISE) ? FilterFlag::NOISE :
+                   value == static_cast<long long>(FilterFlag::DATA) ? FilterFlag::DATA : FilterFlag::UNKNOWN;
+        }
+
+        Epoch start_time;
         double tof_2w;
         double pre_2w;
         double trop_corr_2w;
@@ -114,13 +132,16 @@ struct DP_CORE_EXPORT Tracking
     std::vector<MeteoData> meteo_data;
 
     CalibrationsBySpan cal_data;
+    // References that are not in cal_data because their calibration was not loaded. They are written back with the
+    // tracking, so saving or converting it keeps them.
+    std::vector<CalibrationReference> cal_unresolved;
     double cal_val_overall;
 
     std::vector<TelescopeData> telescope_data;
 
     std::vector<RangeData> ranges;
-    std::vector<long double> tA;
-    std::vector<long double> tB;
+    std::vector<Epoch> tA;
+    std::vector<Epoch> tB;
     unsigned int et_precision;
 
     explicit Tracking();
@@ -129,5 +150,9 @@ struct DP_CORE_EXPORT Tracking
     Tracking& operator=(const Tracking&) = default;
     Tracking& operator=(Tracking&&) = default;
 
+    // Calibration subtracted from the residuals: cal_val_overall truncated to whole picoseconds, as the Filter Tool
+    // does. Every residual computation (see RangeColumns::residual) uses it, so all of them agree.
+    double residualCalibration() const;
+
 };
 
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "tracking.h"
+#include "rangecolumns.h"
+#include "../window_message_box.h"
+#include "../dpcore_global.h"
+
+#include <QFile>
+#include <QByteArray>
+
+#include <array>
+#include <cstdint>
+
+/**
+ * @brief Binary columnar companion of the .dptr json tracking format (.dptb).
+ *
+ * The file is little endian and every section starts at an offset aligned to 8 bytes:
+ *   - Header: magic, version and the offset and element count of every section.
+ *   - Metadata: compact json with the same fields as the .dptr header (see TrackingFileManager::headerToJson).
+ *   - start_time: exact fixed-point, int64 picoseconds.
+ *   - tof_2w, pre_2w, trop_corr_2w, bias: contiguous double arrays.
+ *   - flags: Tracking::RangeData::FilterFlag packed in 2 bits per range inside 64-bit words.
+ *   - tA, tB: exact fixed-point, int64 picoseconds.
+ *
+ * An opened file is mapped in memory, so the columns can be accessed in place without any parsing.
+ */
+class DP_CORE_EXPORT TrackingBinaryFile
+{
+public:
+
+    static constexpr std::array<char, 4> kMagic{{'D', 'P', 'T', 'B'}};
+    static constexpr std::uint32_t kVersion = 1;
+    static constexpr std::uint64_t kAlignment = 8;
+    static constexpr unsigned kFlagBits = 2;
+    static constexpr unsigned kFlagsPerWord = 64 / kFlagBits;
+
+    struct Section
+    {
+        std::uint64_t offset;
+        std::uint64_t count;
+    };
+
+    struct Header
+    {
+        char magic[4];
+        std::uint32_t version;
+        std::uint64_t file_size;
+        Section meta;
+        Section start_time;
+        Section tof_2w;
+        Section pre_2w;
+        Section trop_corr_2w;
+        Section bias;
+        Section flags;
+        Section tA;
+        Section tB;
+        std::uint32_t et_precision;
+        std::uint32_t reserved;
+    };
+
+    TrackingBinaryFile() = default;
+    ~TrackingBinaryFile();
+    TrackingBinaryFile(const TrackingBinaryFile&) = delete;
+    TrackingBinaryFile& operator=(const TrackingBinaryFile&) = delete;
+
+    DegorasInformation open(const QString& file_path);
+    void close();
+    inline bool isOpen() const {return this->m_data != nullptr;}
+
+    // Zero-copy access to the columns. The pointers are valid while the file is open.
+    inline std::size_t rangesCount() const {return this->m_header.start_time.count;}
+    inline std::size_t tACount() const {return this->m_header.tA.count;}
+    inline std::size_t tBCount() const {return this->m_header.tB.count;}
+    inline const std::int64_t* startTimes() const {return this->column<std::int64_t>(this->m_header.start_time);}
+    inline const double* tof() const {return this->column<double>(this->m_header.tof_2w);}
+    inline const double* pre() const {return this->column<double>(this->m_header.pre_2w);}
+    inline const double* tropCorr() const {return this->column<double>(this->m_header.trop_corr_2w);}
+    inline const double* bias() const {return this->column<double>(this->m_header.bias);}
+    inline const std::uint64_t* flagWords() const {return this->column<std::uint64_t>(this->m_header.flags);}
+    inline const std::int64_t* tA() const {return this->column<std::int64_t>(this->m_header.tA);}
+    inline const std::int64_t* tB() const {return this->column<std::int64_t>(this->m_header.tB);}
+    inline unsigned etPrecision() const {return this->m_header.et_precision;}
+    Tracking::RangeData::FilterFlag flag(std::size_t idx) const;
+    QByteArray metadata() const;
+
+    DegorasInformation toTracking(const QString& calib_path, Tracking& track) const;
+    // Copies the range columns as they are stored, without building RangeData records.
+    void toColumns(RangeColumns& columns) const;
+    // Only the metadata, ranges and ET data are left empty.
+    DegorasInformation toTrackingHeader(const QString& calib_path, Tracking& track, bool load_calibrations = true) const;
+
+    static DegorasInformation readTracking(const QString& file_path, const QString& calib_path, Tracking& track);
+    static DegorasInformation readTrackingHeader(const QString& file_path, const QString& calib_path, Tracking& track,
+                                                bool load_calibrations = true);
+    static DegorasInformation writeTracking(const Tracking& track, const QString& file_path);
+    static QByteArray serialize(const Tracking& track);
+
+private:
+
+    template <typename T>
+    inline const T* column(const Section& section) const
+    {
+        return reinterpret_cast<const T*>(this->m_data + section.offset);
+    }
+
+    QFile m_file;
+    QByteArray m_buffer;
+    const uchar* m_data = nullptr;
+    Header m_header{};
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "tracking.h"
+#include "../window_message_box.h"
+#include "../dpcore_global.h"
+
+#include <QDateTime>
+#include <QString>
+
+#include <vector>
+
+class QFileInfo;
+class QLockFile;
+
+/**
+ * @brief On-disk index of the trackings stored below a directory (historical or current observations).
+ *
+ * The index keeps one small row per tracking file with the attributes used by the queries, so searches by date
+ * range, object or configuration do not need to parse the tracking files. It is stored in the root of the
+ * indexed directory and replaced atomically on every save. Files can be placed directly in the root or in its
+ * day subdirectories (yyyyMMdd), as done in the historical tree.
+ *
+ * Single trackings are added or removed by appending a record to a change log next to the index, so a save does
+ * not rewrite the whole historical index. The log is replayed on load and merged into the index every
+ * kMaxLogRecords records, or on any save. All the writers take a lock file next to the index.
+ */
+class DP_CORE_EXPORT TrackingCatalog
+{
+public:
+    enum ErrorEnum
+    {
+        CATALOG_NOT_OPEN,
+        CATALOG_INVALID,
+        CATALOG_UNSUPPORTED_VERSION,
+        CATALOG_NOT_WRITABLE,
+        CATALOG_ENTRY_MISSING,
+        CATALOG_ENTRY_STALE,
+        CATALOG_ENTRY_ORPHAN,
+        CATALOG_LOCKED,
+        CATALOG_STALE
+    };
+
+    static const QMap<ErrorEnum, QString> ErrorListStringMap;
+
+    static constexpr quint32 kMagic = 0x43545044;   // "DPTC"
+    static constexpr quint32 kVersion = 1;
+    static inline const QString kIndexFilename = QStringLiteral("tracking_catalog.dpci");
+    static constexpr quint32 kLogMagic = 0x4C545044;    // "DPTL"
+    static inline const QString kLogFilename = QStringLiteral("tracking_catalog.dpcl");
+    static constexpr std::size_t kMaxLogRecords = 512;
+    static constexpr int kLockTimeoutMs = 2000;
+
+    struct DP_CORE_EXPORT Entry
+    {
+        QString path;                 // Relative to the indexed directory.
+        unsigned int station_id;
+        QString cfg_id;
+        QString obj_norad;
+        unsigned int release;
+        Tracking::FilterMode filter_mode;
+        QDateTime date_start;
+        QDateTime date_end;
+        std::size_t nshots;
+        std::size_t rnshots;
+        double rms_1rms;
+        double rms_rfrms;
+        double arate_rfrms;
+        qint64 file_size;
+        qint64 file_mtime;            // Milliseconds since epoch. Used to detect stale entries.
+
+        QString filename() const;
+
+        static Entry fromTracking(const Tracking& track, const QString& path, const QFileInfo& info);
+
+        explicit Entry();
+    };
+
+    explicit TrackingCatalog(const QString& dir);
+
+    // Loads the index. If it does not exist, is not valid or is stale, it is rebuilt from the directory. The rebuilt
+    // index is saved only if save is true, so a directory without an index can be queried without writing one.
+    DegorasInformation open(bool save = true);
+    DegorasInformation load();
+    DegorasInformation save() const;
+
+    // Scans the indexed directory, reads every tracking and replaces the index.
+    DegorasInformation rebuild();
+    // Checks the index against the directory. Every inconsistency is reported. If repair is true, the
+    // inconsistent entries are fixed and the index is saved.
+    DegorasInformation verify(bool repair = false);
+
+    void insert(Entry entry);
+    bool remove(const QString& path);
+
+    // Trackings that intersect [start, end]. Empty filters match everything.
+    std::vector<Entry> query(const QDateTime& start, const QDateTime& end, const QString& object_norad = "",
+                             const QString& cfg_id = "") const;
+    // All the trackings, filtered only by object and configuration.
+    std::vector<Entry> query(const QString& object_norad = "", const QString& cfg_id = "") const;
+
+    inline const std::vector<Entry>& entries() const {return this->m_entries;}
+    inline const QString& dir() const {return this->m_dir;}
+    QString indexPath() const;
+    QString logPath() const;
+    QString lockPath() const;
+
+    // Convenience functions to keep the index of a directory updated when a tracking is written or removed. Only
+    // an existing index is updated, and it is never rebuilt here: if it is not valid or can not be locked, it is
+    // marked stale and the next open or rebuild replaces it.
+    static DegorasInformation addTracking(const QString& dir, const Tracking& track, const QString& path);
+    static DegorasInformation removeTracking(const QString& dir, const QString& path);
+
+private:
+
+    enum class LogRecord : quint8
+    {
+        ADD = 1,
+        REMOVE = 2,
+        STALE = 3
+    };
+
+    DegorasInformation lock(QLockFile& lock) const;
+    // Without taking the lock.
+    DegorasInformation scan();
+    DegorasInformation write() const;
+    DegorasInformation replayLog();
+    DegorasInformation appendLog(LogRecord type, const Entry& entry);
+    // Applies a change to a loaded catalog, appending it to the log or merging the log into the index.
+    static DegorasInformation update(const QString& dir, LogRecord type, const Entry& entry);
+
+    QStringList trackingFiles() const;
+    DegorasInformation readEntry(const QString& path, Entry& entry) const;
+    bool matches(const Entry& entry, const QString& object_norad, const QString& cfg_id) const;
+
+    QString m_dir;
+    std::vector<Entry> m_entries;   // Sorted by date_start.
+    std::size_t m_log_records;      // Valid records of the log, as loaded.
+    bool m_log_truncated;           // The log ends with an incomplete record.
+};
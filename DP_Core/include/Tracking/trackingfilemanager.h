@@ -1,6 +1,7 @@
 #pragma once
 
 #include "tracking.h"
+#include "jsonstreamwriter.h"
 #include "../window_message_box.h"
 #include "../dpcore_global.h"
 
@@ -12,31 +13,71 @@ public:
         TRACKFILE_NOT_OPEN,
         TRACKFILE_INVALID,
         TRACKFILE_NOT_EXISTS,
-        TRACKFILE_NOT_REMOVABLE
+        TRACKFILE_NOT_REMOVABLE,
+        TRACKFILE_UNSUPPORTED_VERSION,
+        TRACKFILE_CALIBRATION_NOT_LOADED
     };
 
     static const QMap<ErrorEnum, QString> ErrorListStringMap;
 
+    // Tracking file suffixes. The format is always selected by extension.
+    static inline const QString kJsonSuffix = QStringLiteral("dptr");
+    static inline const QString kBinarySuffix = QStringLiteral("dptb");
+
     static DegorasInformation readTracking(const QString& track_name, const QString &track_dirpath,
                                           const QString &calib_dirpath, Tracking& track);
     static DegorasInformation readTracking(const QString& track_name, const QString &track_dirpath, Tracking& track);
     static DegorasInformation readTracking(const QString& track_name, Tracking& track);
+    // The files are read in parallel, using up to max_threads (0 for the ideal thread count). The trackings are
+    // returned in file name order.
     static DegorasInformation readTrackingDir(const QString& dir, const QString& calib_path,
-                                             std::vector<Tracking>& tracks);
-    static DegorasInformation readTrackingDir(const QString& dir, std::vector<Tracking>& tracks);
+                                             std::vector<Tracking>& tracks, int max_threads = 0);
+    static DegorasInformation readTrackingDir(const QString& dir, std::vector<Tracking>& tracks, int max_threads = 0);
+    // Without dest_dir, the tracking is written to the current and historical observation dirs and indexed in their
+    // catalogs. With dest_dir, the catalog of that dir is updated only if it already has one.
     static DegorasInformation writeTracking(const Tracking& track, const QString& dest_dir = "",
-                                           const QString& filename = "");
+                                           const QString& filename = "",
+                                           JsonStreamWriter::Format format = JsonStreamWriter::Format::INDENTED);
     static DegorasInformation removeTracking(const QString& track_name);
     static DegorasInformation removeCurrentTracking(const QString& track_name);
 
     static QString trackingFilename(const Tracking &track);
     static QString findTracking(const QString &track_name);
-    static QStringList findTrackings(const QDateTime &start, const QDateTime &end, const QString &object_norad = "",
-                                     const QString &cfg_id = "", const QString& dir = "");
-    static QStringList currentTrackings(const QString &object_norad = "", const QString &cfg_id = "");
+    // Answered from the catalogs. A dir without a catalog is scanned, but no catalog is written to it.
+    static DegorasInformation findTrackings(const QDateTime &start, const QDateTime &end, QStringList& trackings,
+                                           const QString &object_norad = "", const QString &cfg_id = "",
+                                           const QString& dir = "");
+    static DegorasInformation currentTrackings(QStringList& trackings, const QString &object_norad = "",
+                                              const QString &cfg_id = "");
+
+    // Repair or check the catalogs (see TrackingCatalog) of the current and historical observation dirs.
+    static DegorasInformation rebuildCatalogs();
+    static DegorasInformation verifyCatalogs(bool repair = false);
 
     static QDate startDate(const QString &track_name);
     static DegorasInformation readTrackingFromFile(const QString &file_path, const QString &calib_path, Tracking& track);
-    static DegorasInformation writeTrackingPrivate(const Tracking& track, const QString& filepath);
+    // Reads everything except ranges_data and et_data, which are skipped without being stored.
+    static DegorasInformation readTrackingHeader(const QString &file_path, const QString &calib_path, Tracking& track,
+                                                bool load_calibrations = true);
+    static DegorasInformation writeTrackingPrivate(const Tracking& track, const QString& filepath,
+                                                  JsonStreamWriter::Format format = JsonStreamWriter::Format::INDENTED);
+    // Whole file contents, json or binary (.dptb). Serialize once and write it with writeBytes to every destination.
+    static QByteArray serializeTracking(const Tracking& track, bool binary,
+                                        JsonStreamWriter::Format format = JsonStreamWriter::Format::INDENTED);
+    static DegorasInformation writeBytes(const QByteArray& bytes, const QString& filepath);
+    static DegorasInformation convertTracking(const QString& src_path, const QString& dst_path);
+    static bool isBinaryTrackingFile(const QString& file_path);
+
+    // Everything except the ranges and ET columns. Shared by the json and binary formats. A calibration that can not
+    // be loaded is not an error: its reference is kept in Tracking::cal_unresolved (see unresolvedCalibrations).
+    static QJsonObject headerToJson(const Tracking& track);
+    static DegorasInformation headerFromJson(const QJsonObject& object, const QString& calib_path, Tracking& track,
+                                            bool load_calibrations = true);
+    // A TRACKFILE_CALIBRATION_NOT_LOADED error for every unresolved calibration reference of the tracking.
+    static DegorasInformation unresolvedCalibrations(const Tracking& track);
+
+private:
+    static DegorasInformation readJsonTracking(const QString &file_path, const QString &calib_path, bool header_only,
+                                              bool load_calibrations, Tracking& track);
 };
 
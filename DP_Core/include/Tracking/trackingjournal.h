@@ -0,0 +1,88 @@
+#pragma once
+
+#include "tracking.h"
+#include "jsonstreamwriter.h"
+#include "../window_message_box.h"
+#include "../dpcore_global.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+#include <array>
+#include <cstdint>
+
+/**
+ * @brief Append-only writer for trackings that are recorded in real time (CalibrationSpan::RT).
+ *
+ * Ranges and meteo samples are appended to a journal file (.dptj) as they arrive, so the cost per shot does not
+ * depend on the length of the pass. Every checkpoint_interval ranges, and on every explicit checkpoint, the
+ * updated header is stored and the journal is flushed. When the pass ends, finalize() writes the standard
+ * tracking file and removes the journal. After a crash, recover() replays the journal up to the last complete
+ * record, and resume() does the same and keeps appending to it.
+ *
+ * Journal layout (little endian): magic "DPTJ", uint32 version, then records made of uint32 type, uint32 payload
+ * size, payload and uint32 checksum of the type, size and payload.
+ */
+class DP_CORE_EXPORT TrackingJournal
+{
+public:
+
+    enum class RecordType : std::uint32_t
+    {
+        HEADER = 1,         ///< Compact json header (TrackingFileManager::headerToJson) without meteo data.
+        RANGE = 2,          ///< Start time (int64 ps), tof_2w, pre_2w, trop_corr_2w, bias (double) and flag (uint8).
+        METEO = 3           ///< Compact json of one MeteoData sample.
+    };
+
+    static inline const QString kJournalSuffix = QStringLiteral("dptj");
+    static constexpr std::array<char, 4> kMagic{{'D', 'P', 'T', 'J'}};
+    static constexpr std::uint32_t kVersion = 1;
+    static constexpr std::size_t kDefaultCheckpointInterval = 1000;
+
+    explicit TrackingJournal(std::size_t checkpoint_interval = kDefaultCheckpointInterval);
+    // Flushes and closes the journal without finalizing it, so it can still be recovered.
+    ~TrackingJournal();
+    TrackingJournal(const TrackingJournal&) = delete;
+    TrackingJournal& operator=(const TrackingJournal&) = delete;
+
+    // Creates a new journal. The ranges and meteo data of header are not stored.
+    DegorasInformation begin(const Tracking& header, const QString& journal_path);
+    // Opens an existing journal to keep appending to it. The incomplete records at the end are discarded and the
+    // recovered tracking is returned.
+    DegorasInformation resume(const QString& journal_path, const QString& calib_path, Tracking& track);
+
+    DegorasInformation appendRange(const Tracking::RangeData& range);
+    DegorasInformation appendMeteo(const MeteoData& meteo);
+    // Stores the updated header (stats, shots, end date...) and flushes the journal.
+    DegorasInformation checkpoint(const Tracking& header);
+    // Stores the final header, writes the tracking file (see TrackingFileManager::writeTracking) and removes the
+    // journal.
+    DegorasInformation finalize(const Tracking& header, const QString& dest_dir = "", const QString& filename = "",
+                                JsonStreamWriter::Format format = JsonStreamWriter::Format::INDENTED);
+    void close();
+
+    inline bool isOpen() const {return this->m_file.isOpen();}
+    inline const QString& journalPath() const {return this->m_path;}
+    inline std::size_t rangesCount() const {return this->m_nranges;}
+
+    // Rebuilds the tracking from the last header and all the complete records of the journal.
+    static DegorasInformation recover(const QString& journal_path, const QString& calib_path, Tracking& track);
+
+private:
+
+    // If read_header is false, only the ranges and meteo data of track are replaced.
+    static DegorasInformation replay(const QString& journal_path, const QString& calib_path, bool read_header,
+                                     Tracking& track, qint64& valid_size);
+
+    void appendRecord(RecordType type, const char* payload, std::uint32_t size);
+    DegorasInformation appendHeader(const Tracking& header);
+    DegorasInformation flush();
+
+    QFile m_file;
+    QString m_path;
+    QByteArray m_buffer;
+    std::size_t m_checkpoint_interval;
+    std::size_t m_nranges;
+    std::size_t m_since_checkpoint;
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "tracking.h"
+#include "../spanview.h"
+#include "../dpcore_global.h"
+
+/**
+ * @brief Batch recomputation of the two way tropospheric delay (Marini-Murray) of the ranges.
+ *
+ * The ranges keep the delay computed at acquisition time. After a meteo fix, the delay of a whole pass can be
+ * recomputed here from the meteo data and the elevation of every shot. The kernel works on contiguous columns,
+ * without branches, so the compiler can vectorize it, and the pass is split in chunks on a thread pool.
+ */
+class DP_CORE_EXPORT TropoCorrection
+{
+public:
+
+    struct Config
+    {
+        double wavelength_um = 0.532;       ///< Laser wavelength (microns).
+        double latitude_deg = 0.;           ///< Station geodetic latitude (degrees).
+        double altitude_m = 0.;             ///< Station height over the ellipsoid (meters).
+        int max_threads = 0;
+        std::size_t chunk_size = std::size_t(1) << 15;
+    };
+
+    // Two way delay in picoseconds. Pressure in mbar, temperature in Kelvin, relative humidity in %.
+    static double mariniMurray(double pressure, double temp, double rel_hum, double elevation_deg,
+                               const Config& config);
+
+    // Element-wise mariniMurray over columns of the same size.
+    static void compute(SpanView<const double> pressure, SpanView<const double> temp, SpanView<const double> rel_hum,
+                        SpanView<const double> elevation_deg, SpanView<double> trop_corr_2w, const Config& config);
+
+    // Recomputes trop_corr_2w of every range, interpolating the tracking meteo data at the shot times (see
+    // MeteoSeries). elevations_deg holds the elevation of every range. Returns false, without changing the
+    // tracking, if there is no meteo data or the sizes do not match.
+    static bool recomputeTracking(Tracking& track, SpanView<const double> elevations_deg, const Config& config);
+};
@@ -1,8 +1,20 @@
+#pragma once
+
 #include <LibDegorasSLR/ILRS/algorithms/statistics.h>
 #include <LibDegorasBase/Helpers/container_helpers.h>
 #include <LibDegorasBase/Statistics/fitting.h>
 #include <LibDegorasBase/Statistics/histogram.h>
 
+#include "parallelchunks.h"
+#include "selectionmask.h"
+#include "spanview.h"
+#include "dpcore_global.h"
+
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+#include <vector>
+
 
 namespace algorithm{
 
@@ -25,7 +37,130 @@ std::vector<std::size_t> windowPrefilterPrivate(const std::vector<T> &resids, T
     return indexes;
 }
 
-std::vector<std::size_t> histPrefilterBinSLR(const std::vector<double> &resids_bin, double depth, unsigned min_ph);
+/**
+ * @brief Window prefilter that emits the selection as a mask over the residuals (see windowPrefilterPrivate).
+ */
+template <typename T>
+SelectionMask windowPrefilterMask(const std::vector<T> &resids, T upper, T lower)
+{
+    SelectionMask mask(resids.size());
+
+    // Check the input.
+    if(resids.empty() || upper <= lower)
+        return mask;
+
+    // Set the acepted residuals.
+    for(std::size_t i = 0; i < resids.size(); i++)
+        if(resids[i] <= upper && resids[i] >= lower)
+            mask.set(i);
+
+    // Return the mask.
+    return mask;
+}
+
+DP_CORE_EXPORT std::vector<std::size_t> histPrefilterSLR(const std::vector<double> &times,
+                                                         const std::vector<double> &resids, double bs, double depth,
+                                                         unsigned min_ph, unsigned divisions);
+
+DP_CORE_EXPORT std::vector<std::size_t> histPrefilterBinSLR(const std::vector<double> &resids_bin, double depth,
+                                                            unsigned min_ph);
+DP_CORE_EXPORT std::vector<std::size_t> histPrefilterBinSLR(SpanView<const double> resids_bin, double depth,
+                                                            unsigned min_ph);
+
+DP_CORE_EXPORT std::vector<std::size_t> histPostfilterSLR(const std::vector<double> &times,
+                                                          const std::vector<double> &data, double bs, double depth);
+
+// Versions of the SLR filters that emit the selection as a mask over the residuals.
+DP_CORE_EXPORT SelectionMask histPrefilterMaskSLR(const std::vector<double> &times, const std::vector<double> &resids,
+                                                  double bs, double depth, unsigned min_ph, unsigned divisions);
+
+DP_CORE_EXPORT SelectionMask histPostfilterMaskSLR(const std::vector<double> &times, const std::vector<double> &data,
+                                                   double bs, double depth);
+
+/**
+ * @brief Center of the limits of sigmaClipFilter.
+ */
+enum class ClipCenter
+{
+    MEAN,   ///< The limits are mean +- factor * stddev.
+    ZERO    ///< The limits are +- factor * stddev, as the Filter Tool threshold markers.
+};
+
+/**
+ * @brief Result of sigmaClipFilter.
+ */
+struct SigmaClipResult
+{
+    unsigned iterations = 0;    ///< Iterations done, including the last one if it rejected nothing.
+    std::size_t rejected = 0;   ///< Elements removed from the mask (including the non finite ones).
+    bool converged = false;     ///< True if the last iteration rejected nothing.
+    double mean = 0.;           ///< Mean of the accepted values.
+    double stddev = 0.;         ///< Standard deviation (population) of the accepted values.
+};
+
+/**
+ * @brief Iterative k-sigma rejection over the selected values.
+ *
+ * Every iteration rejects the selected values that are not strictly inside the limits (see ClipCenter), with the
+ * mean and standard deviation of the values accepted by the previous iteration, until an iteration rejects nothing
+ * or max_iterations is reached. The accepted values are kept in a compact column with running sums, so every
+ * iteration is one O(N) pass over the values still accepted, and only the rejected ones are subtracted from the
+ * sums (no second pass for the standard deviation).
+ *
+ * @param[in] values The values (for example, fit residuals).
+ * @param[in,out] mask The selected values. The rejected ones are reset. The size must be the size of the values.
+ * @param[in] factor Number of standard deviations of the limits.
+ * @param[in] max_iterations Maximum number of iterations.
+ * @param[in] center Center of the limits.
+ * @return The result of the rejection.
+ */
+DP_CORE_EXPORT SigmaClipResult sigmaClipFilter(SpanView<const double> values, SelectionMask& mask, double factor,
+                                               unsigned max_iterations, ClipCenter center = ClipCenter::MEAN);
+
+/**
+ * @brief Compile-time interval policy for the histogram bins.
+ *
+ * Selecting the boundaries at compile time removes the per element checks of the open/closed flags.
+ *
+ * @tparam ExMin True to exclude the minimum value (open interval).
+ * @tparam ExMax True to exclude the maximum value (open interval).
+ */
+template <bool ExMin, bool ExMax>
+struct BinInterval
+{
+    static constexpr bool ex_min = ExMin;
+    static constexpr bool ex_max = ExMax;
+
+    template <typename V, typename T>
+    static constexpr bool contains(const V& value, const T& min, const T& max)
+    {
+        return (ExMin ? value > min : value >= min) && (ExMax ? value < max : value <= max);
+    }
+};
+
+using ClosedOpenBin = BinInterval<false, true>;     ///< [min, max), the default interval.
+using OpenClosedBin = BinInterval<true, false>;     ///< (min, max]
+using ClosedBin = BinInterval<false, false>;        ///< [min, max]
+using OpenBin = BinInterval<true, true>;            ///< (min, max)
+
+/**
+ * @brief Count bin function with the interval selected at compile time.
+ *
+ * @tparam Interval One of the BinInterval policies.
+ * @param[in] container The container with the values.
+ * @param[in] min
+ * @param[in] max
+ * @return The number of elements in the container that are in the given interval.
+ */
+template <typename Interval, typename Container, typename T>
+unsigned countBin(const Container& container, T min, T max)
+{
+    // Convenient alias.
+    using ConType = typename Container::value_type;
+
+    return static_cast<unsigned>(std::count_if(container.begin(), container.end(),
+                                               [min, max](const ConType& i){return Interval::contains(i, min, max);}));
+}
 
 /**
  * @brief Custom count bin function.
@@ -45,31 +180,111 @@ std::vector<std::size_t> histPrefilterBinSLR(const std::vector<double> &resids_b
 template <typename Container, typename T>
 unsigned countBin(const Container& container, T min,T max, bool exmin = false, bool exmax = true)
 {
-    // Convenient alias.
-    using ConType = typename Container::value_type;
-
-    // Count the values.
-    unsigned counter = std::count_if(container.begin(), container.end(),
-                                     [&min, &max, &exmin, &exmax](const ConType& i)
-                                     {
-                                         bool result;
-                                         if(exmin && exmax)
-                                             result = (i > min) && (i < max);
-                                         else if(exmin && !exmax)
-                                             result = (i > min) && (i <= max);
-
-                                         else if(!exmin && exmax)
-                                             result = (i >= min) && (i < max);
-                                         else
-                                             result = (i >= min) && (i <= max);
-                                         return result;
-                                     });
-    // Return the result.
-    return counter;
+    // Select the interval once, instead of for every element.
+    if(exmin && exmax)
+        return countBin<OpenBin>(container, min, max);
+    else if(exmin && !exmax)
+        return countBin<OpenClosedBin>(container, min, max);
+    else if(!exmin && exmax)
+        return countBin<ClosedOpenBin>(container, min, max);
+    else
+        return countBin<ClosedBin>(container, min, max);
 }
 
+/**
+ * @brief One pass histogram counting engine.
+ *
+ * The bin of every value is computed directly from its position, instead of scanning the data once per bin, so
+ * the cost is O(N + nbins). The bins are [min_edge + i * div, min_edge + i * div + div] with the Interval
+ * boundaries, computed exactly as they are reported by histcounts1D. The candidate bins of a block of values are
+ * computed in a branchless loop (vectorized by the compiler), and then checked against the bin edges. Large inputs
+ * are split between threads, each one with a private histogram, merged at the end.
+ *
+ * @note A value is counted in a single bin, except with ClosedBin, where values on an inner edge are counted in
+ *       both bins, as countBin does. A value on the top edge is counted in the last bin if its interval contains it,
+ *       so with ClosedBin the counts are the ones of countBin with the reported edges.
+ */
+template <typename Interval, typename T>
+void histCountsPrivate(const T* data, std::size_t size, std::size_t nbins, T min_edge, T div,
+                       std::vector<unsigned>& counts)
+{
+    counts.assign(nbins, 0);
+    if (nbins == 0 || size == 0 || !(div > 0))
+        return;
+
+    constexpr std::size_t kBlock = 256;
+    constexpr std::size_t kParallelMin = std::size_t(1) << 15;
+    const long long nblocks = static_cast<long long>((size + kBlock - 1) / kBlock);
+    const long long last_bin = static_cast<long long>(nbins) - 1;
+    const T max_pos = static_cast<T>(nbins);
+
+    // Inside a parallelChunks kernel the threads are already busy, so the histogram is counted serially instead of
+    // starting an OpenMP team on every pool thread.
+#pragma omp parallel if(size >= kParallelMin && !inParallelChunks())
+    {
+        std::vector<unsigned> local(nbins, 0);
+        long long candidates[kBlock];
+
+#pragma omp for schedule(static) nowait
+        for (long long block = 0; block < nblocks; block++)
+        {
+            const std::size_t begin = static_cast<std::size_t>(block) * kBlock;
+            const std::size_t count = std::min(kBlock, size - begin);
+            const T* values = data + begin;
 
-template <typename C>
+            // Candidate bins. NaN and far away values are clamped to a bin that is rejected below.
+            for (std::size_t j = 0; j < count; j++)
+            {
+                const T pos = (values[j] - min_edge) / div;
+                const T clamped = pos == pos ? std::min(std::max(pos, T(-1)), max_pos) : T(-1);
+                candidates[j] = static_cast<long long>(std::floor(clamped));
+            }
+
+            // Edge checks against the reported bin edges, and scatter.
+            for (std::size_t j = 0; j < count; j++)
+            {
+                const T value = values[j];
+                long long bin = candidates[j];
+                T lower = min_edge + bin * div;
+                if (Interval::ex_min ? value <= lower : value < lower)
+                    lower = min_edge + --bin * div;
+                else if (!Interval::contains(value, lower, lower + div))
+                    lower = min_edge + ++bin * div;
+
+                // A value on or rounded past the top edge gets the candidate bin nbins, so it is checked against
+                // the last bin, as countBin does with the reported edges.
+                if (bin == last_bin + 1)
+                {
+                    const T last_lower = min_edge + last_bin * div;
+                    if (Interval::contains(value, last_lower, last_lower + div))
+                        lower = min_edge + --bin * div;
+                }
+
+                if (bin < 0 || bin > last_bin || !Interval::contains(value, lower, lower + div))
+                    continue;
+                local[static_cast<std::size_t>(bin)]++;
+
+                // With closed bins, a value on an edge shared with a neighbour bin (also when the rounded edges
+                // overlap) is counted in both.
+                if constexpr (!Interval::ex_min && !Interval::ex_max)
+                {
+                    const T prev_lower = min_edge + (bin - 1) * div;
+                    if (bin > 0 && Interval::contains(value, prev_lower, prev_lower + div))
+                        local[static_cast<std::size_t>(bin - 1)]++;
+                    const T next_lower = min_edge + (bin + 1) * div;
+                    if (bin < last_bin && Interval::contains(value, next_lower, next_lower + div))
+                        local[static_cast<std::size_t>(bin + 1)]++;
+                }
+            }
+        }
+
+#pragma omp critical
+        for (std::size_t i = 0; i < nbins; i++)
+            counts[i] += local[i];
+    }
+}
+
+template <typename Interval = ClosedOpenBin, typename C>
 dpbase::stats::types::HistCountRes<C> histcounts1D(const C& data, size_t nbins, typename C::value_type min_edge,
                                                    typename C::value_type max_edge)
 {
@@ -82,23 +297,21 @@ dpbase::stats::types::HistCountRes<C> histcounts1D(const C& data, size_t nbins,
     // Get the division.
     ConType div = (max_edge - min_edge) / nbins;
 
-    // Parallel loop for each bin.
+    // Count all the bins in one pass.
+    std::vector<unsigned> counts;
+    histCountsPrivate<Interval>(data.data(), data.size(), nbins, min_edge, div, counts);
+
     for (size_t i = 0; i < nbins; i++ )
     {
-        // Update the next counter.
         ConType min = min_edge + i * div;
-        ConType max = min + div;
-        // Count the data in the bin.
-        unsigned counter = countBin(data, min,  max);
-        // Push the new data in the result vector, and update the min counter.
-        result[i] = {counter, min, max};
+        result[i] = {counts[i], min, min + div};
     }
 
     // Return the result.
     return result;
 }
 
-template <typename C>
+template <typename Interval = ClosedOpenBin, typename C>
 dpbase::stats::types::HistCountBin<C> histcounts1D(const C& data, size_t nbins)
 {
     // Convenient alias.
@@ -106,6 +319,8 @@ dpbase::stats::types::HistCountBin<C> histcounts1D(const C& data, size_t nbins)
 
     // Return container.
     std::vector<std::tuple<unsigned, ConType, ConType>> result(nbins);
+    if (data.empty())
+        return result;
 
     // Get the minimum and maximum values.
     auto minmax = std::minmax_element(data.begin(), data.end());
@@ -115,18 +330,14 @@ dpbase::stats::types::HistCountBin<C> histcounts1D(const C& data, size_t nbins)
     // Get the division.
     ConType div = (std::abs(max_counter) + std::abs(min_counter)) / nbins;
 
-    // Parallel loop for each bin.
-    omp_set_num_threads(omp_get_num_procs());
-#pragma omp parallel for
+    // Count all the bins in one pass.
+    std::vector<unsigned> counts;
+    histCountsPrivate<Interval>(data.data(), data.size(), nbins, min_counter, div, counts);
+
     for (size_t i = 0; i < nbins; i++ )
     {
-        // Update the next counter.
         ConType min = min_counter + i * div;
-        ConType max = min + div;
-        // Count the data in the bin.
-        unsigned counter = countBin(data, min,  max);
-        // Push the new data in the result vector, and update the min counter.
-        result[i] = {counter, min, max};
+        result[i] = {counts[i], min, min + div};
     }
 
     // Return the result.
@@ -134,200 +345,46 @@ dpbase::stats::types::HistCountBin<C> histcounts1D(const C& data, size_t nbins)
 }
 
 
+/**
+ * @brief Splits sorted times in bins of bs seconds.
+ *
+ * As the times are sorted, every bin is a contiguous range of indexes. The bins are returned as offsets: the bin b
+ * is [offsets[b], offsets[b + 1]), so there is one offset more than bins. Empty bins are not stored.
+ *
+ * @return The offsets of the bins, or an empty container if the input is not valid.
+ */
 template<typename T, typename R>
-std::vector<std::vector<std::size_t>> extractBins(const std::vector<T> &times, const std::vector<R> &resids,
-                                                             double bs)
+std::vector<std::size_t> extractBinOffsets(const std::vector<T> &times, const std::vector<R> &resids, double bs)
 {
     // Check the input data.
     if (times.empty() || resids.empty() || times.size() != resids.size() || bs <= 0)
         return {};
 
     // Containers and auxiliar variables.
-    std::vector<std::vector<std::size_t>> bins;
-    std::vector<std::size_t> current_bin;
-
+    std::vector<std::size_t> offsets{0};
 
     // Get the first bin.
-    int last_bin = static_cast<int>(std::floor(times[0]/bs) + 1);
+    long long last_bin = static_cast<long long>(std::floor(times[0]/bs) + 1);
 
     // Generate the bins.
-    for (std::size_t i = 0; i < times.size(); i++)
+    for (std::size_t i = 1; i < times.size(); i++)
     {
         // Get the current bin.
-        int bin = static_cast<int>(std::floor(times[i]/bs) + 1);
+        long long bin = static_cast<long long>(std::floor(times[i]/bs) + 1);
 
-        // Check if the current bin has changed.
+        // Check if the current bin has changed. In that case, a new bin starts here.
         if(last_bin != bin)
         {
-            // New bin section.
             last_bin = bin;
-            bins.push_back(std::move(current_bin));
-
-            // Clear the bin container.
-            current_bin = {};
+            offsets.push_back(i);
         }
-
-        // Stores the bin data.
-        current_bin.push_back(i);
     }
 
-    // Store the last bin.
-    bins.push_back(std::move(current_bin));
-
+    // Close the last bin.
+    offsets.push_back(times.size());
 
-    // Return the bins.
-    return bins;
+    // Return the bin offsets.
+    return offsets;
 }
 
-
-std::vector<std::size_t> histPrefilterSLR(const std::vector<double> &times, const std::vector<double> &resids,
-                                                     double bs, double depth, unsigned min_ph, unsigned divisions)
-{
-    // Check the input data.
-    if (times.empty() || resids.empty() || times.size() != resids.size() || depth <= 0 || bs <= 0 || divisions <= 0)
-        return {};
-
-    // Containers and auxiliar variables.
-    std::vector<std::size_t> selected_ranges;
-    std::size_t first = 0;
-    double _depth = depth/divisions;
-    unsigned _min_ph = min_ph/divisions;
-    auto bins_indexes = algorithm::extractBins(times, resids, bs);
-
-    for (const auto& bin_indexes : bins_indexes)
-    {
-        // Compute selected ranges from the bin
-        auto bin_resids = dpbase::helpers::containers::extract(resids, bin_indexes);
-        auto bin_selected = algorithm::histPrefilterBinSLR(bin_resids, _depth, _min_ph);
-        std::transform(bin_selected.begin(), bin_selected.end(), std::back_inserter(selected_ranges),
-                       [first](const auto& idx){return  idx + first;});
-
-        // Update the first bin index variable.
-        first += bin_indexes.size();
-    }
-
-    // Return the result container.
-    return selected_ranges;
-}
-
-std::vector<std::size_t> histPrefilterBinSLR(const std::vector<double> &resids_bin, double depth, unsigned min_ph)
-{
-    std::vector<std::size_t> selected_ranges;
-
-    // Check if the residuals bin is not empty.
-    if(!resids_bin.empty())
-    {
-        // Compute the range gate width.
-        auto edges = std::minmax_element(resids_bin.begin(), resids_bin.end());
-        long double rg_width = std::abs(*edges.first) + std::abs(*edges.second);
-
-        // Get the histogram division size.
-        std::size_t hist_size = static_cast<std::size_t>(std::floor(rg_width/depth));
-
-        // Calculate histogram of residuals in bin.
-        auto histcount_res = histcounts1D(resids_bin, hist_size, *edges.first, *edges.second);
-
-
-        // Check which histogram bins have more than min_photons count. They will be selected.
-        //        std::vector<std::size_t> sel_bins;
-        //        for (std::size_t bin_idx = 0; bin_idx < histcount_res.size(); bin_idx++)
-        //            if (std::get<0>(histcount_res[bin_idx]) >= min_photons)
-        //                sel_bins.push_back(bin_idx);
-
-        //        // Get points which are inside of selected histogram bins
-        //        for (std::size_t res_idx = 0; res_idx < resids_bin.size(); res_idx++)
-        //        {
-        //            bool select = false;
-        //            std::size_t sel_bin_idx = 0;
-        //            while(!select && sel_bin_idx < sel_bins.size())
-        //            {
-        //                const auto& bin_res = histcount_res[sel_bins[sel_bin_idx]];
-        //                if (resids_bin[res_idx] >= std::get<1>(bin_res) && resids_bin[res_idx] < std::get<2>(bin_res))
-        //                    select = true;
-        //                sel_bin_idx++;
-        //            }
-
-        //            // Store the selected range.
-        //            if (select)
-        //                selected_ranges.push_back(res_idx);
-        //        }
-
-        //        auto it = std::max_element(histcount_res.begin(), histcount_res.end(),
-        //                         [](const auto& a, const auto& b){return std::get<0>(a) < std::get<0>(b);});
-
-        //        if (it != histcount_res.end() && std::get<0>(*it) >= min_photons)
-        //        {
-        //            // Get points which are inside of selected histogram bins
-        //            for (std::size_t res_idx = 0; res_idx < resids_bin.size(); res_idx++)
-        //            {
-        //                if (resids_bin[res_idx] >= std::get<1>(*it) && resids_bin[res_idx] < std::get<2>(*it))
-        //                    selected_ranges.push_back(res_idx);
-        //            }
-        //        }
-
-        auto it = std::max_element(histcount_res.begin(), histcount_res.end(),
-                                   [](const auto& a, const auto& b){return std::get<0>(a) < std::get<0>(b);});
-
-        if (it != histcount_res.end() && std::get<0>(*it) >= min_ph)
-        {
-            // Iterator pointing to first bin NOT valid
-            auto it_lower = it - 1;
-            auto it_upper = it + 1;
-
-            while (it_lower >= histcount_res.begin() && std::get<0>(*it_lower) >= min_ph)
-                it_lower--;
-
-            while (it_upper != histcount_res.end() && std::get<0>(*it_upper) >= min_ph)
-                it_upper++;
-
-            // Get points which are inside of selected histogram bins
-            for (std::size_t res_idx = 0; res_idx < resids_bin.size(); res_idx++)
-            {
-                bool select = false;
-                auto it_bin = it_lower + 1;
-                while(!select && it_bin < it_upper)
-                {
-                    if (resids_bin[res_idx] >= std::get<1>(*it_bin) && resids_bin[res_idx] < std::get<2>(*it_bin))
-                        select = true;
-                    it_bin++;
-                }
-
-                // Store the selected range.
-                if (select)
-                    selected_ranges.push_back(res_idx);
-            }
-        }
-
-    }
-
-    return selected_ranges;
-}
-
-std::vector<std::size_t> histPostfilterSLR(const std::vector<double> &times, const std::vector<double> &data,
-                                           double bs, double depth)
-{
-    // Call to the prefilter disabling the ph contributions.
-    //return histPrefilterSLR(times, data, bs, depth, 0);
-
-    // Auxiliar containers.
-    std::vector<double> detrend_resids;
-    std::vector<std::size_t> sel_indexes;
-    double rf = depth *1.5; // depth / 2 * 2.5
-    std::vector<double> y_vec;
-
-    // Detrend the residuals.
-    //detrend_resids = dpslr::math::detrend(times, data, 9);
-
-    auto coefs = dpbase::stats::polynomialFit(times, data, 9);
-
-    for (std::size_t i = 0; i < data.size(); i++)
-    {
-        double y_interp = dpbase::stats::applyPolynomial(coefs, times[i]);
-
-        if (data[i] >= y_interp - rf && data[i] <= y_interp + rf)
-            sel_indexes.push_back(i);
-
-    }
-    return sel_indexes;
-}
 }
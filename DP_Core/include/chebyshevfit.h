@@ -0,0 +1,84 @@
+#pragma once
+
+#include "spanview.h"
+#include "dpcore_global.h"
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief Least squares polynomial fit in a scaled Chebyshev basis.
+ *
+ * The x values are mapped to [-1, 1] with the interval given at construction, so the basis columns stay well
+ * conditioned even for x in seconds of day or nanoseconds and high degrees. As the Chebyshev polynomials are nearly
+ * orthogonal on that interval, the normal equations keep that conditioning. The points are accumulated into them in
+ * a single streaming pass, in blocks that the compiler vectorizes, without storing them, and the coefficients are
+ * solved when needed (Cholesky). If there are not enough independent points for the degree, the highest degree that
+ * can be solved is used.
+ */
+class DP_CORE_EXPORT ChebyshevFit
+{
+public:
+
+    ChebyshevFit() = default;
+    ChebyshevFit(unsigned degree, double x_min, double x_max);
+
+    inline unsigned degree() const {return this->m_degree;}
+    inline std::size_t count() const {return this->m_count;}
+    inline double xMin() const {return this->m_x_min;}
+    inline double xMax() const {return this->m_x_max;}
+    // Chebyshev coefficients of the last solve, from T0. They apply to the scaled x (see scale).
+    inline const std::vector<double>& coefficients() const {return this->m_coefs;}
+    inline bool solved() const {return !this->m_coefs.empty();}
+
+    // Accumulation of points. Invalidates the previous solution. Points with non finite values are ignored.
+    void add(double x, double y);
+    void add(SpanView<const double> x, SpanView<const double> y);
+    // Removes points that were added before, for example the rejected ones of a clipping loop.
+    void remove(SpanView<const double> x, SpanView<const double> y);
+    // Removes the accumulated points, keeping the degree and the interval.
+    void reset();
+
+    // Computes the coefficients. Returns false if there are no points.
+    bool solve();
+
+    // Evaluation of the solved fit (Clenshaw). Without a solution, the values are NaN.
+    double evaluate(double x) const;
+    // Batched evaluation in blocks, vectorizable by the compiler. The output must have the size of x.
+    void evaluate(SpanView<const double> x, SpanView<double> y) const;
+
+    // Maps x to [-1, 1] within the fit interval.
+    double scale(double x) const;
+
+    // Fit of a whole data set, with the interval from the minimum and maximum x.
+    static ChebyshevFit fit(SpanView<const double> x, SpanView<const double> y, unsigned degree);
+
+    // Independent fits of the bins [offsets[b], offsets[b + 1]) of x and y (see algorithm::extractBinOffsets), in
+    // parallel. The result has one solved fit per bin, in order.
+    static std::vector<ChebyshevFit> fitBins(SpanView<const double> x, SpanView<const double> y,
+                                             const std::vector<std::size_t>& offsets, unsigned degree,
+                                             int max_threads = 0);
+    // Evaluates every bin of x with its fit.
+    static void evaluateBins(const std::vector<ChebyshevFit>& fits, SpanView<const double> x,
+                             const std::vector<std::size_t>& offsets, SpanView<double> y, int max_threads = 0);
+
+private:
+
+    // Fills the basis values T0..Tdegree of count scaled x, stored by degree with the given stride.
+    void basis(const double* t, std::size_t count, std::size_t stride, double* values) const;
+    // Adds (sign 1) or removes (sign -1) points to the normal equations.
+    void update(SpanView<const double> x, SpanView<const double> y, double sign);
+    // Adds a block of basis values (see basis) and y to the normal equations, with the given sign.
+    void accumulate(const double* values, const double* y, std::size_t count, std::size_t stride, double sign);
+
+    unsigned m_degree = 0;
+    double m_x_min = -1.;
+    double m_x_max = 1.;
+    double m_center = 0.;
+    double m_inv_half_width = 1.;
+    std::size_t m_count = 0;
+    std::vector<double> m_gram;     ///< A^T A, upper triangle, row major, (degree + 1)^2.
+    std::vector<double> m_aty;      ///< A^T y.
+    std::vector<double> m_coefs;
+    std::vector<double> m_block;    ///< Scratch basis values for add.
+};
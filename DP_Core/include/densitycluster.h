@@ -0,0 +1,50 @@
+#pragma once
+
+#include "selectionmask.h"
+#include "spanview.h"
+#include "dpcore_global.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace algorithm{
+
+/**
+ * @brief Clusters of a set of 2D points (see densityClusters).
+ */
+struct DP_CORE_EXPORT DensityClusters
+{
+    static constexpr int kNoise = -1;
+
+    std::vector<int> labels;            ///< Cluster of every point, or kNoise.
+    std::vector<std::size_t> sizes;     ///< Points of every cluster.
+
+    // Points of the clusters with at least min_size points.
+    SelectionMask selection(std::size_t min_size = 1) const;
+};
+
+/**
+ * @brief Density based clustering (DBSCAN) of the points (times[i], resids[i]).
+ *
+ * The distance is anisotropic: two points are neighbours if (dt / time_radius)^2 + (dr / resid_radius)^2 <= 1. A
+ * point is a core point if it has at least min_points neighbours (itself included). The clusters are the connected
+ * groups of core points, plus the other points with a core neighbour (assigned to the cluster of the closest one).
+ * The rest is noise.
+ *
+ * The neighbours are found with a uniform grid over the scaled points, with cells of side 1 / sqrt(2), so all the
+ * points of a cell are neighbours of each other and only the 5x5 cells around a point have to be visited:
+ *   - The points of a cell with at least min_points points are core points without computing any distance, and
+ *     the counts of the others stop as soon as they reach min_points.
+ *   - The clusters are built over the cells with core points: two such cells are joined if they hold a pair of
+ *     core neighbours, which is searched only until the first one is found.
+ * So the cost is O(N) on average for a bounded density. The points are sorted by cell (which, for points sorted in
+ * time, only sorts the residuals of every time column), and the cells are processed in parallel.
+ *
+ * The clusters are numbered in the order of their first cell (time major). Points with non finite coordinates are
+ * noise. If a radius is not positive, or min_points is 0, all the points are noise.
+ */
+DP_CORE_EXPORT DensityClusters densityClusters(SpanView<const double> times, SpanView<const double> resids,
+                                               double time_radius, double resid_radius, std::size_t min_points,
+                                               int max_threads = 0);
+
+}
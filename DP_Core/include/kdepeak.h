@@ -0,0 +1,49 @@
+#pragma once
+
+#include "spanview.h"
+#include "dpcore_global.h"
+
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+namespace algorithm{
+
+/**
+ * @brief Peak of the kernel density estimate of a set of values.
+ *
+ * NaN location and width, and zero density and count, if there are no finite values.
+ */
+struct KdePeak
+{
+    std::size_t count = 0;      ///< Finite values used.
+    double location = std::numeric_limits<double>::quiet_NaN();    ///< Position of the highest density.
+    double width = std::numeric_limits<double>::quiet_NaN();       ///< Full width at half maximum of the peak.
+    double density = 0.;        ///< Density at the peak (fraction of the values per unit).
+};
+
+/**
+ * @brief Peak of the Gaussian kernel density estimate of the values.
+ *
+ * The values are spread once over a regular grid (linear binning, one point per bandwidth), which is convolved with
+ * the Gaussian kernel by multiplying its FFT with the transform of the kernel. The peak is refined with a parabola
+ * through the logarithms of the three highest grid points (exact for a Gaussian peak), so its precision is a small
+ * fraction of the grid spacing, and it does not depend on the phase of any histogram bins. The width is measured
+ * where the density falls to half of the peak.
+ *
+ * @param values The values (for example, the residuals of a time bin). Non finite values are ignored.
+ * @param bandwidth Standard deviation of the Gaussian kernel. Typically the expected width of the signal.
+ * @return The peak. If the bandwidth is not positive, only the count is set.
+ */
+DP_CORE_EXPORT KdePeak kdePeak(SpanView<const double> values, double bandwidth);
+
+/**
+ * @brief Peaks of the kernel density estimates of every bin [offsets[i], offsets[i + 1]) of the values (see
+ *        extractBinOffsets). The bins are processed in parallel, each task reusing its grid and FFT tables, and two
+ *        bins share every transform.
+ */
+DP_CORE_EXPORT std::vector<KdePeak> kdePeakBins(SpanView<const double> values,
+                                                const std::vector<std::size_t>& offsets, double bandwidth,
+                                                int max_threads = 0);
+
+}
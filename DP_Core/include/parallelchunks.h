@@ -0,0 +1,71 @@
+#pragma once
+
+#include <QThread>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <cstddef>
+
+/**
+ * @brief Number of chunks of at most chunk_size elements needed to cover count elements.
+ */
+inline std::size_t chunkCount(std::size_t count, std::size_t chunk_size)
+{
+    chunk_size = std::max<std::size_t>(chunk_size, 1);
+    return (count + chunk_size - 1) / chunk_size;
+}
+
+/**
+ * @brief True on the threads running the kernels of parallelChunks, so nested parallel code (for example an OpenMP
+ *        region) can run serially instead of multiplying the threads.
+ */
+inline bool& inParallelChunks()
+{
+    static thread_local bool value = false;
+    return value;
+}
+
+/**
+ * @brief Runs a kernel over consecutive chunks of [0, count) on a thread pool.
+ *
+ * Chunks are numbered in order, so kernels can write their results into per chunk slots and merge them
+ * afterwards in the same order as the input. With a single chunk or a single thread everything runs on the
+ * calling thread.
+ *
+ * @param count Number of elements.
+ * @param chunk_size Maximum number of elements per chunk.
+ * @param max_threads Concurrency limit. If it is 0 or less, the ideal thread count is used.
+ * @param kernel Callable with signature void(std::size_t chunk, std::size_t begin, std::size_t end). It must be
+ *               thread safe.
+ */
+template <typename Kernel>
+void parallelChunks(std::size_t count, std::size_t chunk_size, int max_threads, Kernel kernel)
+{
+    chunk_size = std::max<std::size_t>(chunk_size, 1);
+    const std::size_t chunks = chunkCount(count, chunk_size);
+    const int threads = static_cast<int>(std::min<std::size_t>(
+                max_threads > 0 ? max_threads : QThread::idealThreadCount(), chunks));
+
+    if (threads <= 1)
+    {
+        for (std::size_t c = 0; c < chunks; c++)
+            kernel(c, c * chunk_size, std::min(count, (c + 1) * chunk_size));
+        return;
+    }
+
+    // Own pool, so the limit does not change the global one and the wait only covers these chunks.
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    for (std::size_t c = 0; c < chunks; c++)
+    {
+        pool.start([&kernel, c, chunk_size, count]
+        {
+            bool& nested = inParallelChunks();
+            const bool previous = nested;
+            nested = true;
+            kernel(c, c * chunk_size, std::min(count, (c + 1) * chunk_size));
+            nested = previous;
+        });
+    }
+    pool.waitForDone();
+}
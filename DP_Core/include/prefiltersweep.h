@@ -0,0 +1,88 @@
+#pragma once
+
+#include "dpcore_global.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Evaluation of a grid of histogram prefilter parameters (algorithm::histPrefilterSLR) over a set of passes.
+ *
+ * Every configuration is evaluated as the prefilter would select, without running it once per configuration:
+ *   - The time bins of every bin size are split once per pass, and the residuals of every time bin are sorted once,
+ *     with prefix sums, for all the configurations of that bin size.
+ *   - The histogram of a time bin is built once for every histogram width (depth / divisions), by walking the
+ *     sorted residuals, and shared by all the configurations with that width.
+ *   - The run of histogram bins selected for every min_ph / divisions is the same index range of the sorted
+ *     residuals, so the kept count and the moments of a configuration come from the prefix sums.
+ *
+ * The rounding of the histogram edges is reproduced as histCountsPrivate computes them, so the kept counts are the ones of
+ * histPrefilterSLR. The kept range of a time bin may include a few residuals lying between two rounded edges, which
+ * are left out of the counts and moments but not of the stability.
+ *
+ * The stability of a configuration is the mean Jaccard index between its kept ranges and the ones of its neighbours
+ * in the grid (the previous and next depth and min_ph, with the same bin size and divisions). A value close to 1
+ * means that the selection does not change when the parameters move one step. It is NaN without neighbours.
+ *
+ * The time bins are processed in parallel. The passes are copied when added, so a sweep can be run many times.
+ */
+class DP_CORE_EXPORT PrefilterSweep
+{
+public:
+
+    struct Grid
+    {
+        std::vector<double> bin_sizes;      ///< Time bins (seconds).
+        std::vector<double> depths;         ///< Histogram bin widths (ps).
+        std::vector<unsigned> min_phs;
+        std::vector<unsigned> divisions;
+    };
+
+    struct Params
+    {
+        double bin_size = 0.;
+        double depth = 0.;
+        unsigned min_ph = 0;
+        unsigned divisions = 1;
+    };
+
+    struct Result
+    {
+        Params params;
+        std::size_t kept = 0;               ///< Kept residuals over all the passes.
+        double mean = 0.;                   ///< Mean of the kept residuals.
+        double rms = 0.;                    ///< RMS of the kept residuals about their mean.
+        double stability = 0.;              ///< See the class description.
+    };
+
+    // Adds a pass. The times must be sorted and have the size of the residuals.
+    void addPass(const std::vector<double>& times, const std::vector<double>& resids);
+    void clearPasses();
+    inline std::size_t passCount() const {return this->m_times.size();}
+
+    // Evaluates every combination of the grid values. The values of every axis are sorted and the repeated ones
+    // removed, and the results are ordered by bin size, depth, min_ph and divisions. Configurations with
+    // parameters that the prefilter rejects (not positive) keep nothing.
+    std::vector<Result> run(const Grid& grid, int max_threads = 0) const;
+
+private:
+
+    // A time bin of a pass.
+    struct TimeBin
+    {
+        std::size_t pass;
+        std::size_t first;
+        std::size_t count;
+    };
+
+    // Kept range [first, last) of the sorted residuals of a time bin.
+    struct KeptRange
+    {
+        std::uint32_t first = 0;
+        std::uint32_t last = 0;
+    };
+
+    std::vector<std::vector<double>> m_times;
+    std::vector<std::vector<double>> m_resids;
+};
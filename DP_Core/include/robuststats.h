@@ -0,0 +1,102 @@
+#pragma once
+
+#include "selectionmask.h"
+#include "spanview.h"
+#include "dpcore_global.h"
+
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+namespace algorithm{
+
+// Factor from the MAD to the standard deviation of a normal distribution.
+constexpr double kMadToStddev = 1.482602218505602;
+
+/**
+ * @brief Robust location and dispersion of a set of values.
+ *
+ * The median and the MAD use the mean of the two central values when the count is even. The trimmed mean drops
+ * floor(fraction * count) values from every end, and the winsorized mean replaces them with the nearest kept
+ * value. Everything is NaN when there are no values.
+ */
+struct RobustStats
+{
+    std::size_t count = 0;      ///< Finite values used.
+    double median = std::numeric_limits<double>::quiet_NaN();
+    double mad = std::numeric_limits<double>::quiet_NaN();  ///< Not scaled (see kMadToStddev).
+    double trimmed_mean = std::numeric_limits<double>::quiet_NaN();
+    double winsorized_mean = std::numeric_limits<double>::quiet_NaN();
+};
+
+// The functions below use the finite values, selected in the mask if there is one (the mask must have the size of
+// the values). They copy the values once and use selection (nth_element) instead of sorting, so the cost is a few
+// linear passes.
+
+DP_CORE_EXPORT double median(SpanView<const double> values);
+DP_CORE_EXPORT double median(SpanView<const double> values, const SelectionMask& mask);
+
+// Quantile q in [0, 1], interpolated linearly between the closest values.
+DP_CORE_EXPORT double quantile(SpanView<const double> values, double q);
+DP_CORE_EXPORT double quantile(SpanView<const double> values, const SelectionMask& mask, double q);
+
+DP_CORE_EXPORT double medianAbsoluteDeviation(SpanView<const double> values);
+DP_CORE_EXPORT double medianAbsoluteDeviation(SpanView<const double> values, const SelectionMask& mask);
+
+// The fraction (in [0, 0.5)) of values trimmed or winsorized from every end.
+DP_CORE_EXPORT double trimmedMean(SpanView<const double> values, double fraction);
+DP_CORE_EXPORT double trimmedMean(SpanView<const double> values, const SelectionMask& mask, double fraction);
+DP_CORE_EXPORT double winsorizedMean(SpanView<const double> values, double fraction);
+DP_CORE_EXPORT double winsorizedMean(SpanView<const double> values, const SelectionMask& mask, double fraction);
+
+// All the statistics at once, sharing the copy and the selections.
+DP_CORE_EXPORT RobustStats robustStats(SpanView<const double> values, double fraction);
+DP_CORE_EXPORT RobustStats robustStats(SpanView<const double> values, const SelectionMask& mask, double fraction);
+
+// Statistics of every bin [offsets[i], offsets[i + 1]) of the values (see extractBinOffsets). The bins are processed
+// in parallel, each task reusing its scratch buffer.
+DP_CORE_EXPORT std::vector<RobustStats> robustStatsBins(SpanView<const double> values,
+                                                        const std::vector<std::size_t>& offsets, double fraction,
+                                                        int max_threads = 0);
+DP_CORE_EXPORT std::vector<RobustStats> robustStatsBins(SpanView<const double> values, const SelectionMask& mask,
+                                                        const std::vector<std::size_t>& offsets, double fraction,
+                                                        int max_threads = 0);
+
+/**
+ * @brief Streaming estimation of a quantile with constant memory (P-square algorithm, Jain and Chlamtac).
+ *
+ * Keeps five markers whose heights are adjusted with a piecewise parabolic interpolation as the values arrive, so
+ * every value costs O(1) and the values are not stored. The estimate is exact up to five values. Use it when the
+ * values can not be kept (for example, while the ranges are read), and the selection based functions otherwise.
+ */
+class DP_CORE_EXPORT QuantileSketch
+{
+public:
+
+    explicit QuantileSketch(double q = 0.5);
+
+    // Adds a value. Non finite values are ignored.
+    void add(double value);
+    void add(SpanView<const double> values);
+    void add(SpanView<const double> values, const SelectionMask& mask);
+    void reset();
+
+    inline double q() const {return this->m_q;}
+    inline std::size_t count() const {return this->m_count;}
+    // Current estimate. NaN if there are no values.
+    double value() const;
+
+private:
+
+    double parabolic(int i, double d) const;
+    double linear(int i, double d) const;
+
+    double m_q;
+    std::size_t m_count = 0;
+    double m_heights[5];        ///< Marker heights.
+    double m_positions[5];      ///< Actual marker positions (1 based).
+    double m_desired[5];        ///< Desired marker positions.
+    double m_increments[5];     ///< Increments of the desired positions.
+};
+
+}
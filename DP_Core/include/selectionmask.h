@@ -0,0 +1,89 @@
+#pragma once
+
+#include "Tracking/tracking.h"
+#include "spanview.h"
+#include "dpcore_global.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Selection of ranges as a bitset, one bit per range.
+ *
+ * Filters produce a SelectionMask over the ranges (or residuals) they get, so chaining them is a few word wide
+ * operations (and, or, and not) instead of merging sorted index lists. The bits beyond size() in the last word are
+ * always zero, so the word loops and the counts do not need to mask them.
+ */
+class DP_CORE_EXPORT SelectionMask
+{
+public:
+
+    using Word = std::uint64_t;
+    using FilterFlag = Tracking::RangeData::FilterFlag;
+    static constexpr std::size_t kWordBits = 64;
+
+    SelectionMask() = default;
+    explicit SelectionMask(std::size_t size, bool value = false);
+
+    // Index lists. Indexes out of the size are ignored.
+    static SelectionMask fromIndexes(const std::vector<std::size_t>& indexes, std::size_t size);
+    std::vector<std::size_t> toIndexes() const;
+
+    // Filter flags. A range is selected if its flag is the given one.
+    static SelectionMask fromFlags(SpanView<const std::uint8_t> flags, FilterFlag flag = FilterFlag::DATA);
+    static SelectionMask fromFlags(const std::vector<Tracking::RangeData>& ranges, FilterFlag flag = FilterFlag::DATA);
+    // Sets the flag of every range, selected or not. The size must be the size of the mask.
+    void applyFlags(SpanView<std::uint8_t> flags, FilterFlag selected = FilterFlag::DATA,
+                    FilterFlag unselected = FilterFlag::NOISE) const;
+    void applyFlags(std::vector<Tracking::RangeData>& ranges, FilterFlag selected = FilterFlag::DATA,
+                    FilterFlag unselected = FilterFlag::NOISE) const;
+
+    inline std::size_t size() const {return this->m_size;}
+    inline bool empty() const {return this->m_size == 0;}
+    inline SpanView<const Word> words() const {return this->m_words;}
+
+    inline bool test(std::size_t idx) const
+    {
+        return (this->m_words[idx / kWordBits] >> (idx % kWordBits)) & Word(1);
+    }
+    inline void set(std::size_t idx, bool value = true)
+    {
+        const Word bit = Word(1) << (idx % kWordBits);
+        Word& word = this->m_words[idx / kWordBits];
+        word = value ? word | bit : word & ~bit;
+    }
+    inline void reset(std::size_t idx) {this->set(idx, false);}
+    void fill(bool value);
+    void resize(std::size_t size, bool value = false);
+
+    // Number of selected elements.
+    std::size_t count() const;
+    bool any() const;
+    inline bool none() const {return !this->any();}
+    inline bool all() const {return this->count() == this->m_size;}
+
+    // Number of selected elements before idx.
+    std::size_t rank(std::size_t idx) const;
+    // Index of the selected element number k (from 0), or size() if there are not so many.
+    std::size_t select(std::size_t k) const;
+
+    // Word wide operations. The masks must have the same size.
+    SelectionMask& operator&=(const SelectionMask& other);
+    SelectionMask& operator|=(const SelectionMask& other);
+    SelectionMask& andNot(const SelectionMask& other);
+    SelectionMask& invert();
+
+    friend inline SelectionMask operator&(SelectionMask a, const SelectionMask& b) {return a &= b;}
+    friend inline SelectionMask operator|(SelectionMask a, const SelectionMask& b) {return a |= b;}
+    friend inline SelectionMask operator~(SelectionMask a) {return a.invert();}
+    bool operator==(const SelectionMask& other) const;
+    inline bool operator!=(const SelectionMask& other) const {return !(*this == other);}
+
+private:
+
+    static inline std::size_t wordCount(std::size_t size) {return (size + kWordBits - 1) / kWordBits;}
+    void clearTail();
+
+    std::vector<Word> m_words;
+    std::size_t m_size = 0;
+};
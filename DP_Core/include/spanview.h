@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief Non-owning view of a contiguous sequence of elements (the subset of std::span used in DP_Core).
+ *
+ * A view is only valid while the viewed storage is alive and not reallocated.
+ */
+template <typename T>
+class SpanView
+{
+public:
+
+    using element_type = T;
+    using value_type = std::remove_cv_t<T>;
+    using iterator = T*;
+
+    constexpr SpanView() noexcept : m_data(nullptr), m_size(0) {}
+    constexpr SpanView(T* data, std::size_t size) noexcept : m_data(data), m_size(size) {}
+
+    template <typename U, typename = std::enable_if_t<std::is_convertible_v<U(*)[], T(*)[]>>>
+    constexpr SpanView(const SpanView<U>& other) noexcept : m_data(other.data()), m_size(other.size()) {}
+
+    template <typename U, typename A, typename = std::enable_if_t<std::is_convertible_v<U(*)[], T(*)[]>>>
+    SpanView(std::vector<U, A>& vector) noexcept : m_data(vector.data()), m_size(vector.size()) {}
+
+    template <typename U, typename A, typename = std::enable_if_t<std::is_convertible_v<const U(*)[], T(*)[]>>>
+    SpanView(const std::vector<U, A>& vector) noexcept : m_data(vector.data()), m_size(vector.size()) {}
+
+    constexpr T* data() const noexcept {return this->m_data;}
+    constexpr std::size_t size() const noexcept {return this->m_size;}
+    constexpr bool empty() const noexcept {return this->m_size == 0;}
+
+    constexpr T& operator[](std::size_t idx) const {return this->m_data[idx];}
+    constexpr T& front() const {return this->m_data[0];}
+    constexpr T& back() const {return this->m_data[this->m_size - 1];}
+
+    constexpr iterator begin() const noexcept {return this->m_data;}
+    constexpr iterator end() const noexcept {return this->m_data + this->m_size;}
+
+    constexpr SpanView subspan(std::size_t offset, std::size_t count) const {return {this->m_data + offset, count};}
+    constexpr SpanView first(std::size_t count) const {return {this->m_data, count};}
+    constexpr SpanView last(std::size_t count) const {return {this->m_data + this->m_size - count, count};}
+
+private:
+
+    T* m_data;
+    std::size_t m_size;
+};
@@ -0,0 +1,230 @@
+#include "Tracking/autofilter.h"
+#include "Tracking/trackingfilemanager.h"
+#include "algorithms.h"
+#include "chebyshevfit.h"
+
+#include <LibDegorasSLR/ILRS/algorithms/statistics.h>
+
+#include <cmath>
+
+const QMap<AutoFilter::ErrorEnum, QString> AutoFilter::ErrorListStringMap =
+{
+    {AutoFilter::ErrorEnum::AUTOFILTER_NOT_ENOUGH_DATA,
+     "The tracking %1 has not enough ranges to be filtered (%2 accepted)."},
+    {AutoFilter::ErrorEnum::AUTOFILTER_STATS_FAILED,
+     "The statistics of the tracking %1 could not be computed."},
+};
+
+AutoFilter::AutoFilter(const Config &config) :
+    m_config(config)
+{}
+
+DegorasInformation AutoFilter::filter(const Tracking &track, Result &result)
+{
+    return this->filterFrom(track, RangeRowsView(track.ranges), result);
+}
+
+DegorasInformation AutoFilter::filter(const Tracking &track, const RangeColumns &ranges, Result &result)
+{
+    return this->filterFrom(track, ranges, result);
+}
+
+template <typename Ranges>
+DegorasInformation AutoFilter::filterFrom(const Tracking &track, const Ranges &ranges, Result &result)
+{
+    const Config& config = this->m_config;
+    const double bin_size = config.bin_size > 0 ? config.bin_size : static_cast<double>(track.obj_bs);
+
+    // Residuals of the ranges with an echo, in a single pass over the ranges.
+    this->m_candidates.clear();
+    this->m_times.clear();
+    this->m_resids.clear();
+    const double cal_val = track.residualCalibration();
+    DayRollover rollover;
+    for (std::size_t i = 0; i < ranges.size(); i++)
+    {
+        // Every start time goes through the rollover, so the day changes are seen even without echoes.
+        const Epoch time = rollover(ranges.startTime(i));
+        if (ranges.tof(i) == 0.)
+            continue;
+        this->m_candidates.push_back(i);
+        this->m_times.push_back(time.toSecondsDouble());
+        this->m_resids.push_back(ranges.residual(i, cal_val));
+    }
+
+    // Stage 1, histogram prefilter.
+    SelectionMask mask(this->m_candidates.size(), true);
+    if (config.prefilter)
+        mask = algorithm::histPrefilterMaskSLR(this->m_times, this->m_resids, bin_size, config.prefilter_depth,
+                                               config.prefilter_min_ph, config.prefilter_divisions);
+
+    // Stage 2, postfilter around the pass fit.
+    if (config.postfilter && mask.any())
+    {
+        this->compact(mask);
+        const SelectionMask post = algorithm::histPostfilterMaskSLR(this->m_sel_times, this->m_sel_resids, bin_size,
+                                                                    config.postfilter_depth);
+        for (std::size_t k = 0; k < this->m_sel.size(); k++)
+            if (!post.test(k))
+                mask.reset(this->m_sel[k]);
+    }
+
+    // Stage 3, clipping.
+    result.iterations = 0;
+    this->compact(mask);
+    if (!this->m_sel.empty())
+    {
+        this->splitBins(bin_size);
+        auto fits = ChebyshevFit::fitBins(this->m_sel_times, this->m_sel_resids, this->m_offsets, config.fit_degree,
+                                          config.max_threads);
+        this->m_weights.assign(this->m_sel.size(), 1.);
+        while (result.iterations < config.max_iterations)
+        {
+            result.iterations++;
+            if (this->clip(fits) == 0)
+                break;
+        }
+        for (std::size_t k = 0; k < this->m_sel.size(); k++)
+            if (this->m_weights[k] == 0.)
+                mask.reset(this->m_sel[k]);
+    }
+
+    // Stage 4, statistics of the accepted residuals.
+    this->compact(mask);
+    if (this->m_sel.size() < std::max<std::size_t>(config.min_ranges, 1))
+        return DegorasInformation({AUTOFILTER_NOT_ENOUGH_DATA,
+                                   ErrorListStringMap[AUTOFILTER_NOT_ENOUGH_DATA].arg(
+                                   TrackingFileManager::trackingFilename(track)).arg(this->m_sel.size())});
+
+    dpslr::ilrs::algorithms::RangeDataV rd;
+    rd.reserve(this->m_sel.size());
+    for (std::size_t k = 0; k < this->m_sel.size(); k++)
+    {
+        dpslr::ilrs::algorithms::RangeDataV::value_type item;
+        item.ts = static_cast<long double>(this->m_sel_times[k]);
+        item.resid = this->m_sel_resids[k];
+        rd.push_back(item);
+    }
+    const double stats_bin_size = config.stats_bin_size > 0 ? config.stats_bin_size :
+                                      this->m_sel_times.back() - this->m_sel_times.front() + 100.;
+    dpslr::ilrs::algorithms::ResidualsStats resid;
+    if (dpslr::ilrs::algorithms::calculateResidualsStats(static_cast<int>(stats_bin_size), rd, resid) !=
+        dpslr::ilrs::algorithms::ResiStatsCalcErr::NOT_ERROR)
+        return DegorasInformation({AUTOFILTER_STATS_FAILED,
+                                   ErrorListStringMap[AUTOFILTER_STATS_FAILED].arg(
+                                   TrackingFileManager::trackingFilename(track))});
+
+    // Selection over the tracking ranges.
+    result.selection = SelectionMask(ranges.size());
+    for (std::size_t k = 0; k < this->m_sel.size(); k++)
+        result.selection.set(this->m_candidates[this->m_sel[k]]);
+    result.stats_1rms = resid.total_bin_stats.stats_1rms;
+    result.stats_rfrms = resid.total_bin_stats.stats_rfrms;
+
+    return {};
+}
+
+DegorasInformation AutoFilter::process(Tracking &track)
+{
+    Result result;
+    DegorasInformation errors = this->filter(track, result);
+    if (errors.hasError())
+        return errors;
+
+    for (std::size_t idx : this->m_candidates)
+        track.ranges[idx].flag = result.selection.test(idx) ? Tracking::RangeData::FilterFlag::DATA :
+                                                              Tracking::RangeData::FilterFlag::NOISE;
+    track.stats_1rms = result.stats_1rms;
+    track.stats_rfrms = result.stats_rfrms;
+    track.filter_mode = Tracking::FilterMode::AUTO;
+
+    return errors;
+}
+
+void AutoFilter::compact(const SelectionMask &mask)
+{
+    this->m_sel = mask.toIndexes();
+    this->m_sel_times.resize(this->m_sel.size());
+    this->m_sel_resids.resize(this->m_sel.size());
+    for (std::size_t k = 0; k < this->m_sel.size(); k++)
+    {
+        this->m_sel_times[k] = this->m_times[this->m_sel[k]];
+        this->m_sel_resids[k] = this->m_resids[this->m_sel[k]];
+    }
+}
+
+void AutoFilter::splitBins(double bin_size)
+{
+    // A new bin starts when the time passes the bin start by bin_size.
+    const std::size_t count = this->m_sel.size();
+    this->m_offsets.assign(1, 0);
+    double bin_start = this->m_sel_times.front();
+    for (std::size_t k = 1; k < count; k++)
+    {
+        if (this->m_sel_times[k] - bin_start > bin_size)
+        {
+            this->m_offsets.push_back(k);
+            bin_start = this->m_sel_times[k];
+        }
+    }
+    this->m_offsets.push_back(count);
+}
+
+std::size_t AutoFilter::clip(std::vector<ChebyshevFit> &fits)
+{
+    const std::size_t count = this->m_sel.size();
+    const double* weights = this->m_weights.data();
+
+    // Fit errors, stored over the fit values. Only the active elements (weight 1) enter the sums: a bin with all its
+    // elements rejected has no fit, and its errors are NaN.
+    this->m_fit.resize(count);
+    ChebyshevFit::evaluateBins(fits, this->m_sel_times, this->m_offsets, this->m_fit, this->m_config.max_threads);
+    double* errors = this->m_fit.data();
+    const double* resids = this->m_sel_resids.data();
+    double sum = 0.;
+    double nactive = 0.;
+    for (std::size_t k = 0; k < count; k++)
+    {
+        errors[k] = resids[k] - errors[k];
+        if (weights[k] != 0.)
+        {
+            sum += errors[k];
+            nactive += 1.;
+        }
+    }
+    if (nactive == 0.)
+        return 0;
+    const double mean = sum / nactive;
+    double sum_sq = 0.;
+    for (std::size_t k = 0; k < count; k++)
+        if (weights[k] != 0.)
+            sum_sq += (errors[k] - mean) * (errors[k] - mean);
+    const double thresh = this->m_config.sigma_factor * std::sqrt(sum_sq / nactive);
+    if (!(thresh > 0.))
+        return 0;
+
+    // Rejection, with the same strict limits as the Filter Tool threshold markers. The rejected elements are removed
+    // from the fit of their bin.
+    std::size_t rejected = 0;
+    for (std::size_t bin = 0; bin + 1 < this->m_offsets.size(); bin++)
+    {
+        this->m_rej_times.clear();
+        this->m_rej_resids.clear();
+        for (std::size_t k = this->m_offsets[bin]; k < this->m_offsets[bin + 1]; k++)
+        {
+            if (this->m_weights[k] != 0. && !(errors[k] > -thresh && errors[k] < thresh))
+            {
+                this->m_weights[k] = 0.;
+                this->m_rej_times.push_back(this->m_sel_times[k]);
+                this->m_rej_resids.push_back(resids[k]);
+            }
+        }
+        if (!this->m_rej_times.empty())
+        {
+            fits[bin].remove(this->m_rej_times, this->m_rej_resids);
+            fits[bin].solve();
+            rejected += this->m_rej_times.size();
+        }
+    }
+    return rejected;
+}
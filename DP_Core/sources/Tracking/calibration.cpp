@@ -1,7 +1,7 @@
 #include "Tracking/calibration.h"
 
 Calibration::RangeData::RangeData():
-    start_time(0.0),
+    start_time(),
     tof_2w(0.0),
     flag(Calibration::RangeData::FilterFlag::UNKNOWN)
 {
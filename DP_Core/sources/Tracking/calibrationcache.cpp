@@ -0,0 +1,68 @@
+#include "Tracking/calibrationcache.h"
+#include "Tracking/calibrationfilemanager.h"
+
+#include <QFileInfo>
+
+CalibrationCache &CalibrationCache::instance()
+{
+    static CalibrationCache cache;
+    return cache;
+}
+
+DegorasInformation CalibrationCache::calibration(const QString &cal_name, const QString &dir_path,
+                                                 CalibrationPtr &calib)
+{
+    const QString path = dir_path.isEmpty() ? CalibrationFileManager::findCalibration(cal_name) :
+                                              dir_path + '/' + cal_name;
+    const QFileInfo info(path);
+    if (path.isEmpty() || !info.exists())
+        return DegorasInformation({CalibrationFileManager::ErrorEnum::CALIBFILE_NOT_OPEN,
+                                  CalibrationFileManager::ErrorListStringMap[
+                                       CalibrationFileManager::ErrorEnum::CALIBFILE_NOT_OPEN].arg(cal_name)});
+
+    std::shared_ptr<Slot> slot;
+    {
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        std::shared_ptr<Slot>& entry = this->m_slots[cal_name];
+        if (!entry)
+            entry = std::make_shared<Slot>();
+        slot = entry;
+    }
+
+    // Only the requests of the same calibration are serialized.
+    std::lock_guard<std::mutex> lock(slot->mutex);
+    const qint64 mtime = info.lastModified().toMSecsSinceEpoch();
+    if (!slot->calib || slot->path != path || slot->mtime != mtime || slot->size != info.size())
+    {
+        auto loaded = std::make_shared<Calibration>();
+        DegorasInformation errors = CalibrationFileManager::readCalibration(info.fileName(), info.path(), *loaded);
+        if (errors.hasError())
+            return errors;
+
+        slot->path = path;
+        slot->mtime = mtime;
+        slot->size = info.size();
+        slot->calib = std::move(loaded);
+    }
+
+    calib = slot->calib;
+    return {};
+}
+
+void CalibrationCache::invalidate(const QString &cal_name)
+{
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+    this->m_slots.remove(cal_name);
+}
+
+void CalibrationCache::clear()
+{
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+    this->m_slots.clear();
+}
+
+std::size_t CalibrationCache::size() const
+{
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+    return static_cast<std::size_t>(this->m_slots.size());
+}
@@ -1,16 +1,23 @@
 #include "Tracking/calibrationfilemanager.h"
 #include "Tracking/tracking.h"
+#include "Tracking/jsonstreamreader.h"
+#include "Tracking/calibrationcache.h"
+#include "Tracking/parallelfileloader.h"
 #include "degoras_settings.h"
 #include "window_message_box.h"
-#include "LibDegorasBase/Helpers/string_helpers.h"
 
 #include <QFile>
 #include <QJsonDocument>
 #include <QJsonArray>
 #include <QJsonObject>
 #include <QDir>
+#include <QFileInfo>
+#include <QLockFile>
+#include <QSaveFile>
 #include <QString>
 
+#include <algorithm>
+
 
 const QString kDateStartKey = QStringLiteral("date");
 const QString kCfgIdKey = QStringLiteral("cfg_id");
@@ -38,6 +45,14 @@ const QString kEtKey = QStringLiteral("et_data");
 const QString kTAKey = QStringLiteral("tA");
 const QString kTBKey = QStringLiteral("tB");
 const QString kETPrecisionKey = QStringLiteral("precision");
+const QString kManifestVersionKey = QStringLiteral("version");
+const QString kManifestLastDirKey = QStringLiteral("last_dir");
+const QString kManifestLatestKey = QStringLiteral("latest");
+const QString kManifestFileKey = QStringLiteral("file");
+const QString kLatestManifestFilename = QStringLiteral("latest_calibrations.json");
+const QString kLatestManifestLockFilename = QStringLiteral("latest_calibrations.json.lock");
+constexpr int kLatestManifestVersion = 1;
+constexpr int kLatestManifestLockTimeoutMs = 2000;
 
 const QMap<CalibrationFileManager::ErrorEnum, QString> CalibrationFileManager::ErrorListStringMap =
 {
@@ -45,8 +60,109 @@ const QMap<CalibrationFileManager::ErrorEnum, QString> CalibrationFileManager::E
      "The calibration json file %1 is not valid."},
     {CalibrationFileManager::ErrorEnum::CALIBFILE_NOT_OPEN,
      "The calibration json file %1 could not be opened."},
+    {CalibrationFileManager::ErrorEnum::CALIB_MANIFEST_LOCKED,
+     "The latest calibrations manifest %1 is locked by another writer."},
 };
 
+namespace
+{
+
+// Smallest json representation of a range, used to bound the reserve done from nshots.
+constexpr std::size_t kMinRangeBytes = 16;
+
+void headerFromJson(const QJsonObject& json, Calibration& calib)
+{
+    calib.date_start = QDateTime::fromString(json[kDateStartKey].toString(), Qt::ISODateWithMs);
+    calib.cfg_id = json[kCfgIdKey].toString();
+    calib.station_name = json[kStationNameKey].toString();
+    calib.station_id = json[kStationIdKey].toInt();
+    calib.type = static_cast<Calibration::Type>(json[kCalTypeKey].toInt());
+    calib.target_dist_2w = json[kTgtDistKey].toDouble();
+    calib.target_tof_2w = {json[kTgtToFKey].toDouble(), decltype(calib.target_tof_2w)::Unit::LIGHT_PS};
+    calib.rf = json[kRFKey].toDouble();
+    calib.nshots = json[kNShotsKey].toInt();
+    calib.rnshots = json[kRNShotsKey].toInt();
+    calib.unshots = json[kUNShotsKey].toInt();
+    calib.tror_rfrms = json[kTRORRFRMSKey].toDouble();
+    calib.tror_1rms = json[kTROR1RMSKey].toDouble();
+    calib.cal_val_rfrms = json[kCalValRFRMSKey].toDouble();
+    calib.cal_val_1rms = json[kCalVal1RMSKey].toDouble();
+
+    calib.meteo = MeteoData::fromJson(json[kMeteoKey].toObject());
+
+    calib.stats_rfrms = StatsFromJson(json[kStatsRFRMSKey].toObject());
+    calib.stats_1rms = StatsFromJson(json[kStats1RMSKey].toObject());
+}
+
+bool readRanges(JsonStreamReader& reader, std::vector<Calibration::RangeData>& ranges)
+{
+    if (reader.token() == JsonStreamReader::Token::NULL_VALUE)
+        return true;
+    if (reader.token() != JsonStreamReader::Token::BEGIN_ARRAY)
+        return false;
+
+    static const std::string flag_key = kFlagKey.toStdString();
+    static const std::string start_key = kStartKey.toStdString();
+    static const std::string tof_key = kToFKey.toStdString();
+
+    while (reader.next() == JsonStreamReader::Token::BEGIN_OBJECT)
+    {
+        Calibration::RangeData echo;
+        while (reader.next() == JsonStreamReader::Token::KEY)
+        {
+            const std::string_view key = reader.text();
+            const bool is_flag = key == flag_key;
+            const bool is_start = key == start_key;
+            const bool is_tof = key == tof_key;
+
+            // Only scalars are converted. Anything else is skipped whole, so the reader never stays inside it.
+            const JsonStreamReader::Token token = reader.next();
+            const bool scalar = token == JsonStreamReader::Token::NUMBER || token == JsonStreamReader::Token::STRING;
+            if (is_flag && scalar)
+                echo.flag = Calibration::RangeData::flagFromInt(reader.toInt());
+            else if (is_start && scalar)
+                reader.toEpoch(echo.start_time);
+            else if (is_tof && token == JsonStreamReader::Token::NUMBER)
+                echo.tof_2w = reader.toDouble();
+            else if (!reader.skipValue())
+                return false;
+        }
+
+        if (reader.token() != JsonStreamReader::Token::END_OBJECT)
+            return false;
+        ranges.push_back(echo);
+    }
+
+    return reader.token() == JsonStreamReader::Token::END_ARRAY;
+}
+
+bool readEt(JsonStreamReader& reader, Calibration& calib)
+{
+    if (reader.token() == JsonStreamReader::Token::NULL_VALUE)
+        return true;
+    if (reader.token() != JsonStreamReader::Token::BEGIN_OBJECT)
+        return false;
+
+    bool valid = true;
+    while (valid && reader.next() == JsonStreamReader::Token::KEY)
+    {
+        const QString key = reader.toString();
+        reader.next();
+        if (key == kTAKey)
+            valid = reader.readEpochArray(calib.tA);
+        else if (key == kTBKey)
+            valid = reader.readEpochArray(calib.tB);
+        else if (key == kETPrecisionKey)
+            calib.et_precision = static_cast<unsigned>(reader.toInt());
+        else
+            valid = reader.skipValue();
+    }
+
+    return valid && reader.token() == JsonStreamReader::Token::END_OBJECT;
+}
+
+}
+
 // TODO: long double?
 // TODO: validation of values?
 DegorasInformation CalibrationFileManager::readCalibration(const QString &cal_name, const QString &dir_path, Calibration &calib)
@@ -111,10 +227,10 @@ DegorasInformation CalibrationFileManager::writeCalibration(const Calibration& c
     for (const auto& elem : calib.ranges)
     {
         QJsonObject obj;
-        // TODO: check values of enum
-        obj.insert(kFlagKey, static_cast<int>(elem.flag));
-        obj.insert(kStartKey, static_cast<double>(elem.start_time));
-        obj.insert(kToFKey, elem.flag == Calibration::RangeData::FilterFlag::UNKNOWN ?
+        const auto flag = Calibration::RangeData::flagFromInt(static_cast<int>(elem.flag));
+        obj.insert(kFlagKey, static_cast<int>(flag));
+        obj.insert(kStartKey, elem.start_time.toString());
+        obj.insert(kToFKey, flag == Calibration::RangeData::FilterFlag::UNKNOWN ?
                        QJsonValue() : static_cast<double>(elem.tof_2w));
         array.push_back(obj);
     }
@@ -123,13 +239,13 @@ DegorasInformation CalibrationFileManager::writeCalibration(const Calibration& c
     QJsonObject et_object;
     array = {};
     std::transform(calib.tA.begin(), calib.tA.end(), std::back_inserter(array),
-                   [](const auto& a){return QString::fromStdString(dpbase::helpers::strings::numberToStr(a, 18, 12));});
+                   [](const auto& a){return a.toString();});
     if (!array.empty())
         et_object.insert(kTAKey, array);
 
     array = {};
     std::transform(calib.tB.begin(), calib.tB.end(), std::back_inserter(array),
-                   [](const auto& a){return QString::fromStdString(dpbase::helpers::strings::numberToStr(a, 18, 12));});
+                   [](const auto& a){return a.toString();});
     if (!array.empty())
         et_object.insert(kTBKey, array);
 
@@ -143,68 +259,106 @@ DegorasInformation CalibrationFileManager::writeCalibration(const Calibration& c
     calib_file.write(calib_jsondocument.toJson(QJsonDocument::Indented));
     calib_file.close();
 
+    // Trackings loaded from now on must see the new contents, even if the modification time does not change.
+    CalibrationCache::instance().invalidate(file_path.section('/', -1));
+
+    // Keep the latest calibration manifest updated when writing to the historical calibrations.
+    const QString hist_calpath =
+            DegorasSettings::instance().getGlobalConfigString("SalaraProjectDataPaths/SP_HistoricalCalibrations");
+    const QFileInfo dest_info(dest_dir);
+    if (dest_info.absolutePath() == QFileInfo(hist_calpath).absoluteFilePath())
+        return CalibrationFileManager::updateLatestManifest(
+                    hist_calpath, calib, dest_info.fileName() + '/' + file_path.section('/', -1));
+
     // Return the errors
     return {};
 }
 
-DegorasInformation CalibrationFileManager::readCalibrationDir(const QString &dir, std::vector<Calibration> &calibs)
+DegorasInformation CalibrationFileManager::readCalibrationDir(const QString &dir, std::vector<Calibration> &calibs,
+                                                             int max_threads)
 {
-    Calibration c;
-    DegorasInformation result;
+    QStringList files;
     for (auto&& file : QDir(dir).entryList({"*.dpcr"}, QDir::Files))
-    {
-        auto errors = CalibrationFileManager::readCalibration(file, dir, c);
-        result.append(errors);
-        if (!errors.hasError())
-            calibs.push_back(c);
-    }
-    return result;
+        files.push_back(dir + '/' + file);
+
+    return loadFilesParallel(files, [](const QString& file, Calibration& c)
+                             {return CalibrationFileManager::readCalibrationFromFile(file, c);},
+                             calibs, max_threads);
 }
 
 DegorasInformation CalibrationFileManager::readLastCalib(Calibration &calib)
+{
+    return CalibrationFileManager::readLastCalib(calib, 0, {});
+}
+
+DegorasInformation CalibrationFileManager::readLastCalib(Calibration &calib, unsigned int station_id,
+                                                        const QString &cfg_id)
 {
     QString hist_calpath =
             DegorasSettings::instance().getGlobalConfigString("SalaraProjectDataPaths/SP_HistoricalCalibrations");
-    QStringList dirs = QDir(hist_calpath).entryList(QDir::Dirs, QDir::Name);
-
-    QDateTime last_calib_dt(QDateTime::fromMSecsSinceEpoch(0));
-    QString last_calib_name;
-    DegorasInformation errors;
-    auto dir_it = dirs.crbegin();
 
-    if (!dirs.empty())
+    // Usually a single read of the manifest. It is rebuilt from the historical tree if it is missing or stale, or if
+    // the chosen calibration does not exist anymore: the manifest only checks the referenced files when the newest
+    // day directory changes, so a calibration removed from an older day is found here.
+    QJsonObject manifest;
+    DegorasInformation errors = CalibrationFileManager::loadLatestManifest(hist_calpath, manifest);
+    bool rebuild = errors.hasError();
+    while (true)
     {
-        do
+        if (rebuild)
+        {
+            // Without the lock, the manifest is only rebuilt in memory.
+            QLockFile lock(hist_calpath + '/' + kLatestManifestLockFilename);
+            const bool locked = !CalibrationFileManager::lockLatestManifest(hist_calpath, lock).hasError();
+            errors = CalibrationFileManager::rebuildLatestManifest(hist_calpath, manifest, locked);
+            if (errors.hasError())
+                return errors;
+        }
+
+        QDateTime last_calib_dt(QDateTime::fromMSecsSinceEpoch(0));
+        QString last_calib_file;
+        for (const auto& elem : manifest.value(kManifestLatestKey).toArray())
         {
-            for (const auto& filename : QDir(hist_calpath + '/' + *dir_it).entryList(QDir::Files))
+            const QJsonObject entry = elem.toObject();
+            if ((station_id != 0 && entry[kStationIdKey].toInt() != static_cast<int>(station_id)) ||
+                (!cfg_id.isEmpty() && entry[kCfgIdKey].toString() != cfg_id))
+                continue;
+
+            QDateTime calib_dt = QDateTime::fromString(entry[kDateStartKey].toString(), Qt::ISODateWithMs);
+            if (calib_dt > last_calib_dt)
             {
-                QDateTime calib_dt(CalibrationFileManager::startDateTime(filename));
-                if (calib_dt > last_calib_dt)
-                {
-                    last_calib_name = filename;
-                    last_calib_dt = calib_dt;
-                }
+                last_calib_file = entry[kManifestFileKey].toString();
+                last_calib_dt = calib_dt;
             }
+        }
 
-            dir_it++;
+        if (!rebuild && !last_calib_file.isEmpty() && !QFile::exists(hist_calpath + '/' + last_calib_file))
+        {
+            rebuild = true;
+            continue;
+        }
 
-        } while (last_calib_name.isEmpty() && dir_it != dirs.crend());
-    }
+        if (last_calib_file.isEmpty())
+            errors = {{ErrorEnum::CALIB_NOT_FOUND, "Last calibration file not found"}};
+        else
+            errors = CalibrationFileManager::readCalibrationFromFile(hist_calpath + '/' + last_calib_file, calib);
 
-    if (last_calib_name.isEmpty())
-    {
-        errors = {{ErrorEnum::CALIB_NOT_FOUND, "Last calibration file not found"}};
+        return errors;
     }
-    else
-    {
-        dir_it--;
-        errors = CalibrationFileManager::readCalibrationFromFile(
-                    hist_calpath + '/' + *dir_it + '/' + last_calib_name, calib);
-    }
-
-    return errors;
 }
 
+DegorasInformation CalibrationFileManager::rebuildLatestManifest()
+{
+    QString hist_calpath =
+            DegorasSettings::instance().getGlobalConfigString("SalaraProjectDataPaths/SP_HistoricalCalibrations");
+    QLockFile lock(hist_calpath + '/' + kLatestManifestLockFilename);
+    DegorasInformation errors = CalibrationFileManager::lockLatestManifest(hist_calpath, lock);
+    if (errors.hasError())
+        return errors;
+
+    QJsonObject manifest;
+    return CalibrationFileManager::rebuildLatestManifest(hist_calpath, manifest);
+}
 
 QString CalibrationFileManager::calibrationFilename(const Calibration &calib)
 {
@@ -271,91 +425,201 @@ DegorasInformation CalibrationFileManager::readCalibrationFromFile(const QString
 {
     QFile calib_file(filepath);
     // Check if file could be opened.
-    if(!calib_file.open(QIODevice::ReadOnly | QIODevice::Text))
+    if(!calib_file.open(QIODevice::ReadOnly))
         return DegorasInformation({CalibrationFileManager::ErrorEnum::CALIBFILE_NOT_OPEN,
                                   ErrorListStringMap[ErrorEnum::CALIBFILE_NOT_OPEN].arg(filepath)});
 
-    // Read all.
-    QString calib_string = calib_file.readAll().simplified();
+    // Ensure object is cleared
+    calib = Calibration();
+
+    // Parse the file in one pass. Ranges and ET data are filled directly, the header fields are collected in a
+    // small json object.
+    JsonStreamReader reader(calib_file);
+    QJsonObject header;
+    bool valid = reader.next() == JsonStreamReader::Token::BEGIN_OBJECT;
+    while (valid && reader.next() == JsonStreamReader::Token::KEY)
+    {
+        const QString key = reader.toString();
+        reader.next();
+
+        if (key == kRangesKey)
+        {
+            // Reserve using nshots, but never more than the file could hold.
+            const std::size_t nshots = static_cast<std::size_t>(header.value(kNShotsKey).toInt());
+            calib.ranges.reserve(std::min(nshots, static_cast<std::size_t>(calib_file.size()) / kMinRangeBytes));
+            valid = readRanges(reader, calib.ranges);
+        }
+        else if (key == kEtKey)
+            valid = readEt(reader, calib);
+        else
+            header.insert(key, reader.readValue());
+
+        valid = valid && !reader.hasError();
+    }
+    valid = valid && reader.token() == JsonStreamReader::Token::END_OBJECT;
     calib_file.close();
-    // Loads the json document.
-    QJsonDocument json = QJsonDocument::fromJson(calib_string.toUtf8());
 
     // Check if scheme is valid
     DegorasInformation::ErrorList error_list;
 
     // Check if data file is valid
-    if (json.isNull())
-    {
+    if (!valid)
         error_list.append({ErrorEnum::CALIBFILE_INVALID, ErrorListStringMap[ErrorEnum::CALIBFILE_INVALID].arg(filepath)});
-    }
     else
+        headerFromJson(header, calib);
+
+    // Return the errors
+    return DegorasInformation(error_list);
+}
+
+DegorasInformation CalibrationFileManager::loadLatestManifest(const QString &hist_calpath, QJsonObject &manifest)
+{
+    const QString manifest_path = hist_calpath + '/' + kLatestManifestFilename;
+    QFile manifest_file(manifest_path);
+    if (!manifest_file.open(QIODevice::ReadOnly))
+        return DegorasInformation({ErrorEnum::CALIBFILE_NOT_OPEN,
+                                  ErrorListStringMap[ErrorEnum::CALIBFILE_NOT_OPEN].arg(manifest_path)});
+
+    QJsonDocument json = QJsonDocument::fromJson(manifest_file.readAll());
+    manifest_file.close();
+    if (!json.isObject() || json.object().value(kManifestVersionKey).toInt() != kLatestManifestVersion)
+        return DegorasInformation({ErrorEnum::CALIBFILE_INVALID,
+                                  ErrorListStringMap[ErrorEnum::CALIBFILE_INVALID].arg(manifest_path)});
+
+    manifest = json.object();
+
+    // Stale if a day directory newer than the ones scanned has been created by other means. The referenced
+    // calibrations are only checked if the newest day directory changed after the manifest was written, as
+    // writeCalibration updates the manifest after writing the file.
+    const QStringList dirs = QDir(hist_calpath).entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name);
+    bool stale = !dirs.isEmpty() && dirs.back() > manifest.value(kManifestLastDirKey).toString();
+    if (!stale && !dirs.isEmpty() &&
+        QFileInfo(hist_calpath + '/' + dirs.back()).lastModified() > QFileInfo(manifest_path).lastModified())
     {
-        // Ensure object is cleared
-        calib = Calibration();
-
-        calib.date_start = QDateTime::fromString(json[kDateStartKey].toString(), Qt::ISODateWithMs);
-        calib.cfg_id = json[kCfgIdKey].toString();
-        calib.station_name = json[kStationNameKey].toString();
-        calib.station_id = json[kStationIdKey].toInt();
-        calib.type = static_cast<Calibration::Type>(json[kCalTypeKey].toInt());
-        calib.target_dist_2w = json[kTgtDistKey].toDouble();
-        calib.target_tof_2w = {json[kTgtToFKey].toDouble(), decltype(calib.target_tof_2w)::Unit::LIGHT_PS};
-        calib.rf = json[kRFKey].toDouble();
-        calib.nshots = json[kNShotsKey].toInt();
-        calib.rnshots = json[kRNShotsKey].toInt();
-        calib.unshots = json[kUNShotsKey].toInt();
-        calib.tror_rfrms = json[kTRORRFRMSKey].toDouble();
-        calib.tror_1rms = json[kTROR1RMSKey].toDouble();
-        calib.cal_val_rfrms = json[kCalValRFRMSKey].toDouble();
-        calib.cal_val_1rms = json[kCalVal1RMSKey].toDouble();
-
-        calib.meteo = MeteoData::fromJson(json[kMeteoKey].toObject());
-
-        calib.stats_rfrms = StatsFromJson(json[kStatsRFRMSKey].toObject());
-        calib.stats_1rms = StatsFromJson(json[kStats1RMSKey].toObject());
-
-        QJsonArray array = json[kRangesKey].toArray();
-        for (const auto& elem : std::as_const(array))
-        {
-            QJsonObject obj = elem.toObject();
-            Calibration::RangeData echo;
-            // TODO: check values of enum
-            echo.flag = static_cast<Calibration::RangeData::FilterFlag>(obj[kFlagKey].toInt());
-            echo.start_time = obj[kStartKey].toDouble();
-            echo.tof_2w = obj[kToFKey].toDouble();
-            calib.ranges.push_back(echo);
-        }
+        for (const auto& elem : manifest.value(kManifestLatestKey).toArray())
+            stale = stale || !QFile::exists(hist_calpath + '/' + elem.toObject().value(kManifestFileKey).toString());
+    }
+
+    if (stale)
+        return DegorasInformation({ErrorEnum::CALIBFILE_INVALID,
+                                  ErrorListStringMap[ErrorEnum::CALIBFILE_INVALID].arg(manifest_path)});
 
-        // TODO: include fail for failed converssions?
-        QJsonObject et_object = json[kEtKey].toObject();
-        if (!et_object.empty())
+    return {};
+}
+
+DegorasInformation CalibrationFileManager::rebuildLatestManifest(const QString &hist_calpath, QJsonObject &manifest,
+                                                                bool save)
+{
+    // Latest calibration of each station and configuration, from the file names.
+    QMap<QString, QJsonObject> latest;
+    const QStringList dirs = QDir(hist_calpath).entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name);
+    for (const auto& dir : dirs)
+    {
+        for (const auto& filename : QDir(hist_calpath + '/' + dir).entryList({"*.dpcr"}, QDir::Files))
         {
-            array = et_object[kTAKey].toArray();
-            for (const auto& elem : std::as_const(array))
+            const QStringList splitted = QString(filename).remove(".dpcr").split('_');
+            const QDateTime calib_dt = CalibrationFileManager::startDateTime(filename);
+            if (splitted.size() < 3 || !calib_dt.isValid())
+                continue;
+
+            QJsonObject& entry = latest[splitted[0] + '_' + splitted[1]];
+            if (entry.isEmpty() ||
+                QDateTime::fromString(entry[kDateStartKey].toString(), Qt::ISODateWithMs) < calib_dt)
             {
-                try
-                {
-                    calib.tA.push_back(std::stold(elem.toString().toStdString()));
-                }
-                catch(...){}
+                entry[kStationIdKey] = splitted[0].toInt();
+                entry[kCfgIdKey] = splitted[1];
+                entry[kDateStartKey] = calib_dt.toString(Qt::ISODateWithMs);
+                entry[kManifestFileKey] = dir + '/' + filename;
             }
+        }
+    }
 
-            array = et_object[kTBKey].toArray();
-            for (const auto& elem : std::as_const(array))
-            {
-                try
-                {
-                    calib.tB.push_back(std::stold(elem.toString().toStdString()));
-                }
-                catch(...){}
-            }
+    QJsonArray array;
+    for (const auto& entry : std::as_const(latest))
+        array.push_back(entry);
 
-            calib.et_precision = et_object[kETPrecisionKey].toInt();
-        }
+    manifest = QJsonObject();
+    manifest.insert(kManifestVersionKey, kLatestManifestVersion);
+    manifest.insert(kManifestLastDirKey, dirs.isEmpty() ? QString() : dirs.back());
+    manifest.insert(kManifestLatestKey, array);
+
+    return save ? CalibrationFileManager::saveLatestManifest(hist_calpath, manifest) : DegorasInformation();
+}
+
+DegorasInformation CalibrationFileManager::saveLatestManifest(const QString &hist_calpath,
+                                                             const QJsonObject &manifest)
+{
+    const QString manifest_path = hist_calpath + '/' + kLatestManifestFilename;
+
+    // Replaced atomically, so a session starting at the same time never reads a partial manifest.
+    QSaveFile manifest_file(manifest_path);
+    if (!manifest_file.open(QIODevice::WriteOnly))
+        return DegorasInformation({ErrorEnum::CALIBFILE_NOT_OPEN,
+                                  ErrorListStringMap[ErrorEnum::CALIBFILE_NOT_OPEN].arg(manifest_path)});
+
+    manifest_file.write(QJsonDocument(manifest).toJson(QJsonDocument::Indented));
+    if (!manifest_file.commit())
+        return DegorasInformation({ErrorEnum::CALIBFILE_NOT_OPEN,
+                                  ErrorListStringMap[ErrorEnum::CALIBFILE_NOT_OPEN].arg(manifest_path)});
+
+    return {};
+}
+
+DegorasInformation CalibrationFileManager::updateLatestManifest(const QString &hist_calpath, const Calibration &calib,
+                                                               const QString &relative_path)
+{
+    // The manifest is read, modified and replaced with the lock held, so concurrent writers do not lose entries.
+    // Without the lock it is removed instead, and the next reader rebuilds it with the new calibration.
+    QLockFile lock(hist_calpath + '/' + kLatestManifestLockFilename);
+    DegorasInformation errors = CalibrationFileManager::lockLatestManifest(hist_calpath, lock);
+    if (errors.hasError())
+    {
+        QFile::remove(hist_calpath + '/' + kLatestManifestFilename);
+        return errors;
     }
 
-    // Return the errors
-    return DegorasInformation(error_list);
+    QJsonObject manifest;
+    // A rebuild already includes the new calibration.
+    if (CalibrationFileManager::loadLatestManifest(hist_calpath, manifest).hasError())
+        return CalibrationFileManager::rebuildLatestManifest(hist_calpath, manifest);
+
+    QJsonArray array = manifest.value(kManifestLatestKey).toArray();
+    auto it = std::find_if(array.begin(), array.end(), [&calib](const QJsonValue& v)
+    {
+        const QJsonObject o = v.toObject();
+        return o.value(kStationIdKey).toInt() == static_cast<int>(calib.station_id) &&
+               o.value(kCfgIdKey).toString() == calib.cfg_id;
+    });
+
+    QJsonObject entry;
+    entry[kStationIdKey] = static_cast<int>(calib.station_id);
+    entry[kCfgIdKey] = calib.cfg_id;
+    entry[kDateStartKey] = calib.date_start.toString(Qt::ISODateWithMs);
+    entry[kManifestFileKey] = relative_path;
+
+    if (it == array.end())
+        array.push_back(entry);
+    else if (QDateTime::fromString(it->toObject().value(kDateStartKey).toString(), Qt::ISODateWithMs) <=
+             calib.date_start)
+        *it = entry;
+    else
+        return {};
+
+    const QString dir = relative_path.section('/', 0, 0);
+    if (dir > manifest.value(kManifestLastDirKey).toString())
+        manifest[kManifestLastDirKey] = dir;
+    manifest[kManifestLatestKey] = array;
+
+    return CalibrationFileManager::saveLatestManifest(hist_calpath, manifest);
 }
 
+DegorasInformation CalibrationFileManager::lockLatestManifest(const QString &hist_calpath, QLockFile &lock)
+{
+    // A rebuild can hold the lock for long, so it is only stale if its owner died.
+    lock.setStaleLockTime(0);
+    if (!lock.tryLock(kLatestManifestLockTimeoutMs))
+        return DegorasInformation({ErrorEnum::CALIB_MANIFEST_LOCKED,
+                                  ErrorListStringMap[ErrorEnum::CALIB_MANIFEST_LOCKED].arg(
+                                      hist_calpath + '/' + kLatestManifestFilename)});
+    return {};
+}
@@ -0,0 +1,110 @@
+#include "Tracking/densityfilter.h"
+#include "Tracking/trackingfilemanager.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+const QMap<DensityFilter::ErrorEnum, QString> DensityFilter::ErrorListStringMap =
+{
+    {DensityFilter::ErrorEnum::DENSITYFILTER_INVALID_RADIUS,
+     "The neighbourhood radii of the tracking %1 are not valid (time %2 s, residual %3 ps)."},
+    {DensityFilter::ErrorEnum::DENSITYFILTER_NO_CLUSTERS,
+     "No clusters were found in the tracking %1 (%2 ranges with an echo)."},
+};
+
+DensityFilter::DensityFilter(const Config &config) :
+    m_config(config)
+{}
+
+DegorasInformation DensityFilter::filter(const Tracking &track, Result &result)
+{
+    return this->filterFrom(track, RangeRowsView(track.ranges), result);
+}
+
+DegorasInformation DensityFilter::filter(const Tracking &track, const RangeColumns &ranges, Result &result)
+{
+    return this->filterFrom(track, ranges, result);
+}
+
+template <typename Ranges>
+DegorasInformation DensityFilter::filterFrom(const Tracking &track, const Ranges &ranges, Result &result)
+{
+    const Config& config = this->m_config;
+    result.time_radius = config.time_radius > 0 ? config.time_radius :
+                                                  kTimeRadiusBins * static_cast<double>(track.obj_bs);
+    result.resid_radius = config.resid_radius > 0 ? config.resid_radius :
+                                                    kResidRadiusPrecisions * static_cast<double>(track.et_precision);
+    if (!(result.time_radius > 0) || !(result.resid_radius > 0))
+        return DegorasInformation({DENSITYFILTER_INVALID_RADIUS,
+                                   ErrorListStringMap[DENSITYFILTER_INVALID_RADIUS].arg(
+                                   TrackingFileManager::trackingFilename(track)).arg(result.time_radius)
+                                   .arg(result.resid_radius)});
+
+    // Times and residuals of all the ranges, and their extent, in a single pass over the ranges.
+    this->m_times.resize(ranges.size());
+    this->m_resids.resize(ranges.size());
+    const double cal_val = track.residualCalibration();
+    DayRollover rollover;
+    std::size_t nechoes = 0;
+    double min_time = std::numeric_limits<double>::infinity();
+    double max_time = -std::numeric_limits<double>::infinity();
+    double min_resid = std::numeric_limits<double>::infinity();
+    double max_resid = -std::numeric_limits<double>::infinity();
+    for (std::size_t i = 0; i < ranges.size(); i++)
+    {
+        // Every start time goes through the rollover, so the day changes are seen even without echoes.
+        this->m_times[i] = rollover(ranges.startTime(i)).toSecondsDouble();
+        this->m_resids[i] = std::numeric_limits<double>::quiet_NaN();
+        if (ranges.tof(i) == 0.)
+            continue;
+        const double resid = ranges.residual(i, cal_val);
+        this->m_resids[i] = resid;
+        nechoes++;
+        min_time = std::min(min_time, this->m_times[i]);
+        max_time = std::max(max_time, this->m_times[i]);
+        min_resid = std::min(min_resid, resid);
+        max_resid = std::max(max_resid, resid);
+    }
+
+    // Points expected in a neighbourhood if all of them were noise, spread uniformly over the pass.
+    result.min_points = config.min_points;
+    if (result.min_points == 0)
+    {
+        const double area = std::max(max_time - min_time, 2. * result.time_radius) *
+                            std::max(max_resid - min_resid, 2. * result.resid_radius);
+        const double expected = nechoes > 0 ? nechoes * std::acos(-1.) * result.time_radius *
+                                              result.resid_radius / area : 0.;
+        result.min_points = std::max(kMinPoints, static_cast<std::size_t>(
+                                         std::ceil(expected + kNoiseSigmas * std::sqrt(expected))) + 1);
+    }
+
+    result.clusters = algorithm::densityClusters(this->m_times, this->m_resids, result.time_radius,
+                                                 result.resid_radius, result.min_points, config.max_threads);
+    if (result.clusters.sizes.empty())
+        return DegorasInformation({DENSITYFILTER_NO_CLUSTERS,
+                                   ErrorListStringMap[DENSITYFILTER_NO_CLUSTERS].arg(
+                                   TrackingFileManager::trackingFilename(track)).arg(nechoes)});
+
+    // Clusters with enough points compared to the largest one.
+    const std::size_t largest = *std::max_element(result.clusters.sizes.begin(), result.clusters.sizes.end());
+    const std::size_t min_size = static_cast<std::size_t>(std::ceil(config.min_cluster_fraction * largest));
+    result.selection = result.clusters.selection(std::max<std::size_t>(min_size, 1));
+
+    return {};
+}
+
+DegorasInformation DensityFilter::process(Tracking &track)
+{
+    Result result;
+    DegorasInformation errors = this->filter(track, result);
+    if (errors.hasError())
+        return errors;
+
+    for (std::size_t i = 0; i < track.ranges.size(); i++)
+        if (track.ranges[i].tof_2w != 0.)
+            track.ranges[i].flag = result.selection.test(i) ? Tracking::RangeData::FilterFlag::DATA :
+                                                              Tracking::RangeData::FilterFlag::NOISE;
+
+    return errors;
+}
@@ -0,0 +1,189 @@
+#include "Tracking/epoch.h"
+
+#include <QByteArray>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+
+constexpr std::array<std::uint64_t, 19> kPow10 =
+{
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL,
+    10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL, 100000000000000ULL,
+    1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL, 1000000000000000000ULL
+};
+
+inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+}
+
+Epoch Epoch::fromSeconds(long double seconds)
+{
+    return Epoch(static_cast<std::int64_t>(std::llround(seconds * static_cast<long double>(kPicosecondsPerSecond))));
+}
+
+long double Epoch::toSeconds() const
+{
+    // Whole seconds and fraction apart, so the integer part is exact even with a 64 bit long double.
+    const std::int64_t seconds = floorDiv(this->m_ps, kPicosecondsPerSecond);
+    const std::int64_t fraction = this->m_ps - seconds * kPicosecondsPerSecond;
+    return static_cast<long double>(seconds) +
+           static_cast<long double>(fraction) / static_cast<long double>(kPicosecondsPerSecond);
+}
+
+double Epoch::toSecondsDouble() const
+{
+    return static_cast<double>(this->toSeconds());
+}
+
+std::from_chars_result Epoch::fromChars(const char *first, const char *last, Epoch &epoch)
+{
+    const char* p = first;
+    const bool negative = p != last && *p == '-';
+    if (negative)
+        p++;
+
+    const char* int_begin = p;
+    while (p != last && isDigit(*p))
+        p++;
+    const char* int_end = p;
+    const char* frac_begin = p;
+    const char* frac_end = p;
+    if (p != last && *p == '.')
+    {
+        frac_begin = ++p;
+        while (p != last && isDigit(*p))
+            p++;
+        frac_end = p;
+    }
+    if (int_begin == int_end && frac_begin == frac_end)
+        return {first, std::errc::invalid_argument};
+
+    // The exponent is only consumed if it has digits, like std::from_chars does.
+    long exponent = 0;
+    if (p != last && (*p == 'e' || *p == 'E'))
+    {
+        const char* q = p + 1;
+        const bool exp_negative = q != last && *q == '-';
+        if (q != last && (*q == '-' || *q == '+'))
+            q++;
+        const char* exp_begin = q;
+        while (q != last && isDigit(*q))
+        {
+            if (exponent < 100000)
+                exponent = exponent * 10 + (*q - '0');
+            q++;
+        }
+        if (q != exp_begin)
+        {
+            exponent = exp_negative ? -exponent : exponent;
+            p = q;
+        }
+    }
+
+    // Accumulate every digit by its power of ten relative to the picosecond. The first discarded digit decides
+    // the rounding.
+    std::uint64_t value = 0;
+    bool overflow = false;
+    bool round_up = false;
+    long power = static_cast<long>(int_end - int_begin) - 1 + exponent + kMaxDecimals;
+    const auto accumulate = [&](const char* begin, const char* end)
+    {
+        for (const char* c = begin; c != end; ++c, --power)
+        {
+            const std::uint64_t digit = static_cast<std::uint64_t>(*c - '0');
+            if (digit == 0 || power < -1)
+                continue;
+            if (power == -1)
+                round_up = digit >= 5;
+            else if (power >= static_cast<long>(kPow10.size()))
+                overflow = true;
+            else
+            {
+                const std::uint64_t term = digit * kPow10[static_cast<std::size_t>(power)];
+                overflow = overflow || value > std::numeric_limits<std::uint64_t>::max() - term;
+                value += term;
+            }
+        }
+    };
+    accumulate(int_begin, int_end);
+    accumulate(frac_begin, frac_end);
+    if (round_up)
+        value++;
+
+    const std::uint64_t limit = static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max()) +
+                                (negative ? 1 : 0);
+    if (overflow || value > limit)
+        return {p, std::errc::result_out_of_range};
+
+    epoch.m_ps = negative ? static_cast<std::int64_t>(0 - value) : static_cast<std::int64_t>(value);
+    return {p, std::errc()};
+}
+
+std::to_chars_result Epoch::toChars(char *first, char *last, Epoch epoch, int decimals)
+{
+    decimals = std::clamp(decimals, 0, kMaxDecimals);
+    const bool negative = epoch.m_ps < 0;
+    std::uint64_t magnitude = negative ? 0 - static_cast<std::uint64_t>(epoch.m_ps) :
+                                         static_cast<std::uint64_t>(epoch.m_ps);
+
+    // Rounding half away from zero to the requested decimals.
+    const std::uint64_t unit = kPow10[static_cast<std::size_t>(kMaxDecimals - decimals)];
+    magnitude = (magnitude + unit / 2) / unit;
+    const std::uint64_t scale = kPow10[static_cast<std::size_t>(decimals)];
+    std::uint64_t fraction = magnitude % scale;
+
+    char* p = first;
+    if (negative && magnitude != 0)
+    {
+        if (p == last)
+            return {last, std::errc::value_too_large};
+        *p++ = '-';
+    }
+    const std::to_chars_result result = std::to_chars(p, last, magnitude / scale);
+    if (result.ec != std::errc())
+        return result;
+    p = result.ptr;
+
+    if (decimals > 0)
+    {
+        if (last - p < decimals + 1)
+            return {last, std::errc::value_too_large};
+        *p++ = '.';
+        for (int i = decimals - 1; i >= 0; i--)
+        {
+            p[i] = static_cast<char>('0' + fraction % 10);
+            fraction /= 10;
+        }
+        p += decimals;
+    }
+
+    return {p, std::errc()};
+}
+
+bool Epoch::fromString(std::string_view text, Epoch &epoch)
+{
+    const char* last = text.data() + text.size();
+    const std::from_chars_result result = Epoch::fromChars(text.data(), last, epoch);
+    return result.ec == std::errc() && result.ptr == last;
+}
+
+bool Epoch::fromString(const QString &text, Epoch &epoch)
+{
+    const QByteArray latin = text.toLatin1();
+    return Epoch::fromString(std::string_view(latin.constData(), static_cast<std::size_t>(latin.size())), epoch);
+}
+
+QString Epoch::toString(int decimals) const
+{
+    char buffer[48];
+    const std::to_chars_result result = Epoch::toChars(buffer, buffer + sizeof(buffer), *this, decimals);
+    return QString::fromLatin1(buffer, static_cast<qsizetype>(result.ptr - buffer));
+}
@@ -0,0 +1,132 @@
+#include "Tracking/eventtimerpairing.h"
+#include "parallelchunks.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+const Epoch kHalfDay = Epoch::fromSeconds(std::int64_t(43200));
+
+}
+
+std::vector<Tracking::RangeData> EventTimerPairing::pair(const std::vector<Epoch> &tA, const std::vector<Epoch> &tB,
+                                                         const Config &config)
+{
+    if (tA.empty())
+        return {};
+
+    // Unwrap only when needed, so passes that do not cross midnight are swept in place.
+    std::vector<Epoch> unwrapped_a;
+    std::vector<Epoch> unwrapped_b;
+    const bool wrap_a = !std::is_sorted(tA.begin(), tA.end());
+    if (wrap_a)
+        unwrapped_a = EventTimerPairing::unwrapDays(tA, tA.front());
+    const std::vector<Epoch>& starts = wrap_a ? unwrapped_a : tA;
+    const bool wrap_b = !tB.empty() && (!std::is_sorted(tB.begin(), tB.end()) || tB.front() < starts.front() - kHalfDay);
+    if (wrap_b)
+    {
+        // Stops of multi-channel timers can be slightly out of order. The sweep needs them sorted.
+        unwrapped_b = EventTimerPairing::unwrapDays(tB, starts.front());
+        if (!std::is_sorted(unwrapped_b.begin(), unwrapped_b.end()))
+            std::sort(unwrapped_b.begin(), unwrapped_b.end());
+    }
+    const std::vector<Epoch>& stops = wrap_b ? unwrapped_b : tB;
+    const std::size_t nstops = stops.size();
+
+    std::vector<std::vector<Tracking::RangeData>> chunk_ranges(chunkCount(starts.size(), config.chunk_size));
+    parallelChunks(starts.size(), config.chunk_size, config.max_threads,
+                   [&](std::size_t chunk, std::size_t begin, std::size_t end)
+    {
+        std::vector<Tracking::RangeData>& ranges = chunk_ranges[chunk];
+        ranges.reserve(end - begin);
+
+        // Every chunk locates its first gate with a binary search. From there the stop cursor only moves with the
+        // gate, which changes slowly from one start to the next.
+        std::size_t j = 0;
+        for (std::size_t i = begin; i < end; i++)
+        {
+            const double pred = config.predicted_tof ? config.predicted_tof(tA[i]) : 0.;
+            const Epoch gate_center = starts[i] + Epoch::fromPicoseconds(std::llround(pred));
+            const Epoch gate_open = gate_center + config.gate_open;
+            const Epoch gate_close = gate_center + config.gate_close;
+
+            if (i == begin)
+                j = static_cast<std::size_t>(std::lower_bound(stops.begin(), stops.end(), gate_open) - stops.begin());
+            else
+            {
+                while (j < nstops && stops[j] < gate_open)
+                    j++;
+                while (j > 0 && stops[j - 1] >= gate_open)
+                    j--;
+            }
+
+            bool paired = false;
+            for (std::size_t k = j; k < nstops && stops[k] <= gate_close; k++)
+            {
+                Tracking::RangeData range;
+                range.start_time = tA[i];
+                range.tof_2w = static_cast<double>((stops[k] - starts[i]).picoseconds());
+                range.pre_2w = pred;
+                range.flag = Tracking::RangeData::FilterFlag::DATA;
+                ranges.push_back(range);
+                paired = true;
+                if (!config.multi_stop)
+                    break;
+            }
+
+            if (!paired && config.keep_empty_shots)
+            {
+                Tracking::RangeData range;
+                range.start_time = tA[i];
+                range.pre_2w = pred;
+                ranges.push_back(range);
+            }
+        }
+    });
+
+    std::size_t total = 0;
+    for (const auto& ranges : chunk_ranges)
+        total += ranges.size();
+    std::vector<Tracking::RangeData> result;
+    result.reserve(total);
+    for (auto& ranges : chunk_ranges)
+    {
+        result.insert(result.end(), ranges.begin(), ranges.end());
+        std::vector<Tracking::RangeData>().swap(ranges);
+    }
+    return result;
+}
+
+void EventTimerPairing::processTracking(Tracking &track, const Config &config)
+{
+    track.ranges = EventTimerPairing::pair(track.tA, track.tB, config);
+}
+
+std::vector<Epoch> EventTimerPairing::unwrapDays(const std::vector<Epoch> &epochs, Epoch reference)
+{
+    std::vector<Epoch> unwrapped;
+    unwrapped.reserve(epochs.size());
+    if (epochs.empty())
+        return unwrapped;
+
+    // Only a step back of more than half a day is a rollover. Smaller ones are timer jitter and are kept, and an
+    // epoch more than half a day ahead of the latest one is a jittered epoch from before the rollover.
+    Epoch offset = epochs.front() < reference - kHalfDay ? Epoch::fromDays(1) : Epoch();
+    Epoch latest = epochs.front() + offset;
+    for (const Epoch& epoch : epochs)
+    {
+        Epoch time = epoch + offset;
+        if (time < latest - kHalfDay)
+        {
+            offset += Epoch::fromDays(1);
+            time += Epoch::fromDays(1);
+        }
+        else if (time > latest + kHalfDay)
+            time -= Epoch::fromDays(1);
+        latest = std::max(latest, time);
+        unwrapped.push_back(time);
+    }
+    return unwrapped;
+}
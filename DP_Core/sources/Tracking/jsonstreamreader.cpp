@@ -0,0 +1,508 @@
+#include "Tracking/jsonstreamreader.h"
+
+#include <QJsonArray>
+#include <QJsonObject>
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+namespace
+{
+
+template <typename T>
+bool parseNumber(std::string_view text, T& value)
+{
+    // Epochs are written as strings and may be padded.
+    while (!text.empty() && text.front() == ' ')
+        text.remove_prefix(1);
+    while (!text.empty() && text.back() == ' ')
+        text.remove_suffix(1);
+    if (!text.empty() && text.front() == '+')
+        text.remove_prefix(1);
+
+    const auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+
+int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+bool readHex4(const char* p, unsigned& code)
+{
+    code = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        const int v = hexValue(p[i]);
+        if (v < 0)
+            return false;
+        code = (code << 4) | static_cast<unsigned>(v);
+    }
+    return true;
+}
+
+void appendUtf8(std::string& out, unsigned code)
+{
+    if (code < 0x80)
+        out.push_back(static_cast<char>(code));
+    else if (code < 0x800)
+    {
+        out.push_back(static_cast<char>(0xC0 | (code >> 6)));
+        out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    }
+    else if (code < 0x10000)
+    {
+        out.push_back(static_cast<char>(0xE0 | (code >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    }
+    else
+    {
+        out.push_back(static_cast<char>(0xF0 | (code >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    }
+}
+
+bool unescape(const char* begin, const char* end, std::string& out)
+{
+    out.clear();
+    for (const char* p = begin; p < end; p++)
+    {
+        if (*p != '\\')
+        {
+            out.push_back(*p);
+            continue;
+        }
+
+        if (++p == end)
+            return false;
+
+        switch (*p)
+        {
+        case '"': out.push_back('"'); break;
+        case '\\': out.push_back('\\'); break;
+        case '/': out.push_back('/'); break;
+        case 'b': out.push_back('\b'); break;
+        case 'f': out.push_back('\f'); break;
+        case 'n': out.push_back('\n'); break;
+        case 'r': out.push_back('\r'); break;
+        case 't': out.push_back('\t'); break;
+        case 'u':
+        {
+            unsigned code;
+            if (end - p < 5 || !readHex4(p + 1, code))
+                return false;
+            p += 4;
+            // Surrogate pair.
+            if (code >= 0xD800 && code < 0xDC00 && end - p >= 7 && p[1] == '\\' && p[2] == 'u')
+            {
+                unsigned low;
+                if (readHex4(p + 3, low) && low >= 0xDC00 && low < 0xE000)
+                {
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    p += 6;
+                }
+            }
+            appendUtf8(out, code);
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+JsonStreamReader::JsonStreamReader(QIODevice &device, std::size_t buffer_size) :
+    m_device(device),
+    m_buffer(std::max<std::size_t>(buffer_size, 64)),
+    m_pos(0),
+    m_end(0),
+    m_eof(false),
+    m_expect(Expect::VALUE),
+    m_token(Token::NONE)
+{
+
+}
+
+JsonStreamReader::Token JsonStreamReader::next()
+{
+    if (this->m_token == Token::INVALID || this->m_token == Token::END)
+        return this->m_token;
+
+    this->m_text = {};
+
+    while (true)
+    {
+        if (!this->skipWhitespace())
+        {
+            // The input can only finish after a complete top level value.
+            this->m_token = this->m_stack.empty() && this->m_expect == Expect::SEPARATOR ? Token::END : Token::INVALID;
+            return this->m_token;
+        }
+
+        const char c = this->m_buffer[this->m_pos];
+        switch (c)
+        {
+        case '{':
+        case '[':
+            if (!this->beginValue())
+                return this->m_token = Token::INVALID;
+            this->m_pos++;
+            this->m_stack.push_back(c);
+            this->m_expect = c == '{' ? Expect::FIRST_KEY : Expect::FIRST_VALUE;
+            return this->m_token = c == '{' ? Token::BEGIN_OBJECT : Token::BEGIN_ARRAY;
+
+        case '}':
+        case ']':
+        {
+            // A container can be closed when it is empty or after a value, never after a separator.
+            const char open = c == '}' ? '{' : '[';
+            const Expect first = c == '}' ? Expect::FIRST_KEY : Expect::FIRST_VALUE;
+            if (this->m_stack.empty() || this->m_stack.back() != open ||
+                (this->m_expect != first && this->m_expect != Expect::SEPARATOR))
+                return this->m_token = Token::INVALID;
+            this->m_pos++;
+            this->m_stack.pop_back();
+            this->m_expect = Expect::SEPARATOR;
+            return this->m_token = c == '}' ? Token::END_OBJECT : Token::END_ARRAY;
+        }
+
+        case ',':
+            if (this->m_stack.empty() || this->m_expect != Expect::SEPARATOR)
+                return this->m_token = Token::INVALID;
+            this->m_pos++;
+            this->m_expect = this->m_stack.back() == '{' ? Expect::KEY : Expect::VALUE;
+            continue;
+
+        case ':':
+            if (this->m_expect != Expect::COLON)
+                return this->m_token = Token::INVALID;
+            this->m_pos++;
+            this->m_expect = Expect::VALUE;
+            continue;
+
+        case '"':
+        {
+            const bool key = this->m_expect == Expect::KEY || this->m_expect == Expect::FIRST_KEY;
+            if (!key && !this->beginValue())
+                return this->m_token = Token::INVALID;
+            if (this->readString() == Token::INVALID)
+                return this->m_token = Token::INVALID;
+            this->m_expect = key ? Expect::COLON : Expect::SEPARATOR;
+            return this->m_token = key ? Token::KEY : Token::STRING;
+        }
+
+        case 't':
+            return this->m_token = this->beginValue() ? this->readLiteral("true", Token::TRUE_VALUE) : Token::INVALID;
+
+        case 'f':
+            return this->m_token = this->beginValue() ? this->readLiteral("false", Token::FALSE_VALUE) : Token::INVALID;
+
+        case 'n':
+            return this->m_token = this->beginValue() ? this->readLiteral("null", Token::NULL_VALUE) : Token::INVALID;
+
+        default:
+            if ((c == '-' || (c >= '0' && c <= '9')) && this->beginValue())
+                return this->m_token = this->readNumber();
+            return this->m_token = Token::INVALID;
+        }
+    }
+}
+
+bool JsonStreamReader::beginValue()
+{
+    if (this->m_expect != Expect::VALUE && this->m_expect != Expect::FIRST_VALUE)
+        return false;
+    this->m_expect = Expect::SEPARATOR;
+    return true;
+}
+
+double JsonStreamReader::toDouble() const
+{
+    double value = 0.;
+    return parseNumber(this->m_text, value) ? value : 0.;
+}
+
+long long JsonStreamReader::toInt() const
+{
+    long long value = 0;
+    if (parseNumber(this->m_text, value))
+        return value;
+    // Integers written in floating point notation.
+    return static_cast<long long>(this->toDouble());
+}
+
+bool JsonStreamReader::toEpoch(Epoch &epoch) const
+{
+    std::string_view text = this->m_text;
+    // Epochs are written as strings and may be padded.
+    while (!text.empty() && text.front() == ' ')
+        text.remove_prefix(1);
+    while (!text.empty() && text.back() == ' ')
+        text.remove_suffix(1);
+    if (!text.empty() && text.front() == '+')
+        text.remove_prefix(1);
+    return Epoch::fromString(text, epoch);
+}
+
+QString JsonStreamReader::toString() const
+{
+    return QString::fromUtf8(this->m_text.data(), static_cast<qsizetype>(this->m_text.size()));
+}
+
+bool JsonStreamReader::skipValue()
+{
+    if (this->m_token != Token::BEGIN_OBJECT && this->m_token != Token::BEGIN_ARRAY)
+        return !this->hasError();
+
+    std::size_t depth = 1;
+    while (depth > 0)
+    {
+        switch (this->next())
+        {
+        case Token::BEGIN_OBJECT:
+        case Token::BEGIN_ARRAY:
+            depth++;
+            break;
+        case Token::END_OBJECT:
+        case Token::END_ARRAY:
+            depth--;
+            break;
+        case Token::END:
+        case Token::INVALID:
+            return false;
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+QJsonValue JsonStreamReader::readValue()
+{
+    switch (this->m_token)
+    {
+    case Token::BEGIN_OBJECT:
+    {
+        QJsonObject object;
+        while (this->next() == Token::KEY)
+        {
+            const QString key = this->toString();
+            this->next();
+            object.insert(key, this->readValue());
+        }
+        if (this->m_token != Token::END_OBJECT)
+            this->m_token = Token::INVALID;
+        return object;
+    }
+    case Token::BEGIN_ARRAY:
+    {
+        QJsonArray array;
+        while (this->next() != Token::END_ARRAY && !this->hasError() && this->m_token != Token::END)
+            array.append(this->readValue());
+        if (this->m_token != Token::END_ARRAY)
+            this->m_token = Token::INVALID;
+        return array;
+    }
+    case Token::STRING:
+        return this->toString();
+    case Token::NUMBER:
+        return this->toDouble();
+    case Token::TRUE_VALUE:
+        return true;
+    case Token::FALSE_VALUE:
+        return false;
+    case Token::NULL_VALUE:
+        return QJsonValue();
+    default:
+        this->m_token = Token::INVALID;
+        return QJsonValue(QJsonValue::Undefined);
+    }
+}
+
+bool JsonStreamReader::readEpochArray(std::vector<Epoch> &epochs)
+{
+    if (this->m_token == Token::NULL_VALUE)
+        return true;
+    if (this->m_token != Token::BEGIN_ARRAY)
+        return false;
+
+    while (true)
+    {
+        switch (this->next())
+        {
+        case Token::STRING:
+        case Token::NUMBER:
+        {
+            // Epochs that can not be converted are discarded.
+            Epoch epoch;
+            if (this->toEpoch(epoch))
+                epochs.push_back(epoch);
+            break;
+        }
+        case Token::END_ARRAY:
+            return true;
+        default:
+            return false;
+        }
+    }
+}
+
+bool JsonStreamReader::readMore()
+{
+    if (this->m_eof)
+        return false;
+
+    // The current token does not fit in the buffer.
+    if (this->m_end == this->m_buffer.size())
+        this->m_buffer.resize(this->m_buffer.size() * 2);
+
+    const qint64 read = this->m_device.read(this->m_buffer.data() + this->m_end,
+                                            static_cast<qint64>(this->m_buffer.size() - this->m_end));
+    if (read <= 0)
+    {
+        this->m_eof = true;
+        return false;
+    }
+
+    this->m_end += static_cast<std::size_t>(read);
+    return true;
+}
+
+void JsonStreamReader::compact(std::size_t &token_begin)
+{
+    // Move the partial token to the front so the rest of the buffer can be refilled.
+    if (token_begin > 0)
+    {
+        std::memmove(this->m_buffer.data(), this->m_buffer.data() + token_begin, this->m_end - token_begin);
+        this->m_end -= token_begin;
+        this->m_pos -= token_begin;
+        token_begin = 0;
+    }
+}
+
+bool JsonStreamReader::skipWhitespace()
+{
+    while (true)
+    {
+        while (this->m_pos < this->m_end)
+        {
+            const char c = this->m_buffer[this->m_pos];
+            if (c != ' ' && c != '\n' && c != '\r' && c != '\t')
+                return true;
+            this->m_pos++;
+        }
+
+        this->m_pos = 0;
+        this->m_end = 0;
+        if (!this->readMore())
+            return false;
+    }
+}
+
+JsonStreamReader::Token JsonStreamReader::readString()
+{
+    // Token begins at the opening quote.
+    std::size_t begin = this->m_pos;
+    std::size_t i = begin + 1;
+    bool escaped = false;
+
+    while (true)
+    {
+        if (i >= this->m_end)
+        {
+            const std::size_t offset = i - begin;
+            this->compact(begin);
+            i = begin + offset;
+            if (!this->readMore())
+                return Token::INVALID;
+            continue;
+        }
+
+        const char c = this->m_buffer[i];
+        if (c == '"')
+            break;
+        if (c == '\\')
+        {
+            // Skip the escaped character, which may not be in the buffer yet.
+            escaped = true;
+            i += 2;
+            continue;
+        }
+        i++;
+    }
+
+    const char* raw_begin = this->m_buffer.data() + begin + 1;
+    const char* raw_end = this->m_buffer.data() + i;
+    this->m_pos = i + 1;
+
+    if (escaped)
+    {
+        if (!unescape(raw_begin, raw_end, this->m_scratch))
+            return Token::INVALID;
+        this->m_text = this->m_scratch;
+    }
+    else
+        this->m_text = std::string_view(raw_begin, static_cast<std::size_t>(raw_end - raw_begin));
+
+    return Token::STRING;
+}
+
+JsonStreamReader::Token JsonStreamReader::readNumber()
+{
+    std::size_t begin = this->m_pos;
+    std::size_t i = begin;
+
+    while (true)
+    {
+        if (i >= this->m_end)
+        {
+            const std::size_t offset = i - begin;
+            this->compact(begin);
+            i = begin + offset;
+            // A number can finish at the end of the input.
+            if (!this->readMore())
+                break;
+            continue;
+        }
+
+        const char c = this->m_buffer[i];
+        if ((c < '0' || c > '9') && c != '-' && c != '+' && c != '.' && c != 'e' && c != 'E')
+            break;
+        i++;
+    }
+
+    this->m_text = std::string_view(this->m_buffer.data() + begin, i - begin);
+    this->m_pos = i;
+    return Token::NUMBER;
+}
+
+JsonStreamReader::Token JsonStreamReader::readLiteral(std::string_view literal, Token token)
+{
+    std::size_t begin = this->m_pos;
+    while (this->m_end - begin < literal.size())
+    {
+        this->compact(begin);
+        if (!this->readMore())
+            return Token::INVALID;
+    }
+
+    if (std::string_view(this->m_buffer.data() + begin, literal.size()) != literal)
+        return Token::INVALID;
+
+    this->m_pos = begin + literal.size();
+    return token;
+}
@@ -0,0 +1,238 @@
+#include "Tracking/jsonstreamwriter.h"
+
+#include <QJsonArray>
+#include <QJsonObject>
+
+#include <charconv>
+#include <cmath>
+
+namespace
+{
+
+constexpr int kIndentSize = 4;
+
+}
+
+JsonStreamWriter::JsonStreamWriter(QByteArray &output, Format format) :
+    m_out(output),
+    m_format(format),
+    m_after_key(false)
+{
+}
+
+void JsonStreamWriter::beginObject()
+{
+    this->beforeValue();
+    this->m_out.append('{');
+    this->m_empty.push_back(true);
+}
+
+void JsonStreamWriter::endObject()
+{
+    const bool empty = this->m_empty.back();
+    this->m_empty.pop_back();
+    if (!empty)
+        this->newline();
+    this->m_out.append('}');
+    if (this->m_empty.empty() && this->m_format == Format::INDENTED)
+        this->m_out.append('\n');
+}
+
+void JsonStreamWriter::beginArray()
+{
+    this->beforeValue();
+    this->m_out.append('[');
+    this->m_empty.push_back(true);
+}
+
+void JsonStreamWriter::endArray()
+{
+    const bool empty = this->m_empty.back();
+    this->m_empty.pop_back();
+    if (!empty)
+        this->newline();
+    this->m_out.append(']');
+    if (this->m_empty.empty() && this->m_format == Format::INDENTED)
+        this->m_out.append('\n');
+}
+
+void JsonStreamWriter::key(std::string_view key)
+{
+    this->beforeValue();
+    this->appendEscaped(key);
+    this->m_out.append(this->m_format == Format::INDENTED ? ": " : ":");
+    this->m_after_key = true;
+}
+
+void JsonStreamWriter::key(const QString &key)
+{
+    const QByteArray utf8 = key.toUtf8();
+    this->key(std::string_view(utf8.constData(), static_cast<std::size_t>(utf8.size())));
+}
+
+void JsonStreamWriter::writeNull()
+{
+    this->beforeValue();
+    this->m_out.append("null");
+}
+
+void JsonStreamWriter::writeBool(bool value)
+{
+    this->beforeValue();
+    this->m_out.append(value ? "true" : "false");
+}
+
+void JsonStreamWriter::writeInt(long long value)
+{
+    this->beforeValue();
+    char buffer[32];
+    const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    this->m_out.append(buffer, static_cast<qsizetype>(result.ptr - buffer));
+}
+
+void JsonStreamWriter::writeDouble(double value)
+{
+    if (!std::isfinite(value))
+    {
+        this->writeNull();
+        return;
+    }
+
+    this->beforeValue();
+    char buffer[32];
+    const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    this->m_out.append(buffer, static_cast<qsizetype>(result.ptr - buffer));
+}
+
+void JsonStreamWriter::writeString(std::string_view value)
+{
+    this->beforeValue();
+    this->appendEscaped(value);
+}
+
+void JsonStreamWriter::writeString(const QString &value)
+{
+    const QByteArray utf8 = value.toUtf8();
+    this->writeString(std::string_view(utf8.constData(), static_cast<std::size_t>(utf8.size())));
+}
+
+void JsonStreamWriter::writeEpoch(Epoch value, int decimals)
+{
+    this->beforeValue();
+    char buffer[48];
+    const auto result = Epoch::toChars(buffer, buffer + sizeof(buffer), value, decimals);
+    this->m_out.append('"');
+    this->m_out.append(buffer, static_cast<qsizetype>(result.ptr - buffer));
+    this->m_out.append('"');
+}
+
+void JsonStreamWriter::writeValue(const QJsonValue &value)
+{
+    switch (value.type())
+    {
+    case QJsonValue::Bool:
+        this->writeBool(value.toBool());
+        break;
+    case QJsonValue::Double:
+        this->writeDouble(value.toDouble());
+        break;
+    case QJsonValue::String:
+        this->writeString(value.toString());
+        break;
+    case QJsonValue::Array:
+    {
+        this->beginArray();
+        const QJsonArray array = value.toArray();
+        for (const auto& elem : array)
+            this->writeValue(elem);
+        this->endArray();
+        break;
+    }
+    case QJsonValue::Object:
+    {
+        this->beginObject();
+        const QJsonObject object = value.toObject();
+        for (auto it = object.constBegin(); it != object.constEnd(); ++it)
+        {
+            this->key(it.key());
+            this->writeValue(it.value());
+        }
+        this->endObject();
+        break;
+    }
+    default:
+        this->writeNull();
+        break;
+    }
+}
+
+void JsonStreamWriter::beforeValue()
+{
+    if (this->m_after_key)
+    {
+        this->m_after_key = false;
+        return;
+    }
+
+    if (this->m_empty.empty())
+        return;
+
+    if (!this->m_empty.back())
+        this->m_out.append(',');
+    this->m_empty.back() = false;
+    this->newline();
+}
+
+void JsonStreamWriter::newline()
+{
+    if (this->m_format == Format::INDENTED)
+    {
+        // Appended in place, without a temporary per line.
+        this->m_out.append('\n');
+        this->m_out.append(static_cast<qsizetype>(this->m_empty.size()) * kIndentSize, ' ');
+    }
+}
+
+void JsonStreamWriter::appendEscaped(std::string_view value)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    this->m_out.append('"');
+    for (const char c : value)
+    {
+        switch (c)
+        {
+        case '"':
+            this->m_out.append("\\\"");
+            break;
+        case '\\':
+            this->m_out.append("\\\\");
+            break;
+        case '\b':
+            this->m_out.append("\\b");
+            break;
+        case '\f':
+            this->m_out.append("\\f");
+            break;
+        case '\n':
+            this->m_out.append("\\n");
+            break;
+        case '\r':
+            this->m_out.append("\\r");
+            break;
+        case '\t':
+            this->m_out.append("\\t");
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                this->m_out.append("\\u00");
+                this->m_out.append(hex[(c >> 4) & 0xF]);
+                this->m_out.append(hex[c & 0xF]);
+            }
+            else
+                this->m_out.append(c);
+        }
+    }
+    this->m_out.append('"');
+}
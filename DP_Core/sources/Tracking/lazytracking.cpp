@@ -0,0 +1,55 @@
+#include "Tracking/lazytracking.h"
+#include "Tracking/trackingfilemanager.h"
+
+LazyTracking::LazyTracking(const QString &file_path, const QString &calib_path) :
+    m_file_path(file_path),
+    m_calib_path(calib_path),
+    m_open(false),
+    m_loaded(false)
+{
+}
+
+DegorasInformation LazyTracking::open()
+{
+    this->m_loaded = false;
+    this->m_errors = TrackingFileManager::readTrackingHeader(this->m_file_path, this->m_calib_path, this->m_track);
+    this->m_open = !this->m_errors.hasError();
+    return this->m_errors;
+}
+
+DegorasInformation LazyTracking::load()
+{
+    if (this->m_loaded)
+        return {};
+
+    // Keep the current header if the file can not be read.
+    Tracking track;
+    this->m_errors = TrackingFileManager::readTrackingFromFile(this->m_file_path, this->m_calib_path, track);
+    if (!this->m_errors.hasError())
+    {
+        this->m_track = std::move(track);
+        this->m_loaded = true;
+        this->m_open = true;
+    }
+    return this->m_errors;
+}
+
+void LazyTracking::release()
+{
+    this->m_loaded = false;
+    std::vector<Tracking::RangeData>().swap(this->m_track.ranges);
+    std::vector<Epoch>().swap(this->m_track.tA);
+    std::vector<Epoch>().swap(this->m_track.tB);
+}
+
+const std::vector<Tracking::RangeData> &LazyTracking::ranges()
+{
+    this->load();
+    return this->m_track.ranges;
+}
+
+const Tracking &LazyTracking::tracking()
+{
+    this->load();
+    return this->m_track;
+}
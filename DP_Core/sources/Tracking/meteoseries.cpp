@@ -0,0 +1,154 @@
+#include "Tracking/meteoseries.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace
+{
+
+QDateTime firstDate(const std::vector<MeteoData>& meteo)
+{
+    const auto first = std::min_element(meteo.begin(), meteo.end(),
+                                        [](const auto& a, const auto& b){return a.date < b.date;});
+    return first == meteo.end() ? QDateTime() : first->date;
+}
+
+}
+
+MeteoSeries::MeteoSeries(const std::vector<MeteoData> &meteo) :
+    MeteoSeries(meteo, MeteoSeries::dayReference(firstDate(meteo)))
+{}
+
+MeteoSeries::MeteoSeries(const std::vector<MeteoData> &meteo, const QDateTime &reference) :
+    m_reference(reference)
+{
+    std::vector<std::size_t> order(meteo.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&meteo](std::size_t a, std::size_t b){return meteo[a].date < meteo[b].date;});
+
+    this->m_time.reserve(meteo.size());
+    this->m_temp.reserve(meteo.size());
+    this->m_pressure.reserve(meteo.size());
+    this->m_rel_hum.reserve(meteo.size());
+    this->m_interpolated.reserve(meteo.size());
+    for (std::size_t idx : order)
+    {
+        const MeteoData& data = meteo[idx];
+        const double time = this->toSeconds(data.date);
+        // Samples with the same time would make the interpolation undefined. The last one is kept.
+        if (!this->m_time.empty() && this->m_time.back() == time)
+        {
+            this->m_temp.back() = data.temp;
+            this->m_pressure.back() = data.pressure;
+            this->m_rel_hum.back() = data.rel_hum;
+            this->m_interpolated.back() = data.origin == MeteoData::Origin::INTERPOLATED;
+            continue;
+        }
+        this->m_time.push_back(time);
+        this->m_temp.push_back(data.temp);
+        this->m_pressure.push_back(data.pressure);
+        this->m_rel_hum.push_back(data.rel_hum);
+        this->m_interpolated.push_back(data.origin == MeteoData::Origin::INTERPOLATED);
+    }
+}
+
+void MeteoSeries::interpolate(SpanView<const double> times, SpanView<double> temp, SpanView<double> pressure,
+                              SpanView<double> rel_hum, SpanView<std::uint8_t> interpolated) const
+{
+    const std::size_t nsamples = this->m_time.size();
+    std::size_t upper = 0;
+    double prev = -std::numeric_limits<double>::infinity();
+    for (std::size_t i = 0; i < times.size(); i++)
+    {
+        const double time = times[i];
+        // The cursor only moves forward. A time before the previous one locates it again.
+        if (time < prev)
+            upper = this->upperIndex(time);
+        else
+        {
+            while (upper < nsamples && this->m_time[upper] <= time)
+                upper++;
+        }
+        prev = time;
+        this->evaluate(upper, time, temp[i], pressure[i], rel_hum[i], interpolated[i]);
+    }
+}
+
+MeteoSeries::Samples MeteoSeries::interpolate(SpanView<const double> times) const
+{
+    Samples samples;
+    samples.temp.resize(times.size());
+    samples.pressure.resize(times.size());
+    samples.rel_hum.resize(times.size());
+    samples.interpolated.resize(times.size());
+    this->interpolate(times, samples.temp, samples.pressure, samples.rel_hum, samples.interpolated);
+    return samples;
+}
+
+void MeteoSeries::at(double time, double &temp, double &pressure, double &rel_hum, bool &interpolated) const
+{
+    std::uint8_t flag = 0;
+    this->evaluate(this->upperIndex(time), time, temp, pressure, rel_hum, flag);
+    interpolated = flag != 0;
+}
+
+double MeteoSeries::toSeconds(const QDateTime &date) const
+{
+    return static_cast<double>(date.toMSecsSinceEpoch() - this->m_reference.toMSecsSinceEpoch()) / 1000.;
+}
+
+std::vector<double> MeteoSeries::rangeTimes(const std::vector<Tracking::RangeData> &ranges)
+{
+    std::vector<double> times;
+    times.reserve(ranges.size());
+    DayRollover rollover;
+    for (const auto& range : ranges)
+        times.push_back(static_cast<double>(rollover(range.start_time).toSeconds()));
+    return times;
+}
+
+QDateTime MeteoSeries::dayReference(const QDateTime &date)
+{
+    return date.isValid() ? QDateTime(date.toUTC().date(), QTime(0, 0), Qt::UTC) : QDateTime();
+}
+
+std::size_t MeteoSeries::upperIndex(double time) const
+{
+    return static_cast<std::size_t>(std::upper_bound(this->m_time.begin(), this->m_time.end(), time) -
+                                    this->m_time.begin());
+}
+
+void MeteoSeries::evaluate(std::size_t upper, double time, double &temp, double &pressure, double &rel_hum,
+                           std::uint8_t &interpolated) const
+{
+    const std::size_t nsamples = this->m_time.size();
+    if (nsamples == 0)
+    {
+        temp = pressure = rel_hum = std::numeric_limits<double>::quiet_NaN();
+        interpolated = 0;
+        return;
+    }
+
+    // Out of the series, the nearest sample.
+    if (upper == 0 || upper == nsamples)
+    {
+        const std::size_t idx = upper == 0 ? 0 : nsamples - 1;
+        temp = this->m_temp[idx];
+        pressure = this->m_pressure[idx];
+        rel_hum = this->m_rel_hum[idx];
+        interpolated = this->m_interpolated[idx];
+        return;
+    }
+
+    // m_time[lower] <= time < m_time[upper]
+    const std::size_t lower = upper - 1;
+    const double w = (time - this->m_time[lower]) / (this->m_time[upper] - this->m_time[lower]);
+    temp = this->m_temp[lower] + w * (this->m_temp[upper] - this->m_temp[lower]);
+    pressure = this->m_pressure[lower] + w * (this->m_pressure[upper] - this->m_pressure[lower]);
+    rel_hum = this->m_rel_hum[lower] + w * (this->m_rel_hum[upper] - this->m_rel_hum[lower]);
+    const std::uint8_t upper_flag = w > 0. ? this->m_interpolated[upper] : 0;
+    interpolated = static_cast<std::uint8_t>(this->m_interpolated[lower] | upper_flag);
+}
@@ -0,0 +1,206 @@
+#include "Tracking/normalpointgenerator.h"
+#include "Tracking/trackingfilemanager.h"
+#include "algorithms.h"
+#include "parallelchunks.h"
+
+#include <cmath>
+
+namespace
+{
+
+// Bins processed by every task.
+constexpr std::size_t kBinsPerChunk = 4;
+
+}
+
+const QMap<NormalPointGenerator::ErrorEnum, QString> NormalPointGenerator::ErrorListStringMap =
+{
+    {NormalPointGenerator::ErrorEnum::NORMALPOINT_INVALID_BIN_SIZE,
+     "The normal point bin size of the tracking %1 is not valid."},
+    {NormalPointGenerator::ErrorEnum::NORMALPOINT_NO_DATA,
+     "The tracking %1 has no normal points (no bin with %2 accepted ranges)."},
+};
+
+NormalPointGenerator::NormalPointGenerator(const Config &config) :
+    m_config(config)
+{}
+
+DegorasInformation NormalPointGenerator::generate(const Tracking &track, std::vector<NormalPoint> &normal_points)
+{
+    return this->generateFrom(track, RangeRowsView(track.ranges), normal_points);
+}
+
+DegorasInformation NormalPointGenerator::generate(const Tracking &track, const RangeColumns &ranges,
+                                                  std::vector<NormalPoint> &normal_points)
+{
+    return this->generateFrom(track, ranges, normal_points);
+}
+
+template <typename Ranges>
+DegorasInformation NormalPointGenerator::generateFrom(const Tracking &track, const Ranges &ranges,
+                                                      std::vector<NormalPoint> &normal_points)
+{
+    normal_points.clear();
+    const double bin_size = this->m_config.bin_size > 0 ? this->m_config.bin_size :
+                                                          static_cast<double>(track.obj_bs);
+    const std::int64_t bin_ps = std::llround(bin_size * Epoch::kPicosecondsPerSecond);
+    if (bin_ps <= 0)
+        return DegorasInformation({NORMALPOINT_INVALID_BIN_SIZE,
+                                   ErrorListStringMap[NORMALPOINT_INVALID_BIN_SIZE].arg(
+                                   TrackingFileManager::trackingFilename(track))});
+
+    this->splitBins(ranges, track.residualCalibration(), bin_ps);
+
+    // Every bin writes its own slot, and the valid ones are kept in order.
+    const std::size_t nbins = this->m_bin_starts.size();
+    std::vector<NormalPoint> bin_points(nbins);
+    std::vector<char> valid(nbins, 0);
+    parallelChunks(nbins, kBinsPerChunk, this->m_config.max_threads, [&](std::size_t, std::size_t begin,
+                                                                           std::size_t end)
+    {
+        for (std::size_t bin = begin; bin < end; bin++)
+            valid[bin] = this->normalPoint(bin, bin_points[bin]);
+    });
+
+    for (std::size_t bin = 0; bin < nbins; bin++)
+        if (valid[bin])
+            normal_points.push_back(bin_points[bin]);
+
+    if (normal_points.empty())
+        return DegorasInformation({NORMALPOINT_NO_DATA,
+                                   ErrorListStringMap[NORMALPOINT_NO_DATA].arg(
+                                   TrackingFileManager::trackingFilename(track)).arg(
+                                   std::max<std::size_t>(this->m_config.min_ranges, 1))});
+
+    return {};
+}
+
+template <typename Ranges>
+void NormalPointGenerator::splitBins(const Ranges &ranges, double cal_val, std::int64_t bin_ps)
+{
+    this->m_times.clear();
+    this->m_resids.clear();
+    this->m_tofs.clear();
+    this->m_epochs.clear();
+    this->m_offsets.assign(1, 0);
+    this->m_bin_starts.clear();
+    this->m_bin_shots.clear();
+    this->m_bin_echoes.clear();
+
+    // The bins are aligned to 0h of the first day, as the unwrapped times are. A new bin starts when the bin number
+    // of a range changes, so the ranges must be in time order.
+    DayRollover rollover;
+    std::int64_t current = 0;
+    for (std::size_t i = 0; i < ranges.size(); i++)
+    {
+        const Epoch time = rollover(ranges.startTime(i));
+        const std::int64_t ps = time.picoseconds();
+        const std::int64_t bin = ps / bin_ps - (ps % bin_ps < 0 ? 1 : 0);
+        if (this->m_bin_starts.empty() || bin != current)
+        {
+            if (!this->m_bin_starts.empty())
+                this->m_offsets.push_back(this->m_times.size());
+            current = bin;
+            this->m_bin_starts.push_back(Epoch::fromPicoseconds(bin * bin_ps).toSecondsDouble());
+            this->m_bin_shots.push_back(0);
+            this->m_bin_echoes.push_back(0);
+        }
+        this->m_bin_shots.back()++;
+
+        const double tof = ranges.tof(i);
+        if (tof == 0.)
+            continue;
+        this->m_bin_echoes.back()++;
+        if (ranges.flag(i) != Tracking::RangeData::FilterFlag::DATA)
+            continue;
+        this->m_times.push_back(time.toSecondsDouble());
+        this->m_resids.push_back(ranges.residual(i, cal_val));
+        this->m_tofs.push_back(tof);
+        this->m_epochs.push_back(time);
+    }
+    if (!this->m_bin_starts.empty())
+        this->m_offsets.push_back(this->m_times.size());
+}
+
+bool NormalPointGenerator::normalPoint(std::size_t bin, NormalPoint &np) const
+{
+    const std::size_t first = this->m_offsets[bin];
+    const std::size_t count = this->m_offsets[bin + 1] - first;
+    if (count == 0 || count < this->m_config.min_ranges)
+        return false;
+
+    const double* times = this->m_times.data() + first;
+    const double* resids = this->m_resids.data() + first;
+
+    // Mean epoch and mean residual. The times are taken from the bin start to keep the precision.
+    const double bin_start = this->m_bin_starts[bin];
+    double sum_time = 0.;
+    double sum_resid = 0.;
+    double min_resid = resids[0];
+    double max_resid = resids[0];
+    for (std::size_t k = 0; k < count; k++)
+    {
+        sum_time += times[k] - bin_start;
+        sum_resid += resids[k];
+        min_resid = std::min(min_resid, resids[k]);
+        max_resid = std::max(max_resid, resids[k]);
+    }
+    const double mean_time = sum_time / count;
+    const double mean = sum_resid / count;
+
+    // Central moments and the range closest to the mean epoch.
+    double m2 = 0.;
+    double m3 = 0.;
+    double m4 = 0.;
+    std::size_t closest = 0;
+    double closest_dist = std::abs(times[0] - bin_start - mean_time);
+    for (std::size_t k = 0; k < count; k++)
+    {
+        const double dev = resids[k] - mean;
+        const double dev2 = dev * dev;
+        m2 += dev2;
+        m3 += dev2 * dev;
+        m4 += dev2 * dev2;
+        const double dist = std::abs(times[k] - bin_start - mean_time);
+        if (dist < closest_dist)
+        {
+            closest = k;
+            closest_dist = dist;
+        }
+    }
+    m2 /= count;
+    m3 /= count;
+    m4 /= count;
+
+    // Peak of the residuals distribution.
+    double peak = mean;
+    if (this->m_config.peak_bin_width > 0. && max_resid > min_resid)
+    {
+        const double width = this->m_config.peak_bin_width;
+        const std::size_t nbins = static_cast<std::size_t>((max_resid - min_resid) / width) + 1;
+        std::vector<unsigned> counts;
+        algorithm::histCountsPrivate<algorithm::ClosedOpenBin>(resids, count, nbins, min_resid, width, counts);
+        const std::size_t highest = static_cast<std::size_t>(
+                    std::max_element(counts.begin(), counts.end()) - counts.begin());
+        peak = min_resid + (highest + 0.5) * width;
+    }
+
+    np.epoch = this->m_epochs[first + closest];
+    np.mean_epoch = bin_start + mean_time;
+    np.tof_2w = this->m_tofs[first + closest] + (mean - resids[closest]);
+    np.bin_start = bin_start;
+    np.nshots = this->m_bin_shots[bin];
+    np.nranges = count;
+    np.return_rate = np.nshots ? 100. * count / np.nshots : 0.;
+    np.stats = dpslr::ilrs::algorithms::DistStats();
+    np.stats.aptn = count;
+    np.stats.rptn = this->m_bin_echoes[bin] - count;
+    np.stats.mean = mean;
+    np.stats.rms = std::sqrt(m2);
+    np.stats.skew = m2 > 0. ? m3 / std::pow(m2, 1.5) : 0.;
+    np.stats.kurt = m2 > 0. ? m4 / (m2 * m2) - 3. : 0.;
+    np.stats.peak = peak - mean;
+    np.stats.arate = 100. * count / this->m_bin_echoes[bin];
+
+    return true;
+}
@@ -0,0 +1,123 @@
+#include "Tracking/rangecolumns.h"
+
+#include <algorithm>
+
+RangeColumns::RangeColumns(const std::vector<RangeData> &ranges)
+{
+    this->fromRanges(ranges);
+}
+
+void RangeColumns::reserve(std::size_t size)
+{
+    this->m_start_time.reserve(size);
+    this->m_tof_2w.reserve(size);
+    this->m_pre_2w.reserve(size);
+    this->m_trop_corr_2w.reserve(size);
+    this->m_bias.reserve(size);
+    this->m_flags.reserve(size);
+}
+
+void RangeColumns::resize(std::size_t size)
+{
+    this->m_start_time.resize(size);
+    this->m_tof_2w.resize(size);
+    this->m_pre_2w.resize(size);
+    this->m_trop_corr_2w.resize(size);
+    this->m_bias.resize(size);
+    this->m_flags.resize(size, static_cast<std::uint8_t>(FilterFlag::UNKNOWN));
+}
+
+void RangeColumns::clear()
+{
+    this->m_start_time.clear();
+    this->m_tof_2w.clear();
+    this->m_pre_2w.clear();
+    this->m_trop_corr_2w.clear();
+    this->m_bias.clear();
+    this->m_flags.clear();
+}
+
+void RangeColumns::push_back(const RangeData &range)
+{
+    this->m_start_time.push_back(range.start_time);
+    this->m_tof_2w.push_back(range.tof_2w);
+    this->m_pre_2w.push_back(range.pre_2w);
+    this->m_trop_corr_2w.push_back(range.trop_corr_2w);
+    this->m_bias.push_back(range.bias);
+    this->m_flags.push_back(static_cast<std::uint8_t>(range.flag));
+}
+
+RangeColumns::RangeData RangeColumns::at(std::size_t idx) const
+{
+    RangeData range;
+    range.start_time = this->m_start_time[idx];
+    range.tof_2w = this->m_tof_2w[idx];
+    range.pre_2w = this->m_pre_2w[idx];
+    range.trop_corr_2w = this->m_trop_corr_2w[idx];
+    range.bias = this->m_bias[idx];
+    range.flag = this->flag(idx);
+    return range;
+}
+
+void RangeColumns::set(std::size_t idx, const RangeData &range)
+{
+    this->m_start_time[idx] = range.start_time;
+    this->m_tof_2w[idx] = range.tof_2w;
+    this->m_pre_2w[idx] = range.pre_2w;
+    this->m_trop_corr_2w[idx] = range.trop_corr_2w;
+    this->m_bias[idx] = range.bias;
+    this->setFlag(idx, range.flag);
+}
+
+std::vector<RangeColumns::RangeData> RangeColumns::toRanges() const
+{
+    std::vector<RangeData> ranges(this->size());
+    for (std::size_t i = 0; i < ranges.size(); i++)
+    {
+        RangeData& range = ranges[i];
+        range.start_time = this->m_start_time[i];
+        range.tof_2w = this->m_tof_2w[i];
+        range.pre_2w = this->m_pre_2w[i];
+        range.trop_corr_2w = this->m_trop_corr_2w[i];
+        range.bias = this->m_bias[i];
+        range.flag = this->flag(i);
+    }
+    return ranges;
+}
+
+void RangeColumns::fromRanges(const std::vector<RangeData> &ranges)
+{
+    this->resize(ranges.size());
+    for (std::size_t i = 0; i < ranges.size(); i++)
+        this->set(i, ranges[i]);
+}
+
+void RangeColumns::residuals(double cal_val, SpanView<double> out) const
+{
+    // Plain indexed loop over the contiguous columns, so the compiler can vectorize it.
+    const std::size_t n = std::min(out.size(), this->size());
+    const double* tof = this->m_tof_2w.data();
+    const double* pre = this->m_pre_2w.data();
+    const double* trop = this->m_trop_corr_2w.data();
+    double* res = out.data();
+    for (std::size_t i = 0; i < n; i++)
+        res[i] = residual(tof[i], pre[i], trop[i], cal_val);
+}
+
+std::vector<double> RangeColumns::residuals(double cal_val) const
+{
+    std::vector<double> res(this->size());
+    this->residuals(cal_val, res);
+    return res;
+}
+
+std::size_t RangeColumns::countFlag(FilterFlag flag) const
+{
+    const std::uint8_t value = static_cast<std::uint8_t>(flag);
+    return static_cast<std::size_t>(std::count(this->m_flags.begin(), this->m_flags.end(), value));
+}
+
+void RangeColumns::setFlags(FilterFlag flag)
+{
+    std::fill(this->m_flags.begin(), this->m_flags.end(), static_cast<std::uint8_t>(flag));
+}
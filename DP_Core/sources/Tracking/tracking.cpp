@@ -44,7 +44,7 @@ QJsonObject StatstoJson(const dpslr::ilrs::algorithms::DistStats &stats)
 
 
 Tracking::RangeData::RangeData():
-    start_time(0.0),
+    start_time(),
     tof_2w(0.0),
     pre_2w(0.0),
     trop_corr_2w(0.0),
@@ -71,6 +71,11 @@ Tracking::Tracking() :
 
 }
 
+double Tracking::residualCalibration() const
+{
+    return static_cast<double>(static_cast<long long>(this->cal_val_overall));
+}
+
 QJsonObject TelescopeData::toJson() const
 {
     // TODO
@@ -0,0 +1,280 @@
+#include "Tracking/trackingbinaryfile.h"
+#include "Tracking/trackingfilemanager.h"
+
+#include <QJsonDocument>
+#include <QtGlobal>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+static_assert(Q_BYTE_ORDER == Q_LITTLE_ENDIAN, "The binary tracking format is only supported on little endian hosts.");
+static_assert(sizeof(TrackingBinaryFile::Header) == 168, "The binary tracking header layout must not change.");
+
+namespace
+{
+
+std::uint64_t alignUp(std::uint64_t offset)
+{
+    return (offset + TrackingBinaryFile::kAlignment - 1) & ~(TrackingBinaryFile::kAlignment - 1);
+}
+
+bool validSection(const TrackingBinaryFile::Section& section, std::uint64_t elem_size, std::uint64_t file_size)
+{
+    return section.offset % TrackingBinaryFile::kAlignment == 0 && section.offset <= file_size &&
+           section.count <= (file_size - section.offset) / elem_size;
+}
+
+}
+
+TrackingBinaryFile::~TrackingBinaryFile()
+{
+    this->close();
+}
+
+DegorasInformation TrackingBinaryFile::open(const QString &file_path)
+{
+    this->close();
+
+    this->m_file.setFileName(file_path);
+    if (!this->m_file.open(QIODevice::ReadOnly))
+        return DegorasInformation({TrackingFileManager::ErrorEnum::TRACKFILE_NOT_OPEN,
+                                  TrackingFileManager::ErrorListStringMap[
+                                       TrackingFileManager::ErrorEnum::TRACKFILE_NOT_OPEN].arg(file_path)});
+
+    const qint64 size = this->m_file.size();
+    DegorasInformation invalid({TrackingFileManager::ErrorEnum::TRACKFILE_INVALID,
+                               TrackingFileManager::ErrorListStringMap[
+                                    TrackingFileManager::ErrorEnum::TRACKFILE_INVALID].arg(file_path)});
+
+    if (size < static_cast<qint64>(sizeof(Header)))
+    {
+        this->close();
+        return invalid;
+    }
+
+    // Map the file. If the platform does not allow it, fall back to a single read.
+    this->m_data = this->m_file.map(0, size);
+    if (!this->m_data)
+    {
+        this->m_buffer = this->m_file.readAll();
+        this->m_data = reinterpret_cast<const uchar*>(this->m_buffer.constData());
+    }
+
+    std::memcpy(&this->m_header, this->m_data, sizeof(Header));
+
+    if (!std::equal(kMagic.begin(), kMagic.end(), this->m_header.magic) ||
+        this->m_header.file_size != static_cast<std::uint64_t>(size))
+    {
+        this->close();
+        return invalid;
+    }
+
+    if (this->m_header.version != kVersion)
+    {
+        this->close();
+        return DegorasInformation({TrackingFileManager::ErrorEnum::TRACKFILE_UNSUPPORTED_VERSION,
+                                  TrackingFileManager::ErrorListStringMap[
+                                       TrackingFileManager::ErrorEnum::TRACKFILE_UNSUPPORTED_VERSION].arg(file_path)});
+    }
+
+    // Check that every column lies inside the file and that all the range columns have the same length.
+    const Header& h = this->m_header;
+    const std::uint64_t nranges = h.start_time.count;
+    const std::uint64_t file_size = h.file_size;
+    bool valid = validSection(h.meta, 1, file_size) &&
+                 validSection(h.start_time, sizeof(std::int64_t), file_size) &&
+                 validSection(h.tof_2w, sizeof(double), file_size) &&
+                 validSection(h.pre_2w, sizeof(double), file_size) &&
+                 validSection(h.trop_corr_2w, sizeof(double), file_size) &&
+                 validSection(h.bias, sizeof(double), file_size) &&
+                 validSection(h.flags, sizeof(std::uint64_t), file_size) &&
+                 validSection(h.tA, sizeof(std::int64_t), file_size) &&
+                 validSection(h.tB, sizeof(std::int64_t), file_size) &&
+                 h.tof_2w.count == nranges && h.pre_2w.count == nranges && h.trop_corr_2w.count == nranges &&
+                 h.bias.count == nranges && h.flags.count == (nranges + kFlagsPerWord - 1) / kFlagsPerWord;
+
+    if (!valid)
+    {
+        this->close();
+        return invalid;
+    }
+
+    return {};
+}
+
+void TrackingBinaryFile::close()
+{
+    if (this->m_file.isOpen())
+        this->m_file.close();
+    this->m_buffer.clear();
+    this->m_data = nullptr;
+    this->m_header = Header{};
+}
+
+Tracking::RangeData::FilterFlag TrackingBinaryFile::flag(std::size_t idx) const
+{
+    const std::uint64_t word = this->flagWords()[idx / kFlagsPerWord];
+    const unsigned shift = static_cast<unsigned>(idx % kFlagsPerWord) * kFlagBits;
+    return Tracking::RangeData::flagFromInt(static_cast<long long>((word >> shift) & ((1u << kFlagBits) - 1)));
+}
+
+QByteArray TrackingBinaryFile::metadata() const
+{
+    return QByteArray::fromRawData(reinterpret_cast<const char*>(this->m_data + this->m_header.meta.offset),
+                                   static_cast<qsizetype>(this->m_header.meta.count));
+}
+
+DegorasInformation TrackingBinaryFile::toTrackingHeader(const QString &calib_path, Tracking &track,
+                                                        bool load_calibrations) const
+{
+    DegorasInformation errors;
+
+    // Ensure object is cleared
+    track = Tracking();
+
+    // Data, stats, meteo and calibrations.
+    QJsonDocument meta = QJsonDocument::fromJson(this->metadata());
+    if (meta.isObject())
+        errors.append(TrackingFileManager::headerFromJson(meta.object(), calib_path, track, load_calibrations));
+    else
+        errors.append({{TrackingFileManager::ErrorEnum::TRACKFILE_INVALID,
+                        TrackingFileManager::ErrorListStringMap[TrackingFileManager::ErrorEnum::TRACKFILE_INVALID]
+                            .arg(this->m_file.fileName())}});
+
+    return errors;
+}
+
+DegorasInformation TrackingBinaryFile::toTracking(const QString &calib_path, Tracking &track) const
+{
+    DegorasInformation errors = this->toTrackingHeader(calib_path, track);
+
+    // Ranges
+    const std::size_t nranges = this->rangesCount();
+    const std::int64_t* start = this->startTimes();
+    const double* tof = this->tof();
+    const double* pre = this->pre();
+    const double* trop = this->tropCorr();
+    const double* bias = this->bias();
+    track.ranges.resize(nranges);
+    for (std::size_t i = 0; i < nranges; i++)
+    {
+        Tracking::RangeData& range = track.ranges[i];
+        range.start_time = Epoch::fromPicoseconds(start[i]);
+        range.tof_2w = tof[i];
+        range.pre_2w = pre[i];
+        range.trop_corr_2w = trop[i];
+        range.bias = bias[i];
+        range.flag = this->flag(i);
+    }
+
+    // ET
+    track.tA.resize(this->tACount());
+    std::transform(this->tA(), this->tA() + this->tACount(), track.tA.begin(), &Epoch::fromPicoseconds);
+    track.tB.resize(this->tBCount());
+    std::transform(this->tB(), this->tB() + this->tBCount(), track.tB.begin(), &Epoch::fromPicoseconds);
+    track.et_precision = this->etPrecision();
+
+    return errors;
+}
+
+void TrackingBinaryFile::toColumns(RangeColumns &columns) const
+{
+    const std::size_t nranges = this->rangesCount();
+    columns.resize(nranges);
+    std::transform(this->startTimes(), this->startTimes() + nranges, columns.startTimes().begin(),
+                   &Epoch::fromPicoseconds);
+    std::copy(this->tof(), this->tof() + nranges, columns.tof().begin());
+    std::copy(this->pre(), this->pre() + nranges, columns.pre().begin());
+    std::copy(this->tropCorr(), this->tropCorr() + nranges, columns.tropCorr().begin());
+    std::copy(this->bias(), this->bias() + nranges, columns.bias().begin());
+    for (std::size_t i = 0; i < nranges; i++)
+        columns.setFlag(i, this->flag(i));
+}
+
+DegorasInformation TrackingBinaryFile::readTracking(const QString &file_path, const QString &calib_path,
+                                                    Tracking &track)
+{
+    TrackingBinaryFile file;
+    DegorasInformation errors = file.open(file_path);
+    if (!errors.hasError())
+        errors = file.toTracking(calib_path, track);
+    return errors;
+}
+
+DegorasInformation TrackingBinaryFile::readTrackingHeader(const QString &file_path, const QString &calib_path,
+                                                          Tracking &track, bool load_calibrations)
+{
+    // The columns are mapped but never touched, so only the header pages are read.
+    TrackingBinaryFile file;
+    DegorasInformation errors = file.open(file_path);
+    if (!errors.hasError())
+        errors = file.toTrackingHeader(calib_path, track, load_calibrations);
+    return errors;
+}
+
+DegorasInformation TrackingBinaryFile::writeTracking(const Tracking &track, const QString &file_path)
+{
+    return TrackingFileManager::writeBytes(TrackingBinaryFile::serialize(track), file_path);
+}
+
+QByteArray TrackingBinaryFile::serialize(const Tracking &track)
+{
+    const QByteArray meta = QJsonDocument(TrackingFileManager::headerToJson(track)).toJson(QJsonDocument::Compact);
+    const std::uint64_t nranges = track.ranges.size();
+
+    // Layout of the sections.
+    Header header{};
+    std::copy(kMagic.begin(), kMagic.end(), header.magic);
+    header.version = kVersion;
+    header.et_precision = track.et_precision;
+    std::uint64_t offset = sizeof(Header);
+    auto place = [&offset](Section& section, std::uint64_t count, std::uint64_t elem_size)
+    {
+        section.offset = alignUp(offset);
+        section.count = count;
+        offset = section.offset + count * elem_size;
+    };
+    place(header.meta, static_cast<std::uint64_t>(meta.size()), 1);
+    place(header.start_time, nranges, sizeof(std::int64_t));
+    place(header.tof_2w, nranges, sizeof(double));
+    place(header.pre_2w, nranges, sizeof(double));
+    place(header.trop_corr_2w, nranges, sizeof(double));
+    place(header.bias, nranges, sizeof(double));
+    place(header.flags, (nranges + kFlagsPerWord - 1) / kFlagsPerWord, sizeof(std::uint64_t));
+    place(header.tA, track.tA.size(), sizeof(std::int64_t));
+    place(header.tB, track.tB.size(), sizeof(std::int64_t));
+    header.file_size = alignUp(offset);
+
+    // Serialize the whole file in memory, so it can be written at once.
+    QByteArray bytes(static_cast<qsizetype>(header.file_size), '\0');
+    uchar* data = reinterpret_cast<uchar*>(bytes.data());
+    std::memcpy(data, &header, sizeof(Header));
+    std::memcpy(data + header.meta.offset, meta.constData(), static_cast<std::size_t>(meta.size()));
+
+    auto* start = reinterpret_cast<std::int64_t*>(data + header.start_time.offset);
+    auto* tof = reinterpret_cast<double*>(data + header.tof_2w.offset);
+    auto* pre = reinterpret_cast<double*>(data + header.pre_2w.offset);
+    auto* trop = reinterpret_cast<double*>(data + header.trop_corr_2w.offset);
+    auto* bias = reinterpret_cast<double*>(data + header.bias.offset);
+    auto* flags = reinterpret_cast<std::uint64_t*>(data + header.flags.offset);
+    for (std::size_t i = 0; i < nranges; i++)
+    {
+        const Tracking::RangeData& range = track.ranges[i];
+        start[i] = range.start_time.picoseconds();
+        tof[i] = range.tof_2w;
+        pre[i] = range.pre_2w;
+        trop[i] = range.trop_corr_2w;
+        bias[i] = range.bias;
+        // Masked, so a flag out of the enum can not change the flags of the other ranges of the word.
+        const std::uint64_t flag = static_cast<std::uint64_t>(range.flag) & ((1u << kFlagBits) - 1);
+        flags[i / kFlagsPerWord] |= flag << ((i % kFlagsPerWord) * kFlagBits);
+    }
+
+    std::transform(track.tA.begin(), track.tA.end(),
+                   reinterpret_cast<std::int64_t*>(data + header.tA.offset), std::mem_fn(&Epoch::picoseconds));
+    std::transform(track.tB.begin(), track.tB.end(),
+                   reinterpret_cast<std::int64_t*>(data + header.tB.offset), std::mem_fn(&Epoch::picoseconds));
+
+    return bytes;
+}
@@ -0,0 +1,553 @@
+#include "Tracking/trackingcatalog.h"
+#include "Tracking/trackingfilemanager.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QLockFile>
+#include <QSaveFile>
+
+#include <algorithm>
+
+const QMap<TrackingCatalog::ErrorEnum, QString> TrackingCatalog::ErrorListStringMap =
+{
+    {TrackingCatalog::ErrorEnum::CATALOG_NOT_OPEN,
+     "The tracking catalog %1 could not be opened."},
+    {TrackingCatalog::ErrorEnum::CATALOG_INVALID,
+     "The tracking catalog %1 is not valid."},
+    {TrackingCatalog::ErrorEnum::CATALOG_UNSUPPORTED_VERSION,
+     "The tracking catalog %1 has an unsupported format version."},
+    {TrackingCatalog::ErrorEnum::CATALOG_NOT_WRITABLE,
+     "The tracking catalog %1 could not be written."},
+    {TrackingCatalog::ErrorEnum::CATALOG_ENTRY_MISSING,
+     "The tracking %1 is not in the catalog."},
+    {TrackingCatalog::ErrorEnum::CATALOG_ENTRY_STALE,
+     "The catalog entry of the tracking %1 is outdated."},
+    {TrackingCatalog::ErrorEnum::CATALOG_ENTRY_ORPHAN,
+     "The catalog entry of the tracking %1 has no file."},
+    {TrackingCatalog::ErrorEnum::CATALOG_LOCKED,
+     "The tracking catalog %1 is locked by another writer."},
+    {TrackingCatalog::ErrorEnum::CATALOG_STALE,
+     "The tracking catalog %1 is outdated and must be rebuilt."},
+};
+
+namespace
+{
+
+QDataStream& operator<<(QDataStream& stream, const TrackingCatalog::Entry& entry)
+{
+    stream << entry.path << static_cast<quint32>(entry.station_id) << entry.cfg_id << entry.obj_norad
+           << static_cast<quint32>(entry.release) << static_cast<qint32>(entry.filter_mode)
+           << entry.date_start << entry.date_end
+           << static_cast<quint64>(entry.nshots) << static_cast<quint64>(entry.rnshots)
+           << entry.rms_1rms << entry.rms_rfrms << entry.arate_rfrms
+           << entry.file_size << entry.file_mtime;
+    return stream;
+}
+
+QDataStream& operator>>(QDataStream& stream, TrackingCatalog::Entry& entry)
+{
+    quint32 station_id, release;
+    qint32 filter_mode;
+    quint64 nshots, rnshots;
+    stream >> entry.path >> station_id >> entry.cfg_id >> entry.obj_norad >> release >> filter_mode
+           >> entry.date_start >> entry.date_end >> nshots >> rnshots
+           >> entry.rms_1rms >> entry.rms_rfrms >> entry.arate_rfrms
+           >> entry.file_size >> entry.file_mtime;
+    entry.station_id = station_id;
+    entry.release = release;
+    entry.filter_mode = static_cast<Tracking::FilterMode>(filter_mode);
+    entry.nshots = static_cast<std::size_t>(nshots);
+    entry.rnshots = static_cast<std::size_t>(rnshots);
+    return stream;
+}
+
+bool startLess(const TrackingCatalog::Entry& a, const TrackingCatalog::Entry& b)
+{
+    return a.date_start < b.date_start || (a.date_start == b.date_start && a.path < b.path);
+}
+
+}
+
+TrackingCatalog::Entry::Entry() :
+    station_id(0),
+    release(0),
+    filter_mode(Tracking::FilterMode::RAW),
+    nshots(0),
+    rnshots(0),
+    rms_1rms(0.),
+    rms_rfrms(0.),
+    arate_rfrms(0.),
+    file_size(0),
+    file_mtime(0)
+{
+}
+
+QString TrackingCatalog::Entry::filename() const
+{
+    return this->path.section('/', -1);
+}
+
+TrackingCatalog::Entry TrackingCatalog::Entry::fromTracking(const Tracking &track, const QString &path,
+                                                            const QFileInfo &info)
+{
+    Entry entry;
+    entry.path = path;
+    entry.station_id = track.station_id;
+    entry.cfg_id = track.cfg_id;
+    entry.obj_norad = track.obj_norad;
+    entry.release = track.release;
+    entry.filter_mode = track.filter_mode;
+    entry.date_start = track.date_start;
+    entry.date_end = track.date_end;
+    entry.nshots = track.nshots;
+    entry.rnshots = track.rnshots;
+    entry.rms_1rms = static_cast<double>(track.stats_1rms.rms);
+    entry.rms_rfrms = static_cast<double>(track.stats_rfrms.rms);
+    entry.arate_rfrms = static_cast<double>(track.stats_rfrms.arate);
+    entry.file_size = info.size();
+    entry.file_mtime = info.lastModified().toMSecsSinceEpoch();
+    return entry;
+}
+
+TrackingCatalog::TrackingCatalog(const QString &dir) :
+    m_dir(dir),
+    m_log_records(0),
+    m_log_truncated(false)
+{
+}
+
+DegorasInformation TrackingCatalog::open(bool save)
+{
+    DegorasInformation errors = this->load();
+    if (errors.hasError())
+        errors = save ? this->rebuild() : this->scan();
+    return errors;
+}
+
+DegorasInformation TrackingCatalog::load()
+{
+    this->m_entries.clear();
+    this->m_log_records = 0;
+    this->m_log_truncated = false;
+
+    const QString index_path = this->indexPath();
+    QFile index_file(index_path);
+    if (!index_file.open(QIODevice::ReadOnly))
+        return DegorasInformation({ErrorEnum::CATALOG_NOT_OPEN, ErrorListStringMap[ErrorEnum::CATALOG_NOT_OPEN].arg(index_path)});
+
+    QDataStream stream(&index_file);
+    stream.setVersion(QDataStream::Qt_6_0);
+
+    quint32 magic, version, count;
+    stream >> magic >> version;
+    if (stream.status() != QDataStream::Ok || magic != kMagic)
+        return DegorasInformation({ErrorEnum::CATALOG_INVALID, ErrorListStringMap[ErrorEnum::CATALOG_INVALID].arg(index_path)});
+    if (version != kVersion)
+        return DegorasInformation({ErrorEnum::CATALOG_UNSUPPORTED_VERSION,
+                                  ErrorListStringMap[ErrorEnum::CATALOG_UNSUPPORTED_VERSION].arg(index_path)});
+
+    stream >> count;
+    // Never trust the count for the reserve, a row takes at least 64 bytes.
+    this->m_entries.reserve(std::min<std::size_t>(count, static_cast<std::size_t>(index_file.size()) / 64));
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++)
+    {
+        Entry entry;
+        stream >> entry;
+        this->m_entries.push_back(std::move(entry));
+    }
+
+    if (stream.status() != QDataStream::Ok)
+    {
+        this->m_entries.clear();
+        return DegorasInformation({ErrorEnum::CATALOG_INVALID, ErrorListStringMap[ErrorEnum::CATALOG_INVALID].arg(index_path)});
+    }
+
+    std::sort(this->m_entries.begin(), this->m_entries.end(), &startLess);
+
+    // Changes appended after the last save.
+    DegorasInformation errors = this->replayLog();
+    if (errors.hasError())
+        this->m_entries.clear();
+
+    return errors;
+}
+
+DegorasInformation TrackingCatalog::save() const
+{
+    QLockFile lock(this->lockPath());
+    DegorasInformation errors = this->lock(lock);
+    return errors.hasError() ? errors : this->write();
+}
+
+DegorasInformation TrackingCatalog::write() const
+{
+    const QString index_path = this->indexPath();
+
+    // The index is replaced atomically, so readers never see a partially written file.
+    QSaveFile index_file(index_path);
+    if (!index_file.open(QIODevice::WriteOnly))
+        return DegorasInformation({ErrorEnum::CATALOG_NOT_WRITABLE,
+                                  ErrorListStringMap[ErrorEnum::CATALOG_NOT_WRITABLE].arg(index_path)});
+
+    QDataStream stream(&index_file);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << kMagic << kVersion << static_cast<quint32>(this->m_entries.size());
+    for (const auto& entry : this->m_entries)
+        stream << entry;
+
+    if (stream.status() != QDataStream::Ok || !index_file.commit())
+        return DegorasInformation({ErrorEnum::CATALOG_NOT_WRITABLE,
+                                  ErrorListStringMap[ErrorEnum::CATALOG_NOT_WRITABLE].arg(index_path)});
+
+    // The log is merged into the new index. If it could not be removed, its changes would be applied again.
+    const QString log_path = this->logPath();
+    if (QFile::exists(log_path) && !QFile::remove(log_path))
+        return DegorasInformation({ErrorEnum::CATALOG_NOT_WRITABLE,
+                                  ErrorListStringMap[ErrorEnum::CATALOG_NOT_WRITABLE].arg(log_path)});
+
+    return {};
+}
+
+DegorasInformation TrackingCatalog::rebuild()
+{
+    // The directory is scanned with the lock held, so no change appended meanwhile is lost when the log is merged.
+    // Without the lock, the index is only rebuilt in memory.
+    QLockFile lock(this->lockPath());
+    DegorasInformation errors = this->lock(lock);
+    const bool locked = !errors.hasError();
+    errors.append(this->scan());
+    if (locked)
+        errors.append(this->write());
+    return errors;
+}
+
+DegorasInformation TrackingCatalog::scan()
+{
+    DegorasInformation errors;
+
+    this->m_entries.clear();
+    for (const auto& path : this->trackingFiles())
+    {
+        Entry entry;
+        DegorasInformation e = this->readEntry(path, entry);
+        if (e.hasError())
+            errors.append(e);
+        else
+            this->m_entries.push_back(std::move(entry));
+    }
+
+    std::sort(this->m_entries.begin(), this->m_entries.end(), &startLess);
+
+    return errors;
+}
+
+DegorasInformation TrackingCatalog::verify(bool repair)
+{
+    QLockFile lock(this->lockPath());
+    if (repair)
+    {
+        DegorasInformation lock_errors = this->lock(lock);
+        if (lock_errors.hasError())
+            return lock_errors;
+    }
+
+    DegorasInformation errors;
+    DegorasInformation load_errors = this->load();
+
+    // Without a valid index, everything has to be repaired.
+    if (load_errors.hasError())
+    {
+        if (!repair)
+            return load_errors;
+        errors = this->scan();
+        errors.append(this->write());
+        return errors;
+    }
+
+    QStringList files = this->trackingFiles();
+    files.sort();
+    std::vector<Entry> verified;
+    verified.reserve(this->m_entries.size());
+    std::vector<bool> indexed(static_cast<std::size_t>(files.size()), false);
+
+    for (const auto& entry : this->m_entries)
+    {
+        const auto it = std::lower_bound(files.cbegin(), files.cend(), entry.path);
+        if (it == files.cend() || *it != entry.path)
+        {
+            errors.append({{ErrorEnum::CATALOG_ENTRY_ORPHAN, ErrorListStringMap[ErrorEnum::CATALOG_ENTRY_ORPHAN].arg(entry.path)}});
+            continue;
+        }
+
+        indexed[static_cast<std::size_t>(it - files.cbegin())] = true;
+
+        const QFileInfo info(this->m_dir + '/' + entry.path);
+        if (info.size() != entry.file_size || info.lastModified().toMSecsSinceEpoch() != entry.file_mtime)
+        {
+            errors.append({{ErrorEnum::CATALOG_ENTRY_STALE, ErrorListStringMap[ErrorEnum::CATALOG_ENTRY_STALE].arg(entry.path)}});
+            if (repair)
+            {
+                Entry updated;
+                DegorasInformation e = this->readEntry(entry.path, updated);
+                if (e.hasError())
+                    errors.append(e);
+                else
+                    verified.push_back(std::move(updated));
+            }
+            continue;
+        }
+
+        verified.push_back(entry);
+    }
+
+    for (std::size_t i = 0; i < indexed.size(); i++)
+    {
+        if (indexed[i])
+            continue;
+
+        const QString& path = files[static_cast<qsizetype>(i)];
+        errors.append({{ErrorEnum::CATALOG_ENTRY_MISSING, ErrorListStringMap[ErrorEnum::CATALOG_ENTRY_MISSING].arg(path)}});
+        if (repair)
+        {
+            Entry entry;
+            DegorasInformation e = this->readEntry(path, entry);
+            if (e.hasError())
+                errors.append(e);
+            else
+                verified.push_back(std::move(entry));
+        }
+    }
+
+    if (repair)
+    {
+        std::sort(verified.begin(), verified.end(), &startLess);
+        this->m_entries = std::move(verified);
+        errors.append(this->write());
+    }
+
+    return errors;
+}
+
+void TrackingCatalog::insert(Entry entry)
+{
+    this->remove(entry.path);
+    const auto it = std::upper_bound(this->m_entries.begin(), this->m_entries.end(), entry, &startLess);
+    this->m_entries.insert(it, std::move(entry));
+}
+
+bool TrackingCatalog::remove(const QString &path)
+{
+    const auto it = std::find_if(this->m_entries.begin(), this->m_entries.end(),
+                                 [&path](const auto& e){return e.path == path;});
+    if (it == this->m_entries.end())
+        return false;
+    this->m_entries.erase(it);
+    return true;
+}
+
+std::vector<TrackingCatalog::Entry> TrackingCatalog::query(const QDateTime &start, const QDateTime &end,
+                                                           const QString &object_norad, const QString &cfg_id) const
+{
+    std::vector<Entry> result;
+
+    // Entries are sorted by start, so only the ones starting before the end of the interval are checked.
+    Entry last;
+    last.date_start = end;
+    last.path = QChar(0xFFFF);
+    const auto it_end = std::upper_bound(this->m_entries.cbegin(), this->m_entries.cend(), last, &startLess);
+    for (auto it = this->m_entries.cbegin(); it != it_end; ++it)
+    {
+        // Include file if it contains at least an interval within start-end
+        if (it->date_end >= start && this->matches(*it, object_norad, cfg_id))
+            result.push_back(*it);
+    }
+
+    return result;
+}
+
+std::vector<TrackingCatalog::Entry> TrackingCatalog::query(const QString &object_norad, const QString &cfg_id) const
+{
+    std::vector<Entry> result;
+    std::copy_if(this->m_entries.cbegin(), this->m_entries.cend(), std::back_inserter(result),
+                 [this, &object_norad, &cfg_id](const auto& e){return this->matches(e, object_norad, cfg_id);});
+    return result;
+}
+
+QString TrackingCatalog::indexPath() const
+{
+    return this->m_dir + '/' + kIndexFilename;
+}
+
+QString TrackingCatalog::logPath() const
+{
+    return this->m_dir + '/' + kLogFilename;
+}
+
+QString TrackingCatalog::lockPath() const
+{
+    return this->indexPath() + QStringLiteral(".lock");
+}
+
+DegorasInformation TrackingCatalog::addTracking(const QString &dir, const Tracking &track, const QString &path)
+{
+    return TrackingCatalog::update(dir, LogRecord::ADD, Entry::fromTracking(track, path, QFileInfo(dir + '/' + path)));
+}
+
+DegorasInformation TrackingCatalog::removeTracking(const QString &dir, const QString &path)
+{
+    Entry entry;
+    entry.path = path;
+    return TrackingCatalog::update(dir, LogRecord::REMOVE, entry);
+}
+
+DegorasInformation TrackingCatalog::update(const QString &dir, LogRecord type, const Entry &entry)
+{
+    TrackingCatalog catalog(dir);
+
+    // A missing index is built by the next open or rebuild, with this change already in the directory.
+    if (!QFile::exists(catalog.indexPath()))
+        return {};
+
+    // This is the save path of the trackings, so the index is not rebuilt here. Without the lock the record is
+    // appended anyway: it is small and written at once.
+    QLockFile lock(catalog.lockPath());
+    if (catalog.lock(lock).hasError() || catalog.load().hasError())
+        return catalog.appendLog(LogRecord::STALE, entry);
+
+    if (type == LogRecord::ADD)
+        catalog.insert(entry);
+    else if (!catalog.remove(entry.path))
+        return {};
+
+    // The log is merged when it grows too much or when it ends with a record cut by a writer that died, as the
+    // records appended after it could not be read.
+    if (catalog.m_log_truncated || catalog.m_log_records + 1 >= kMaxLogRecords)
+        return catalog.write();
+    return catalog.appendLog(type, entry);
+}
+
+DegorasInformation TrackingCatalog::lock(QLockFile &lock) const
+{
+    // A rebuild can hold the lock for long, so it is only stale if its owner died.
+    lock.setStaleLockTime(0);
+    if (!lock.tryLock(kLockTimeoutMs))
+        return DegorasInformation({ErrorEnum::CATALOG_LOCKED,
+                                  ErrorListStringMap[ErrorEnum::CATALOG_LOCKED].arg(this->indexPath())});
+    return {};
+}
+
+DegorasInformation TrackingCatalog::replayLog()
+{
+    const QString log_path = this->logPath();
+    QFile log_file(log_path);
+
+    // Without a log, there are no changes since the last save.
+    if (!log_file.exists())
+        return {};
+    if (!log_file.open(QIODevice::ReadOnly))
+        return DegorasInformation({ErrorEnum::CATALOG_NOT_OPEN, ErrorListStringMap[ErrorEnum::CATALOG_NOT_OPEN].arg(log_path)});
+
+    QDataStream stream(&log_file);
+    stream.setVersion(QDataStream::Qt_6_0);
+
+    quint32 magic, version;
+    stream >> magic >> version;
+    if (stream.status() != QDataStream::Ok || magic != kLogMagic || version != kVersion)
+        return DegorasInformation({ErrorEnum::CATALOG_INVALID, ErrorListStringMap[ErrorEnum::CATALOG_INVALID].arg(log_path)});
+
+    while (!stream.atEnd())
+    {
+        quint8 type;
+        Entry entry;
+        stream >> type;
+        const LogRecord record = static_cast<LogRecord>(type);
+        if (record == LogRecord::ADD)
+            stream >> entry;
+        else if (record == LogRecord::REMOVE)
+            stream >> entry.path;
+        else if (record != LogRecord::STALE)
+            return DegorasInformation({ErrorEnum::CATALOG_INVALID, ErrorListStringMap[ErrorEnum::CATALOG_INVALID].arg(log_path)});
+
+        // A record still being written, or cut by a writer that died, is ignored.
+        if (stream.status() == QDataStream::ReadPastEnd)
+        {
+            this->m_log_truncated = true;
+            break;
+        }
+        if (stream.status() != QDataStream::Ok)
+            return DegorasInformation({ErrorEnum::CATALOG_INVALID, ErrorListStringMap[ErrorEnum::CATALOG_INVALID].arg(log_path)});
+        if (record == LogRecord::STALE)
+            return DegorasInformation({ErrorEnum::CATALOG_STALE,
+                                      ErrorListStringMap[ErrorEnum::CATALOG_STALE].arg(this->indexPath())});
+
+        if (record == LogRecord::ADD)
+            this->insert(std::move(entry));
+        else
+            this->remove(entry.path);
+        this->m_log_records++;
+    }
+
+    return {};
+}
+
+DegorasInformation TrackingCatalog::appendLog(LogRecord type, const Entry &entry)
+{
+    const QString log_path = this->logPath();
+    QFile log_file(log_path);
+    if (!log_file.open(QIODevice::WriteOnly | QIODevice::Append))
+        return DegorasInformation({ErrorEnum::CATALOG_NOT_WRITABLE,
+                                  ErrorListStringMap[ErrorEnum::CATALOG_NOT_WRITABLE].arg(log_path)});
+
+    QByteArray record;
+    QDataStream stream(&record, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_6_0);
+    if (log_file.size() == 0)
+        stream << kLogMagic << kVersion;
+    stream << static_cast<quint8>(type);
+    if (type == LogRecord::ADD)
+        stream << entry;
+    else if (type == LogRecord::REMOVE)
+        stream << entry.path;
+
+    // The whole record is written at once, so a reader sees it complete or cut at the end of the file.
+    if (log_file.write(record) != record.size() || !log_file.flush())
+        return DegorasInformation({ErrorEnum::CATALOG_NOT_WRITABLE,
+                                  ErrorListStringMap[ErrorEnum::CATALOG_NOT_WRITABLE].arg(log_path)});
+
+    return {};
+}
+
+QStringList TrackingCatalog::trackingFiles() const
+{
+    const QStringList filters{"*." + TrackingFileManager::kJsonSuffix, "*." + TrackingFileManager::kBinarySuffix};
+    QDir root(this->m_dir);
+
+    // Trackings in the root and in the day subdirectories.
+    QStringList files = root.entryList(filters, QDir::Files);
+    for (const auto& sub : root.entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+    {
+        for (const auto& file : QDir(root.filePath(sub)).entryList(filters, QDir::Files))
+            files.push_back(sub + '/' + file);
+    }
+
+    return files;
+}
+
+DegorasInformation TrackingCatalog::readEntry(const QString &path, Entry &entry) const
+{
+    const QString file_path = this->m_dir + '/' + path;
+    Tracking track;
+    // The catalog does not need the calibrations.
+    DegorasInformation errors = TrackingFileManager::readTrackingHeader(file_path, {}, track, false);
+    if (!errors.hasError())
+        entry = Entry::fromTracking(track, path, QFileInfo(file_path));
+    return errors;
+}
+
+bool TrackingCatalog::matches(const Entry &entry, const QString &object_norad, const QString &cfg_id) const
+{
+    return (object_norad.isEmpty() || object_norad == entry.obj_norad) &&
+           (cfg_id.isEmpty() || cfg_id == entry.cfg_id);
+}
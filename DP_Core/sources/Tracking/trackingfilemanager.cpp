@@ -1,14 +1,20 @@
 #include "Tracking/trackingfilemanager.h"
 
 #include <QFile>
-#include <QJsonDocument>
 #include <QJsonArray>
 #include <QJsonObject>
 #include <QDir>
+#include <QFileInfo>
+
+#include <algorithm>
 
 #include "Tracking/calibrationfilemanager.h"
+#include "Tracking/calibrationcache.h"
+#include "Tracking/trackingbinaryfile.h"
+#include "Tracking/jsonstreamreader.h"
+#include "Tracking/trackingcatalog.h"
+#include "Tracking/parallelfileloader.h"
 #include "degoras_settings.h"
-#include "LibDegorasBase/Helpers/string_helpers.h"
 
 const QString kDateStartKey = QStringLiteral("date_start");
 const QString kDateEndKey = QStringLiteral("date_end");
@@ -56,8 +62,103 @@ const QMap<TrackingFileManager::ErrorEnum, QString> TrackingFileManager::ErrorLi
      "The tracking json file %1 does not exist."},
     {TrackingFileManager::ErrorEnum::TRACKFILE_NOT_REMOVABLE,
      "The tracking json file %1 could not be removed."},
+    {TrackingFileManager::ErrorEnum::TRACKFILE_UNSUPPORTED_VERSION,
+     "The tracking binary file %1 has an unsupported format version."},
+    {TrackingFileManager::ErrorEnum::TRACKFILE_CALIBRATION_NOT_LOADED,
+     "The calibration %1 referenced by the tracking could not be loaded."},
 };
 
+namespace
+{
+
+// Smallest json representation of a range, used to bound the reserve done from nshots.
+constexpr std::size_t kMinRangeBytes = 16;
+
+bool readRanges(JsonStreamReader& reader, std::vector<Tracking::RangeData>& ranges)
+{
+    // Trackings without ranges store a null value.
+    if (reader.token() == JsonStreamReader::Token::NULL_VALUE)
+        return true;
+    if (reader.token() != JsonStreamReader::Token::BEGIN_ARRAY)
+        return false;
+
+    static const std::string flag_key = kFlagKey.toStdString();
+    static const std::string start_key = kStartKey.toStdString();
+    static const std::string tof_key = kToFKey.toStdString();
+    static const std::string pred_key = kPredKey.toStdString();
+    static const std::string trop_key = kTropCorrKey.toStdString();
+    static const std::string bias_key = kBiasKey.toStdString();
+
+    while (reader.next() == JsonStreamReader::Token::BEGIN_OBJECT)
+    {
+        Tracking::RangeData range;
+        while (reader.next() == JsonStreamReader::Token::KEY)
+        {
+            const std::string_view key = reader.text();
+            double* value = nullptr;
+            bool is_flag = false;
+            bool is_start = false;
+            if (key == flag_key)
+                is_flag = true;
+            else if (key == start_key)
+                is_start = true;
+            else if (key == tof_key)
+                value = &range.tof_2w;
+            else if (key == pred_key)
+                value = &range.pre_2w;
+            else if (key == trop_key)
+                value = &range.trop_corr_2w;
+            else if (key == bias_key)
+                value = &range.bias;
+
+            // Only scalars are converted. Anything else is skipped whole, so the reader never stays inside it.
+            const JsonStreamReader::Token token = reader.next();
+            const bool scalar = token == JsonStreamReader::Token::NUMBER || token == JsonStreamReader::Token::STRING;
+            if (is_flag && scalar)
+                range.flag = Tracking::RangeData::flagFromInt(reader.toInt());
+            else if (is_start && scalar)
+                reader.toEpoch(range.start_time);
+            else if (value && token == JsonStreamReader::Token::NUMBER)
+                *value = reader.toDouble();
+            else if (!reader.skipValue())
+                return false;
+        }
+
+        if (reader.token() != JsonStreamReader::Token::END_OBJECT)
+            return false;
+        ranges.push_back(range);
+    }
+
+    return reader.token() == JsonStreamReader::Token::END_ARRAY;
+}
+
+bool readEt(JsonStreamReader& reader, Tracking& track)
+{
+    if (reader.token() == JsonStreamReader::Token::NULL_VALUE)
+        return true;
+    if (reader.token() != JsonStreamReader::Token::BEGIN_OBJECT)
+        return false;
+
+    bool valid = true;
+    while (valid && reader.next() == JsonStreamReader::Token::KEY)
+    {
+        const QString key = reader.toString();
+        reader.next();
+        if (key == kTAKey)
+            valid = reader.readEpochArray(track.tA);
+        else if (key == kTBKey)
+            valid = reader.readEpochArray(track.tB);
+        else if (key == kETPrecisionKey)
+            track.et_precision = static_cast<unsigned>(reader.toInt());
+        else
+            valid = reader.skipValue();
+    }
+
+    return valid && reader.token() == JsonStreamReader::Token::END_OBJECT;
+}
+
+}
+
 // TODO: long double?
 // TODO: validation of values?
 DegorasInformation TrackingFileManager::readTracking(const QString &track_name, const QString &track_dirpath,
@@ -90,30 +191,46 @@ DegorasInformation TrackingFileManager::readTracking(const QString &track_name,
 
 DegorasInformation TrackingFileManager::writeTracking(const Tracking& track,
                                                      const QString& dest_dir,
-                                                     const QString& filename )
+                                                     const QString& filename,
+                                                     JsonStreamWriter::Format format)
 {
     DegorasInformation errors;
 
     // If filename is empty, then use default
     QString filename_selected = filename.isEmpty() ? TrackingFileManager::trackingFilename(track) : filename;
 
+    // The tracking is serialized only once, even when it is written to several destinations.
+    const QByteArray bytes = TrackingFileManager::serializeTracking(
+                track, TrackingFileManager::isBinaryTrackingFile(filename_selected), format);
+
     if (dest_dir.isEmpty())
     {
         QString current_path = DegorasSettings::instance().getGlobalConfigString(
                     "SalaraProjectDataPaths/SP_CurrentObservations");
-        QString hist_path = DegorasSettings::instance().getGlobalConfigString(
-                    "SalaraProjectDataPaths/SP_HistoricalObservations") + '/' + track.date_start.date().toString("yyyyMMdd");
+        QString hist_root = DegorasSettings::instance().getGlobalConfigString(
+                    "SalaraProjectDataPaths/SP_HistoricalObservations");
+        QString day_folder = track.date_start.date().toString("yyyyMMdd");
+        QString hist_path = hist_root + '/' + day_folder;
 
-        errors = TrackingFileManager::writeTrackingPrivate(track, current_path + '/' + filename_selected);
+        errors = TrackingFileManager::writeBytes(bytes, current_path + '/' + filename_selected);
+        if (!errors.hasError())
+            errors.append(TrackingCatalog::addTracking(current_path, track, filename_selected));
 
         if (QDir().mkpath(hist_path))
-            errors.append(TrackingFileManager::writeTrackingPrivate(track, hist_path + '/' + filename_selected));
+        {
+            DegorasInformation hist_errors = TrackingFileManager::writeBytes(bytes, hist_path + '/' + filename_selected);
+            if (!hist_errors.hasError())
+                hist_errors.append(TrackingCatalog::addTracking(hist_root, track, day_folder + '/' + filename_selected));
+            errors.append(hist_errors);
+        }
         else
             errors.append({{0, "Cannot create historical path: " + hist_path}});
     }
     else
     {
-        errors = TrackingFileManager::writeTrackingPrivate(track, dest_dir + '/' + filename_selected);
+        errors = TrackingFileManager::writeBytes(bytes, dest_dir + '/' + filename_selected);
+        if (!errors.hasError())
+            errors.append(TrackingCatalog::addTracking(dest_dir, track, filename_selected));
     }
 
     return errors;
@@ -125,11 +242,13 @@ DegorasInformation TrackingFileManager::removeTracking(const QString &track_name
 {
     DegorasInformation errors;
     QDate date_start(TrackingFileManager::startDate(track_name));
-    QString current_filepath = DegorasSettings::instance().getGlobalConfigString(
-                "SalaraProjectDataPaths/SP_CurrentObservations") + '/' + track_name;
-    QString hist_filepath = DegorasSettings::instance().getGlobalConfigString(
-                "SalaraProjectDataPaths/SP_HistoricalObservations") + '/' +
-            date_start.toString("yyyyMMdd") + '/' + track_name;
+    QString current_path = DegorasSettings::instance().getGlobalConfigString(
+                "SalaraProjectDataPaths/SP_CurrentObservations");
+    QString hist_root = DegorasSettings::instance().getGlobalConfigString(
+                "SalaraProjectDataPaths/SP_HistoricalObservations");
+    QString hist_relpath = date_start.toString("yyyyMMdd") + '/' + track_name;
+    QString current_filepath = current_path + '/' + track_name;
+    QString hist_filepath = hist_root + '/' + hist_relpath;
 
 
     if (QFile::exists(current_filepath))
@@ -152,6 +271,9 @@ DegorasInformation TrackingFileManager::removeTracking(const QString &track_name
         errors.append({{TrackingFileManager::TRACKFILE_NOT_EXISTS,
                         TrackingFileManager::ErrorListStringMap[TRACKFILE_NOT_EXISTS].arg(hist_filepath)}});
 
+    errors.append(TrackingCatalog::removeTracking(current_path, track_name));
+    errors.append(TrackingCatalog::removeTracking(hist_root, hist_relpath));
+
     return errors;
 
 }
@@ -159,8 +281,9 @@ DegorasInformation TrackingFileManager::removeTracking(const QString &track_name
 DegorasInformation TrackingFileManager::removeCurrentTracking(const QString &track_name)
 {
     DegorasInformation errors;
-    QString current_filepath = DegorasSettings::instance().getGlobalConfigString(
-                "SalaraProjectDataPaths/SP_CurrentObservations") + '/' + track_name;
+    QString current_path = DegorasSettings::instance().getGlobalConfigString(
+                "SalaraProjectDataPaths/SP_CurrentObservations");
+    QString current_filepath = current_path + '/' + track_name;
 
 
     if (QFile::exists(current_filepath))
@@ -173,28 +296,27 @@ DegorasInformation TrackingFileManager::removeCurrentTracking(const QString &tra
         errors.append({{TrackingFileManager::TRACKFILE_NOT_EXISTS,
                         TrackingFileManager::ErrorListStringMap[TRACKFILE_NOT_EXISTS].arg(current_filepath)}});
 
+    errors.append(TrackingCatalog::removeTracking(current_path, track_name));
 
     return errors;
 }
 
 DegorasInformation TrackingFileManager::readTrackingDir(const QString &dir, const QString& calib_path,
-                                                       std::vector<Tracking> &tracks)
+                                                       std::vector<Tracking> &tracks, int max_threads)
 {
-    Tracking t;
-    DegorasInformation result;
-    for (auto&& file : QDir(dir).entryInfoList({"*.dptr"}, QDir::Files))
-    {
-        auto errors = TrackingFileManager::readTracking(file.fileName(), file.canonicalPath(), calib_path, t);
-        result.append(errors);
-        if (!errors.hasError())
-            tracks.push_back(t);
-    }
-    return result;
+    QStringList files;
+    for (auto&& file : QDir(dir).entryInfoList({"*." + kJsonSuffix, "*." + kBinarySuffix}, QDir::Files))
+        files.push_back(file.canonicalFilePath());
+
+    return loadFilesParallel(files, [&calib_path](const QString& file, Tracking& t)
+                             {return TrackingFileManager::readTrackingFromFile(file, calib_path, t);},
+                             tracks, max_threads);
 }
 
-DegorasInformation TrackingFileManager::readTrackingDir(const QString &dir, std::vector<Tracking> &tracks)
+DegorasInformation TrackingFileManager::readTrackingDir(const QString &dir, std::vector<Tracking> &tracks,
+                                                       int max_threads)
 {
-    return TrackingFileManager::readTrackingDir(dir, {}, tracks);
+    return TrackingFileManager::readTrackingDir(dir, {}, tracks, max_threads);
 }
 
 QString TrackingFileManager::trackingFilename(const Tracking &track)
@@ -222,71 +344,53 @@ QString TrackingFileManager::findTracking(const QString &track_name)
     return result;
 }
 
-QStringList TrackingFileManager::findTrackings(const QDateTime &start, const QDateTime &end,
-                                               const QString &object_norad, const QString &cfg_id, const QString &dir)
+DegorasInformation TrackingFileManager::findTrackings(const QDateTime &start, const QDateTime &end,
+                                                     QStringList &trackings, const QString &object_norad,
+                                                     const QString &cfg_id, const QString &dir)
 {
-    QStringList trackings_selected;
     QString hist_trackpath = dir.isEmpty() ?
             DegorasSettings::instance().getGlobalConfigString("SalaraProjectDataPaths/SP_HistoricalObservations") : dir;
-    for (auto date = start.date(); date <= end.date(); date = date.addDays(1))
-    {
-        QString date_folder(date.toString("yyyyMMdd"));
-        QDir dir(hist_trackpath + '/' + date_folder);
-        QStringList files = dir.entryList(QDir::Files);
 
-        for (const auto& file : std::as_const(files))
-        {
-            QStringList name_tokens = file.split('_');
-            if (name_tokens.size() > 3)
-            {
-                bool include = true;
-                if (!object_norad.isEmpty() && object_norad != name_tokens[3])
-                    include = false;
-                if (include && !cfg_id.isEmpty() && cfg_id != name_tokens[1])
-                    include = false;
-
-                if (include)
-                {
-                    Tracking tracking;
-                    TrackingFileManager::readTrackingFromFile(dir.path() + '/' + file, {}, tracking);
-                    // Include file if it contains at least an interval within start-end
-                    include = tracking.date_end >= start && tracking.date_start <= end;
-                }
-                if (include)
-                    trackings_selected.push_back(file);
-
-            }
-        }   
-    }
+    // The query is answered from the catalog. It is only rebuilt (reading every tracking) if it is missing, and
+    // the rebuilt one is saved only for the historical dir.
+    TrackingCatalog catalog(hist_trackpath);
+    DegorasInformation errors = catalog.open(dir.isEmpty());
+    for (const auto& entry : catalog.query(start, end, object_norad, cfg_id))
+        trackings.push_back(entry.filename());
 
-    return trackings_selected;
+    return errors;
 }
 
-QStringList TrackingFileManager::currentTrackings(const QString &object_norad, const QString &cfg_id)
+DegorasInformation TrackingFileManager::currentTrackings(QStringList &trackings, const QString &object_norad,
+                                                        const QString &cfg_id)
 {
-    QStringList trackings_selected;
     QString current_trackpath =
             DegorasSettings::instance().getGlobalConfigString("SalaraProjectDataPaths/SP_CurrentObservations");
 
-    QStringList files = QDir(current_trackpath).entryList(QDir::Files);
+    TrackingCatalog catalog(current_trackpath);
+    DegorasInformation errors = catalog.open();
+    for (const auto& entry : catalog.query(object_norad, cfg_id))
+        trackings.push_back(entry.filename());
 
-    for (const auto& file : std::as_const(files))
-    {
-        QStringList name_tokens = file.split('_');
-        if (name_tokens.size() > 3)
-        {
-            bool include = true;
-            if (!object_norad.isEmpty() && object_norad != name_tokens[3])
-                include = false;
-            if (!include && !cfg_id.isEmpty() && cfg_id != name_tokens[1])
-                include = false;
-
-            if (include)
-                trackings_selected.push_back(file);
-        }
-    }
+    return errors;
+}
+
+DegorasInformation TrackingFileManager::rebuildCatalogs()
+{
+    DegorasInformation errors = TrackingCatalog(DegorasSettings::instance().getGlobalConfigString(
+                "SalaraProjectDataPaths/SP_CurrentObservations")).rebuild();
+    errors.append(TrackingCatalog(DegorasSettings::instance().getGlobalConfigString(
+                      "SalaraProjectDataPaths/SP_HistoricalObservations")).rebuild());
+    return errors;
+}
 
-    return trackings_selected;
+DegorasInformation TrackingFileManager::verifyCatalogs(bool repair)
+{
+    DegorasInformation errors = TrackingCatalog(DegorasSettings::instance().getGlobalConfigString(
+                "SalaraProjectDataPaths/SP_CurrentObservations")).verify(repair);
+    errors.append(TrackingCatalog(DegorasSettings::instance().getGlobalConfigString(
+                      "SalaraProjectDataPaths/SP_HistoricalObservations")).verify(repair));
+    return errors;
 }
 
 QDate TrackingFileManager::startDate(const QString &track_name)
@@ -306,149 +410,250 @@ QDate TrackingFileManager::startDate(const QString &track_name)
 }
 
 DegorasInformation TrackingFileManager::readTrackingFromFile(const QString &file_path, const QString &calib_path, Tracking &track)
+{
+    // Binary columnar files have their own reader.
+    if (TrackingFileManager::isBinaryTrackingFile(file_path))
+        return TrackingBinaryFile::readTracking(file_path, calib_path, track);
+
+    return TrackingFileManager::readJsonTracking(file_path, calib_path, false, true, track);
+}
+
+DegorasInformation TrackingFileManager::readTrackingHeader(const QString &file_path, const QString &calib_path,
+                                                          Tracking &track, bool load_calibrations)
+{
+    if (TrackingFileManager::isBinaryTrackingFile(file_path))
+        return TrackingBinaryFile::readTrackingHeader(file_path, calib_path, track, load_calibrations);
+
+    return TrackingFileManager::readJsonTracking(file_path, calib_path, true, load_calibrations, track);
+}
+
+DegorasInformation TrackingFileManager::readJsonTracking(const QString &file_path, const QString &calib_path,
+                                                        bool header_only, bool load_calibrations, Tracking &track)
 {
     QFile track_file(file_path);
     // Check if file could be opened.
-    if(!track_file.open(QIODevice::ReadOnly | QIODevice::Text))
+    if(!track_file.open(QIODevice::ReadOnly))
         return DegorasInformation({TrackingFileManager::ErrorEnum::TRACKFILE_NOT_OPEN,
                                   ErrorListStringMap[ErrorEnum::TRACKFILE_NOT_OPEN].arg(file_path)});
 
-    // Read all.
-    QString track_string = track_file.readAll().simplified();
+    // Ensure object is cleared
+    track = Tracking();
+
+    // Parse the file in one pass, filling the ranges and ET data directly from the read buffer. Only the small
+    // header fields are collected in a json object. In header only mode, the big arrays are skipped token by
+    // token without storing anything.
+    JsonStreamReader reader(track_file);
+    QJsonObject header;
+    bool valid = reader.next() == JsonStreamReader::Token::BEGIN_OBJECT;
+    while (valid && reader.next() == JsonStreamReader::Token::KEY)
+    {
+        const QString key = reader.toString();
+        reader.next();
+
+        if ((key == kRangesKey || key == kEtKey) && header_only)
+            valid = reader.skipValue();
+        else if (key == kRangesKey)
+        {
+            // Reserve using nshots (written before the ranges), but never more than the file could hold.
+            const std::size_t nshots = static_cast<std::size_t>(header.value(kNShotsKey).toInt());
+            track.ranges.reserve(std::min(nshots, static_cast<std::size_t>(track_file.size()) / kMinRangeBytes));
+            valid = readRanges(reader, track.ranges);
+        }
+        else if (key == kEtKey)
+            valid = readEt(reader, track);
+        else
+            header.insert(key, reader.readValue());
+
+        valid = valid && !reader.hasError();
+    }
+    valid = valid && reader.token() == JsonStreamReader::Token::END_OBJECT;
     track_file.close();
-    // Loads the json document.
-    QJsonDocument track_jsondocument = QJsonDocument::fromJson(track_string.toUtf8());
 
     // Check if scheme is valid
     DegorasInformation errors;
 
     // Check if data file is valid
-    if (track_jsondocument.isNull())
+    if (!valid)
     {
         errors.append({{ErrorEnum::TRACKFILE_INVALID, ErrorListStringMap[ErrorEnum::TRACKFILE_INVALID].arg(file_path)}});
     }
     else
     {
-        // Ensure object is cleared
-        track = Tracking();
-
-        // Data
-        track.date_start = QDateTime::fromString(track_jsondocument[kDateStartKey].toString(), Qt::ISODateWithMs);
-        track.date_end = QDateTime::fromString(track_jsondocument[kDateEndKey].toString(), Qt::ISODateWithMs);
-        track.filter_mode = static_cast<Tracking::FilterMode>(track_jsondocument[kFilterModeKey].toInt());
-        track.station_name = track_jsondocument[kStationNameKey].toString();
-        track.station_id = track_jsondocument[kStationIdKey].toInt();
-        track.cfg_id = track_jsondocument[kCfgIdKey].toString();
-        track.obj_name = track_jsondocument[kObjNameKey].toString();
-        track.obj_norad = track_jsondocument[kObjNoradKey].toString();
-        track.obj_bs = track_jsondocument[kObjBSKey].toInt();
-        track.rf = track_jsondocument[kRFKey].toDouble();
-        track.nshots = track_jsondocument[kNShotsKey].toInt();
-        track.rnshots = track_jsondocument[kRNShotsKey].toInt();
-        track.unshots = track_jsondocument[kUNShotsKey].toInt();
-        track.tror_rfrms = track_jsondocument[kTRORRFRMSKey].toDouble();
-        track.tror_1rms = track_jsondocument[kTROR1RMSKey].toDouble();
-        track.release = track_jsondocument[kReleaseKey].toInt();
-        track.ephemeris_file = track_jsondocument[kEphemerisKey].toString();
-
-        // Stats
-        track.stats_rfrms = StatsFromJson(track_jsondocument[kStatsRFRMSKey].toObject());
-        track.stats_1rms = StatsFromJson(track_jsondocument[kStats1RMSKey].toObject());
-
-        // Meteo
-        for (auto&& meteo : track_jsondocument[kMeteoKey].toArray())
+        // Data, stats, meteo and calibrations.
+        errors.append(TrackingFileManager::headerFromJson(header, calib_path, track, load_calibrations));
+
+        // TODO telescope
+    }
+
+    // Return the errors
+    return errors;
+}
+
+DegorasInformation TrackingFileManager::writeTrackingPrivate(const Tracking &track, const QString &filepath,
+                                                           JsonStreamWriter::Format format)
+{
+    const QByteArray bytes = TrackingFileManager::serializeTracking(
+                track, TrackingFileManager::isBinaryTrackingFile(filepath), format);
+    return TrackingFileManager::writeBytes(bytes, filepath);
+}
+
+QByteArray TrackingFileManager::serializeTracking(const Tracking &track, bool binary, JsonStreamWriter::Format format)
+{
+    // Binary columnar files have their own writer.
+    if (binary)
+        return TrackingBinaryFile::serialize(track);
+
+    static const std::string ranges_key = kRangesKey.toStdString();
+    static const std::string et_key = kEtKey.toStdString();
+
+    // Data, stats, meteo and calibrations.
+    const QJsonObject header = TrackingFileManager::headerToJson(track);
+
+    QByteArray bytes;
+    // Rough size of an indented range, to avoid most of the reallocations.
+    bytes.reserve(static_cast<qsizetype>(track.ranges.size() + track.tA.size() + track.tB.size()) * 200 + 4096);
+    JsonStreamWriter writer(bytes, format);
+
+    // Ranges
+    auto write_ranges = [&writer, &track]
+    {
+        writer.key(ranges_key);
+        if (track.ranges.empty())
         {
-            track.meteo_data.push_back(MeteoData::fromJson(meteo.toObject()));
+            writer.writeNull();
+            return;
         }
 
-        // Calibration data and overall value
-        track.cal_val_overall = track_jsondocument[kOverallCalKey].toDouble();
-        QJsonArray array = track_jsondocument[kCalDataKey].toArray();
-        for (const auto& elem : std::as_const(array))
+        static const std::string flag_key = kFlagKey.toStdString();
+        static const std::string start_key = kStartKey.toStdString();
+        static const std::string tof_key = kToFKey.toStdString();
+        static const std::string pred_key = kPredKey.toStdString();
+        static const std::string trop_key = kTropCorrKey.toStdString();
+        static const std::string bias_key = kBiasKey.toStdString();
+
+        writer.beginArray();
+        for (const auto& elem : track.ranges)
         {
-            /*QJsonObject obj = elem.toObject();
-            Calibration calib;
-            DegorasInformation e = calib_path.isEmpty() ?
-                        CalibrationFileManager::readCalibration(obj[kCalFileKey].toString(), calib) :
-                        CalibrationFileManager::readCalibration(obj[kCalFileKey].toString(), calib_path, calib);
-
-            if (e.hasError())
-                errors.append(e);
-            else
-            {
-                Tracking::CalibrationSpan span = static_cast<decltype(span)>(obj[kCalSpanKey].toInt());
-                track.cal_data[span][calib.date_start] = calib;
-            }*/
+            const auto flag = Tracking::RangeData::flagFromInt(static_cast<int>(elem.flag));
+            const bool unknown = flag == Tracking::RangeData::FilterFlag::UNKNOWN;
+            writer.beginObject();
+            writer.key(bias_key);
+            unknown ? writer.writeNull() : writer.writeDouble(elem.bias);
+            writer.key(flag_key);
+            writer.writeInt(static_cast<int>(flag));
+            writer.key(pred_key);
+            unknown ? writer.writeNull() : writer.writeInt(static_cast<long long>(elem.pre_2w));
+            writer.key(start_key);
+            writer.writeEpoch(elem.start_time);
+            writer.key(tof_key);
+            unknown ? writer.writeNull() : writer.writeInt(static_cast<long long>(elem.tof_2w));
+            writer.key(trop_key);
+            unknown ? writer.writeNull() : writer.writeInt(static_cast<long long>(elem.trop_corr_2w));
+            writer.endObject();
         }
+        writer.endArray();
+    };
 
-        // Ranges
-        array = track_jsondocument[kRangesKey].toArray();
-        for (const auto& elem : std::as_const(array))
+    // ET. Only insert ET precission if there is tA or tB
+    auto write_et = [&writer, &track]
+    {
+        writer.key(et_key);
+        if (track.tA.empty() && track.tB.empty())
         {
-            QJsonObject obj = elem.toObject();
-            Tracking::RangeData range;
-            // TODO: check values of enum
-            range.flag = static_cast<Tracking::RangeData::FilterFlag>(obj[kFlagKey].toInt());
-            try
-            {
-                range.start_time = std::stold(obj[kStartKey].toString().toStdString());
-            }
-            catch (...)
-            {
-                range.start_time = 0.L;
-            }
-
-            range.tof_2w = obj[kToFKey].toDouble();
-            range.pre_2w = obj[kPredKey].toDouble();
-            range.trop_corr_2w = obj[kTropCorrKey].toDouble();
-            range.bias = obj[kBiasKey].toDouble();
-            track.ranges.push_back(range);
+            writer.writeNull();
+            return;
         }
 
-        // TODO: include fail for failed converssions?
-        // ET
-        QJsonObject et_object = track_jsondocument[kEtKey].toObject();
-        if (!et_object.empty())
+        writer.beginObject();
+        writer.key(kETPrecisionKey);
+        writer.writeInt(static_cast<int>(track.et_precision));
+        if (!track.tA.empty())
         {
-            array = et_object[kTAKey].toArray();
-            for (const auto& elem : std::as_const(array))
-            {
-                try
-                {
-                    track.tA.push_back(std::stold(elem.toString().toStdString()));
-                }
-                catch(...){}
-            }
-
-            array = et_object[kTBKey].toArray();
-            for (const auto& elem : std::as_const(array))
-            {
-                try
-                {
-                    track.tB.push_back(std::stold(elem.toString().toStdString()));
-                }
-                catch(...){}
-            }
-
-            track.et_precision = et_object[kETPrecisionKey].toInt();
+            writer.key(kTAKey);
+            writer.beginArray();
+            for (const auto& a : track.tA)
+                writer.writeEpoch(a);
+            writer.endArray();
         }
-
-        // TODO telescope
+        if (!track.tB.empty())
+        {
+            writer.key(kTBKey);
+            writer.beginArray();
+            for (const auto& b : track.tB)
+                writer.writeEpoch(b);
+            writer.endArray();
+        }
+        writer.endObject();
+    };
+
+    // Keys are written in the same (sorted) order used by QJsonDocument, so nshots precedes the ranges.
+    bool ranges_written = false;
+    bool et_written = false;
+    writer.beginObject();
+    for (auto it = header.constBegin(); it != header.constEnd(); ++it)
+    {
+        const std::string key = it.key().toStdString();
+        if (!et_written && et_key < key)
+        {
+            write_et();
+            et_written = true;
+        }
+        if (!ranges_written && ranges_key < key)
+        {
+            write_ranges();
+            ranges_written = true;
+        }
+        writer.key(key);
+        writer.writeValue(it.value());
     }
+    if (!et_written)
+        write_et();
+    if (!ranges_written)
+        write_ranges();
 
-    // Return the errors
-    return errors;
+    // TODO telescope
+
+    writer.endObject();
+
+    return bytes;
 }
 
-DegorasInformation TrackingFileManager::writeTrackingPrivate(const Tracking &track, const QString &filepath)
+DegorasInformation TrackingFileManager::writeBytes(const QByteArray &bytes, const QString &filepath)
 {
-
     QFile track_file(filepath);
     // Check if file could be opened to write.
-    if(!track_file.open(QIODevice::WriteOnly | QIODevice::Text))
+    if(!track_file.open(QIODevice::WriteOnly))
         return DegorasInformation({TrackingFileManager::ErrorEnum::TRACKFILE_NOT_OPEN,
                                   ErrorListStringMap[ErrorEnum::TRACKFILE_NOT_OPEN].arg(filepath)});
 
+    const bool written = track_file.write(bytes) == bytes.size();
+    track_file.close();
+
+    if (!written)
+        return DegorasInformation({TrackingFileManager::ErrorEnum::TRACKFILE_NOT_OPEN,
+                                  ErrorListStringMap[ErrorEnum::TRACKFILE_NOT_OPEN].arg(filepath)});
+
+    // Return the errors
+    return {};
+}
+
+DegorasInformation TrackingFileManager::convertTracking(const QString &src_path, const QString &dst_path)
+{
+    // Both formats are loaded into the same Tracking, so the conversion is lossless in both directions.
+    Tracking track;
+    DegorasInformation errors = TrackingFileManager::readTrackingFromFile(src_path, {}, track);
+    if (!errors.hasError())
+        errors = TrackingFileManager::writeTrackingPrivate(track, dst_path);
+    return errors;
+}
+
+bool TrackingFileManager::isBinaryTrackingFile(const QString &file_path)
+{
+    return QFileInfo(file_path).suffix().compare(TrackingFileManager::kBinarySuffix, Qt::CaseInsensitive) == 0;
+}
+
+QJsonObject TrackingFileManager::headerToJson(const Tracking &track)
+{
     QJsonObject track_object;
 
     // Data
@@ -488,59 +693,81 @@ DegorasInformation TrackingFileManager::writeTrackingPrivate(const Tracking &tra
         for (const auto& cal_pair : std::as_const(span_pair.second))
         {
             QJsonObject o;
-            o[kCalFileKey] = CalibrationFileManager::calibrationFilename(cal_pair.second);
+            o[kCalFileKey] = CalibrationFileManager::calibrationFilename(*cal_pair.second);
             o[kCalSpanKey] = static_cast<int>(span_pair.first);
             array.push_back(o);
         }
     }
-    track_object.insert(kCalDataKey, array);
-
-    // Ranges
-    array = {};
-    for (const auto& elem : track.ranges)
+    for (const auto& ref : track.cal_unresolved)
     {
-        QJsonObject obj;
-        // TODO: check values of enum
-        obj.insert(kFlagKey, static_cast<int>(elem.flag));
-        obj.insert(kStartKey, QString::fromStdString(dpbase::helpers::strings::numberToStr(elem.start_time,17,12)));
-        obj.insert(kToFKey, elem.flag == Tracking::RangeData::FilterFlag::UNKNOWN ?
-                       QJsonValue() : static_cast<long long>(elem.tof_2w));
-        obj.insert(kPredKey, elem.flag == Tracking::RangeData::FilterFlag::UNKNOWN ?
-                       QJsonValue() : static_cast<long long>(elem.pre_2w));
-        obj.insert(kTropCorrKey,
-                   elem.flag == Tracking::RangeData::FilterFlag::UNKNOWN ?
-                       QJsonValue() : static_cast<long long>(elem.trop_corr_2w));
-        obj.insert(kBiasKey, elem.flag == Tracking::RangeData::FilterFlag::UNKNOWN ? QJsonValue() : elem.bias);
-        array.push_back(obj);
+        QJsonObject o;
+        o[kCalFileKey] = ref.file;
+        o[kCalSpanKey] = static_cast<int>(ref.span);
+        array.push_back(o);
     }
-    track_object.insert(kRangesKey, array.empty() ? QJsonValue() : array);
+    track_object.insert(kCalDataKey, array);
 
-    // ET
-    QJsonObject et_object;
-    array = {};
-    std::transform(track.tA.begin(), track.tA.end(), std::back_inserter(array),
-                   [](const auto& a){return QString::fromStdString(dpbase::helpers::strings::numberToStr(a, 18, 12));});
-    if (!array.empty())
-        et_object.insert(kTAKey, array);
+    return track_object;
+}
+
+DegorasInformation TrackingFileManager::headerFromJson(const QJsonObject &object, const QString &calib_path,
+                                                       Tracking &track, bool load_calibrations)
+{
+    DegorasInformation errors;
 
-    array = {};
-    std::transform(track.tB.begin(), track.tB.end(), std::back_inserter(array),
-                   [](const auto& a){return QString::fromStdString(dpbase::helpers::strings::numberToStr(a, 18, 12));});
-    if (!array.empty())
-        et_object.insert(kTBKey, array);
+    // Data
+    track.date_start = QDateTime::fromString(object[kDateStartKey].toString(), Qt::ISODateWithMs);
+    track.date_end = QDateTime::fromString(object[kDateEndKey].toString(), Qt::ISODateWithMs);
+    track.filter_mode = static_cast<Tracking::FilterMode>(object[kFilterModeKey].toInt());
+    track.station_name = object[kStationNameKey].toString();
+    track.station_id = object[kStationIdKey].toInt();
+    track.cfg_id = object[kCfgIdKey].toString();
+    track.obj_name = object[kObjNameKey].toString();
+    track.obj_norad = object[kObjNoradKey].toString();
+    track.obj_bs = object[kObjBSKey].toInt();
+    track.rf = object[kRFKey].toDouble();
+    track.nshots = object[kNShotsKey].toInt();
+    track.rnshots = object[kRNShotsKey].toInt();
+    track.unshots = object[kUNShotsKey].toInt();
+    track.tror_rfrms = object[kTRORRFRMSKey].toDouble();
+    track.tror_1rms = object[kTROR1RMSKey].toDouble();
+    track.release = object[kReleaseKey].toInt();
+    track.ephemeris_file = object[kEphemerisKey].toString();
 
-    if (!et_object.empty())
-        et_object.insert(kETPrecisionKey, static_cast<int>(track.et_precision));
+    // Stats
+    track.stats_rfrms = StatsFromJson(object[kStatsRFRMSKey].toObject());
+    track.stats_1rms = StatsFromJson(object[kStats1RMSKey].toObject());
 
-    // Only insert ET precission if there is tA or tB
-    track_object.insert(kEtKey, et_object.empty() ? QJsonValue() : et_object);
+    // Meteo
+    for (auto&& meteo : object[kMeteoKey].toArray())
+    {
+        track.meteo_data.push_back(MeteoData::fromJson(meteo.toObject()));
+    }
 
-    // TODO telescope
+    // Calibration data and overall value
+    track.cal_val_overall = object[kOverallCalKey].toDouble();
+    QJsonArray array = object[kCalDataKey].toArray();
+    for (const auto& elem : std::as_const(array))
+    {
+        // Each calibration file is read once and shared by all the trackings that reference it.
+        QJsonObject obj = elem.toObject();
+        const QString cal_name = obj[kCalFileKey].toString();
+        const Tracking::CalibrationSpan span = static_cast<Tracking::CalibrationSpan>(obj[kCalSpanKey].toInt());
+        CalibrationCache::CalibrationPtr calib;
+        if (load_calibrations && !CalibrationCache::instance().calibration(cal_name, calib_path, calib).hasError())
+            track.cal_data[span][calib->date_start] = calib;
+        else
+            track.cal_unresolved.push_back({cal_name, span});
+    }
 
-    QJsonDocument track_jsondocument(track_object);
-    track_file.write(track_jsondocument.toJson(QJsonDocument::Indented));
-    track_file.close();
+    return errors;
+}
 
-    // Return the errors
-    return {};
+DegorasInformation TrackingFileManager::unresolvedCalibrations(const Tracking &track)
+{
+    DegorasInformation errors;
+    for (const auto& ref : track.cal_unresolved)
+        errors.append({{ErrorEnum::TRACKFILE_CALIBRATION_NOT_LOADED,
+                        ErrorListStringMap[ErrorEnum::TRACKFILE_CALIBRATION_NOT_LOADED].arg(ref.file)}});
+    return errors;
 }
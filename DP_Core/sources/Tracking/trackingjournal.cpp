@@ -0,0 +1,297 @@
+#include "Tracking/trackingjournal.h"
+#include "Tracking/trackingfilemanager.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtGlobal>
+
+#include <algorithm>
+#include <cstring>
+
+static_assert(Q_BYTE_ORDER == Q_LITTLE_ENDIAN, "The tracking journal is only supported on little endian hosts.");
+
+namespace
+{
+
+const QString kMeteoKey = QStringLiteral("meteo_data");
+
+constexpr std::size_t kRecordHeadSize = 2 * sizeof(std::uint32_t);
+constexpr std::size_t kChecksumSize = sizeof(std::uint32_t);
+constexpr std::size_t kRangePayloadSize = sizeof(std::int64_t) + 4 * sizeof(double) + sizeof(std::uint8_t);
+constexpr std::size_t kFileHeadSize = TrackingJournal::kMagic.size() + sizeof(std::uint32_t);
+
+// FNV-1a. Only used to detect records torn by a crash.
+std::uint32_t checksum(const char* data, std::size_t size)
+{
+    std::uint32_t hash = 2166136261u;
+    for (std::size_t i = 0; i < size; i++)
+    {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+template <typename T>
+T readAt(const char* data)
+{
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+template <typename T>
+char* writeAt(char* data, T value)
+{
+    std::memcpy(data, &value, sizeof(T));
+    return data + sizeof(T);
+}
+
+DegorasInformation error(TrackingFileManager::ErrorEnum code, const QString& path)
+{
+    return DegorasInformation({code, TrackingFileManager::ErrorListStringMap[code].arg(path)});
+}
+
+}
+
+TrackingJournal::TrackingJournal(std::size_t checkpoint_interval) :
+    m_checkpoint_interval(std::max<std::size_t>(checkpoint_interval, 1)),
+    m_nranges(0),
+    m_since_checkpoint(0)
+{}
+
+TrackingJournal::~TrackingJournal()
+{
+    this->close();
+}
+
+DegorasInformation TrackingJournal::begin(const Tracking &header, const QString &journal_path)
+{
+    this->close();
+
+    this->m_path = journal_path;
+    this->m_file.setFileName(journal_path);
+    if (!this->m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return error(TrackingFileManager::TRACKFILE_NOT_OPEN, journal_path);
+
+    this->m_nranges = 0;
+    this->m_since_checkpoint = 0;
+    this->m_buffer.clear();
+    this->m_buffer.append(kMagic.data(), static_cast<qsizetype>(kMagic.size()));
+    this->m_buffer.append(reinterpret_cast<const char*>(&kVersion), sizeof(kVersion));
+
+    return this->appendHeader(header);
+}
+
+DegorasInformation TrackingJournal::resume(const QString &journal_path, const QString &calib_path, Tracking &track)
+{
+    this->close();
+
+    qint64 valid_size = 0;
+    DegorasInformation errors = TrackingJournal::replay(journal_path, calib_path, true, track, valid_size);
+    if (valid_size == 0)
+        return errors;
+
+    // Drop the torn records, if any, so new records follow the last complete one.
+    this->m_path = journal_path;
+    this->m_file.setFileName(journal_path);
+    if (!this->m_file.open(QIODevice::ReadWrite) || !this->m_file.resize(valid_size) ||
+        !this->m_file.seek(valid_size))
+    {
+        this->m_file.close();
+        errors.append(error(TrackingFileManager::TRACKFILE_NOT_OPEN, journal_path));
+        return errors;
+    }
+
+    this->m_nranges = track.ranges.size();
+    this->m_since_checkpoint = 0;
+    this->m_buffer.clear();
+    return errors;
+}
+
+DegorasInformation TrackingJournal::appendRange(const Tracking::RangeData &range)
+{
+    if (!this->isOpen())
+        return error(TrackingFileManager::TRACKFILE_NOT_OPEN, this->m_path);
+
+    char payload[kRangePayloadSize];
+    char* p = writeAt(payload, range.start_time.picoseconds());
+    p = writeAt(p, range.tof_2w);
+    p = writeAt(p, range.pre_2w);
+    p = writeAt(p, range.trop_corr_2w);
+    p = writeAt(p, range.bias);
+    writeAt(p, static_cast<std::uint8_t>(range.flag));
+    this->appendRecord(RecordType::RANGE, payload, kRangePayloadSize);
+
+    this->m_nranges++;
+    if (++this->m_since_checkpoint >= this->m_checkpoint_interval)
+        return this->flush();
+    return {};
+}
+
+DegorasInformation TrackingJournal::appendMeteo(const MeteoData &meteo)
+{
+    if (!this->isOpen())
+        return error(TrackingFileManager::TRACKFILE_NOT_OPEN, this->m_path);
+
+    const QByteArray json = QJsonDocument(meteo.toJson()).toJson(QJsonDocument::Compact);
+    this->appendRecord(RecordType::METEO, json.constData(), static_cast<std::uint32_t>(json.size()));
+    return {};
+}
+
+DegorasInformation TrackingJournal::checkpoint(const Tracking &header)
+{
+    if (!this->isOpen())
+        return error(TrackingFileManager::TRACKFILE_NOT_OPEN, this->m_path);
+    return this->appendHeader(header);
+}
+
+DegorasInformation TrackingJournal::finalize(const Tracking &header, const QString &dest_dir,
+                                             const QString &filename, JsonStreamWriter::Format format)
+{
+    DegorasInformation errors = this->checkpoint(header);
+    if (errors.hasError())
+        return errors;
+    this->close();
+
+    // The header is taken as given (with its loaded calibrations). Only the ranges and meteo data come from the
+    // journal.
+    Tracking track(header);
+    qint64 valid_size = 0;
+    errors = TrackingJournal::replay(this->m_path, "", false, track, valid_size);
+    if (errors.hasError())
+        return errors;
+
+    errors = TrackingFileManager::writeTracking(track, dest_dir, filename, format);
+    if (!errors.hasError() && !QFile::remove(this->m_path))
+        errors.append(error(TrackingFileManager::TRACKFILE_NOT_REMOVABLE, this->m_path));
+    return errors;
+}
+
+void TrackingJournal::close()
+{
+    if (!this->isOpen())
+        return;
+    this->flush();
+    this->m_file.close();
+}
+
+DegorasInformation TrackingJournal::recover(const QString &journal_path, const QString &calib_path, Tracking &track)
+{
+    qint64 valid_size = 0;
+    return TrackingJournal::replay(journal_path, calib_path, true, track, valid_size);
+}
+
+DegorasInformation TrackingJournal::replay(const QString &journal_path, const QString &calib_path, bool read_header,
+                                           Tracking &track, qint64 &valid_size)
+{
+    valid_size = 0;
+
+    QFile file(journal_path);
+    if (!file.open(QIODevice::ReadOnly))
+        return error(TrackingFileManager::TRACKFILE_NOT_OPEN, journal_path);
+    const QByteArray data = file.readAll();
+    file.close();
+
+    const std::size_t size = static_cast<std::size_t>(data.size());
+    const char* bytes = data.constData();
+    if (size < kFileHeadSize || !std::equal(kMagic.begin(), kMagic.end(), bytes))
+        return error(TrackingFileManager::TRACKFILE_INVALID, journal_path);
+    if (readAt<std::uint32_t>(bytes + kMagic.size()) != kVersion)
+        return error(TrackingFileManager::TRACKFILE_UNSUPPORTED_VERSION, journal_path);
+
+    std::vector<Tracking::RangeData> ranges;
+    std::vector<MeteoData> meteo_data;
+    ranges.reserve(size / (kRecordHeadSize + kRangePayloadSize + kChecksumSize));
+    const char* header_json = nullptr;
+    std::size_t header_size = 0;
+
+    // Records are read until the first one that is incomplete or damaged, which can only be the last one written
+    // before a crash.
+    std::size_t pos = kFileHeadSize;
+    while (size - pos >= kRecordHeadSize + kChecksumSize)
+    {
+        const auto type = static_cast<RecordType>(readAt<std::uint32_t>(bytes + pos));
+        const std::size_t payload_size = readAt<std::uint32_t>(bytes + pos + sizeof(std::uint32_t));
+        if (payload_size > size - pos - kRecordHeadSize - kChecksumSize)
+            break;
+        const char* payload = bytes + pos + kRecordHeadSize;
+        if (readAt<std::uint32_t>(payload + payload_size) != checksum(bytes + pos, kRecordHeadSize + payload_size))
+            break;
+
+        if (type == RecordType::HEADER)
+        {
+            header_json = payload;
+            header_size = payload_size;
+        }
+        else if (type == RecordType::RANGE && payload_size == kRangePayloadSize)
+        {
+            Tracking::RangeData range;
+            const char* p = payload;
+            range.start_time = Epoch::fromPicoseconds(readAt<std::int64_t>(p));
+            range.tof_2w = readAt<double>(p += sizeof(std::int64_t));
+            range.pre_2w = readAt<double>(p += sizeof(double));
+            range.trop_corr_2w = readAt<double>(p += sizeof(double));
+            range.bias = readAt<double>(p += sizeof(double));
+            range.flag = Tracking::RangeData::flagFromInt(readAt<std::uint8_t>(p += sizeof(double)));
+            ranges.push_back(range);
+        }
+        else if (type == RecordType::METEO)
+        {
+            const QByteArray json = QByteArray::fromRawData(payload, static_cast<qsizetype>(payload_size));
+            meteo_data.push_back(MeteoData::fromJson(QJsonDocument::fromJson(json).object()));
+        }
+
+        pos += kRecordHeadSize + payload_size + kChecksumSize;
+    }
+
+    DegorasInformation errors;
+    if (read_header)
+    {
+        if (!header_json)
+            return error(TrackingFileManager::TRACKFILE_INVALID, journal_path);
+        const QByteArray json = QByteArray::fromRawData(header_json, static_cast<qsizetype>(header_size));
+        track = Tracking();
+        errors = TrackingFileManager::headerFromJson(QJsonDocument::fromJson(json).object(), calib_path, track);
+    }
+
+    track.ranges = std::move(ranges);
+    track.meteo_data = std::move(meteo_data);
+    valid_size = static_cast<qint64>(pos);
+    return errors;
+}
+
+void TrackingJournal::appendRecord(RecordType type, const char *payload, std::uint32_t size)
+{
+    const qsizetype start = this->m_buffer.size();
+    this->m_buffer.resize(start + static_cast<qsizetype>(kRecordHeadSize + size + kChecksumSize));
+    char* record = this->m_buffer.data() + start;
+    char* p = writeAt(record, static_cast<std::uint32_t>(type));
+    p = writeAt(p, size);
+    std::memcpy(p, payload, size);
+    writeAt(p + size, checksum(record, kRecordHeadSize + size));
+}
+
+DegorasInformation TrackingJournal::appendHeader(const Tracking &header)
+{
+    // The meteo samples are journaled one by one, so the header must not repeat them.
+    QJsonObject object = TrackingFileManager::headerToJson(header);
+    object.remove(kMeteoKey);
+    const QByteArray json = QJsonDocument(object).toJson(QJsonDocument::Compact);
+    this->appendRecord(RecordType::HEADER, json.constData(), static_cast<std::uint32_t>(json.size()));
+    return this->flush();
+}
+
+DegorasInformation TrackingJournal::flush()
+{
+    this->m_since_checkpoint = 0;
+    if (this->m_buffer.isEmpty())
+        return {};
+
+    const bool written = this->m_file.write(this->m_buffer) == this->m_buffer.size() && this->m_file.flush();
+    // Keep the capacity, so appending does not allocate again.
+    this->m_buffer.resize(0);
+    if (!written)
+        return error(TrackingFileManager::TRACKFILE_NOT_OPEN, this->m_path);
+    return {};
+}
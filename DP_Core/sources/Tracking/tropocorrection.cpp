@@ -0,0 +1,86 @@
+#include "Tracking/tropocorrection.h"
+#include "Tracking/meteoseries.h"
+#include "parallelchunks.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+constexpr double kSpeedOfLight = 299792458.;
+constexpr double kPicosecondsPerSecond = 1e12;
+constexpr double kDegToRad = 3.14159265358979323846 / 180.;
+constexpr double kLn10 = 2.302585092994046;
+
+// Terms of the model that only depend on the station and the laser.
+struct Coefficients
+{
+    double scale;       ///< Two way, meters to picoseconds and f(lambda) / f(phi, H).
+    double cos2phi;
+};
+
+Coefficients coefficients(const TropoCorrection::Config& config)
+{
+    const double l2 = config.wavelength_um * config.wavelength_um;
+    const double f_lambda = 0.9650 + 0.0164 / l2 + 0.000228 / (l2 * l2);
+    const double cos2phi = std::cos(2. * config.latitude_deg * kDegToRad);
+    const double f_site = 1. - 0.0026 * cos2phi - 0.00031 * config.altitude_m / 1000.;
+    return {2. * f_lambda / f_site * kPicosecondsPerSecond / kSpeedOfLight, cos2phi};
+}
+
+inline double delay(double pressure, double temp, double rel_hum, double elevation_deg, const Coefficients& c)
+{
+    // Water vapor pressure (mbar) from the relative humidity.
+    const double temp_c = temp - 273.15;
+    const double wvp = rel_hum * 0.0611 * std::exp(kLn10 * 7.5 * temp_c / (237.3 + temp_c));
+    const double a = 0.002357 * pressure + 0.000141 * wvp;
+    const double k = 1.163 - 0.00968 * c.cos2phi - 0.00104 * temp + 0.00001435 * pressure;
+    const double b = 1.084e-8 * pressure * temp * k + 4.734e-8 * (pressure * pressure / temp) * (2. / (3. - 1. / k));
+    const double sin_el = std::sin(elevation_deg * kDegToRad);
+    return c.scale * (a + b) / (sin_el + (b / (a + b)) / (sin_el + 0.01));
+}
+
+}
+
+double TropoCorrection::mariniMurray(double pressure, double temp, double rel_hum, double elevation_deg,
+                                     const Config &config)
+{
+    return delay(pressure, temp, rel_hum, elevation_deg, coefficients(config));
+}
+
+void TropoCorrection::compute(SpanView<const double> pressure, SpanView<const double> temp,
+                              SpanView<const double> rel_hum, SpanView<const double> elevation_deg,
+                              SpanView<double> trop_corr_2w, const Config &config)
+{
+    const std::size_t count = std::min({pressure.size(), temp.size(), rel_hum.size(), elevation_deg.size(),
+                                        trop_corr_2w.size()});
+    const Coefficients c = coefficients(config);
+    parallelChunks(count, config.chunk_size, config.max_threads, [&](std::size_t, std::size_t begin, std::size_t end)
+    {
+        const double* p = pressure.data();
+        const double* t = temp.data();
+        const double* rh = rel_hum.data();
+        const double* el = elevation_deg.data();
+        double* out = trop_corr_2w.data();
+        for (std::size_t i = begin; i < end; i++)
+            out[i] = delay(p[i], t[i], rh[i], el[i], c);
+    });
+}
+
+bool TropoCorrection::recomputeTracking(Tracking &track, SpanView<const double> elevations_deg, const Config &config)
+{
+    if (track.meteo_data.empty() || elevations_deg.size() != track.ranges.size())
+        return false;
+
+    const MeteoSeries series(track.meteo_data, MeteoSeries::dayReference(track.date_start));
+    const std::vector<double> times = MeteoSeries::rangeTimes(track.ranges);
+    const MeteoSeries::Samples meteo = series.interpolate(times);
+
+    std::vector<double> trop_corr(track.ranges.size());
+    TropoCorrection::compute(meteo.pressure, meteo.temp, meteo.rel_hum, elevations_deg, trop_corr, config);
+    for (std::size_t i = 0; i < trop_corr.size(); i++)
+        track.ranges[i].trop_corr_2w = trop_corr[i];
+
+    return true;
+}
@@ -0,0 +1,287 @@
+#include "algorithms.h"
+#include "chebyshevfit.h"
+#include "parallelchunks.h"
+
+namespace
+{
+
+// Time bins filtered by every task of the histogram prefilter.
+constexpr std::size_t kPrefilterBinsPerChunk = 4;
+
+// Selected ranges of the histogram prefilter, for every chunk of bins in order.
+std::vector<std::vector<std::size_t>> histPrefilterChunks(const std::vector<double> &times,
+                                                          const std::vector<double> &resids, double bs, double depth,
+                                                          unsigned min_ph, unsigned divisions)
+{
+    // Check the input data.
+    if (times.empty() || resids.empty() || times.size() != resids.size() || depth <= 0 || bs <= 0 || divisions <= 0)
+        return {};
+
+    // Containers and auxiliar variables.
+    double _depth = depth/divisions;
+    unsigned _min_ph = min_ph/divisions;
+    const auto offsets = algorithm::extractBinOffsets(times, resids, bs);
+    const std::size_t nbins = offsets.size() - 1;
+    const SpanView<const double> all_resids(resids);
+
+    // The bins are independent, so they are filtered concurrently. Every chunk of bins stores its selection in its
+    // own slot, and the slots are joined in order, so the result is the same as filtering them one after another.
+    std::vector<std::vector<std::size_t>> chunk_selected(chunkCount(nbins, kPrefilterBinsPerChunk));
+    parallelChunks(nbins, kPrefilterBinsPerChunk, 0, [&](std::size_t chunk, std::size_t begin, std::size_t end)
+    {
+        std::vector<std::size_t>& selected = chunk_selected[chunk];
+        for (std::size_t bin = begin; bin < end; bin++)
+        {
+            // Compute selected ranges from the bin, directly over the residuals of the bin.
+            const std::size_t first = offsets[bin];
+            auto bin_resids = all_resids.subspan(first, offsets[bin + 1] - first);
+            auto bin_selected = algorithm::histPrefilterBinSLR(bin_resids, _depth, _min_ph);
+            std::transform(bin_selected.begin(), bin_selected.end(), std::back_inserter(selected),
+                           [first](const auto& idx){return  idx + first;});
+        }
+    });
+
+    return chunk_selected;
+}
+
+}
+
+namespace algorithm{
+
+std::vector<std::size_t> histPrefilterSLR(const std::vector<double> &times, const std::vector<double> &resids,
+                                                     double bs, double depth, unsigned min_ph, unsigned divisions)
+{
+    const auto chunk_selected = histPrefilterChunks(times, resids, bs, depth, min_ph, divisions);
+
+    // Join the selected ranges.
+    std::size_t total = 0;
+    for (const auto& selected : chunk_selected)
+        total += selected.size();
+    std::vector<std::size_t> selected_ranges;
+    selected_ranges.reserve(total);
+    for (const auto& selected : chunk_selected)
+        selected_ranges.insert(selected_ranges.end(), selected.begin(), selected.end());
+
+    // Return the result container.
+    return selected_ranges;
+}
+
+SelectionMask histPrefilterMaskSLR(const std::vector<double> &times, const std::vector<double> &resids,
+                                   double bs, double depth, unsigned min_ph, unsigned divisions)
+{
+    SelectionMask mask(resids.size());
+    for (const auto& selected : histPrefilterChunks(times, resids, bs, depth, min_ph, divisions))
+        for (std::size_t idx : selected)
+            mask.set(idx);
+    return mask;
+}
+
+std::vector<std::size_t> histPrefilterBinSLR(const std::vector<double> &resids_bin, double depth, unsigned min_ph)
+{
+    return histPrefilterBinSLR(SpanView<const double>(resids_bin), depth, min_ph);
+}
+
+std::vector<std::size_t> histPrefilterBinSLR(SpanView<const double> resids_bin, double depth, unsigned min_ph)
+{
+    std::vector<std::size_t> selected_ranges;
+
+    // Check if the residuals bin is not empty.
+    if(!resids_bin.empty())
+    {
+        // Compute the range gate width.
+        auto edges = std::minmax_element(resids_bin.begin(), resids_bin.end());
+        long double rg_width = std::abs(*edges.first) + std::abs(*edges.second);
+
+        // Get the histogram division size.
+        std::size_t hist_size = static_cast<std::size_t>(std::floor(rg_width/depth));
+        if (hist_size == 0)
+            return selected_ranges;
+
+        // Calculate histogram of residuals in bin. The edges of the histogram bin k are
+        // [min_edge + k * div, min_edge + k * div + div), as reported by histcounts1D.
+        const double min_edge = *edges.first;
+        const double div = (*edges.second - min_edge) / hist_size;
+        std::vector<unsigned> counts;
+        histCountsPrivate<ClosedOpenBin>(resids_bin.data(), resids_bin.size(), hist_size, min_edge, div, counts);
+
+        auto it = std::max_element(counts.begin(), counts.end());
+
+        if (*it >= min_ph)
+        {
+            // Selected histogram bins: the contiguous run [sel_first, sel_last] around the maximum.
+            const long long max_idx = static_cast<long long>(it - counts.begin());
+            long long sel_first = max_idx;
+            long long sel_last = max_idx;
+
+            while (sel_first > 0 && counts[static_cast<std::size_t>(sel_first - 1)] >= min_ph)
+                sel_first--;
+
+            while (sel_last + 1 < static_cast<long long>(hist_size) &&
+                   counts[static_cast<std::size_t>(sel_last + 1)] >= min_ph)
+                sel_last++;
+
+            // Get points which are inside of selected histogram bins. The histogram bin of every point is computed
+            // directly, and only the neighbours are checked against the edges for rounding issues.
+            const double lower_limit = min_edge + sel_first * div;
+            const double upper_limit = min_edge + sel_last * div + div;
+            for (std::size_t res_idx = 0; res_idx < resids_bin.size(); res_idx++)
+            {
+                const double resid = resids_bin[res_idx];
+                if (!(resid >= lower_limit - div && resid < upper_limit + div))
+                    continue;
+
+                const long long candidate = static_cast<long long>(std::floor((resid - min_edge) / div));
+                const long long k_first = std::max(candidate - 1, sel_first);
+                const long long k_last = std::min(candidate + 1, sel_last);
+                bool select = false;
+                for (long long k = k_first; !select && k <= k_last; k++)
+                {
+                    const double bin_min = min_edge + k * div;
+                    select = resid >= bin_min && resid < bin_min + div;
+                }
+
+                // Store the selected range.
+                if (select)
+                    selected_ranges.push_back(res_idx);
+            }
+        }
+
+    }
+
+    return selected_ranges;
+}
+
+std::vector<std::size_t> histPostfilterSLR(const std::vector<double> &times, const std::vector<double> &data,
+                                           double bs, double depth)
+{
+    return histPostfilterMaskSLR(times, data, bs, depth).toIndexes();
+}
+
+SelectionMask histPostfilterMaskSLR(const std::vector<double> &times, const std::vector<double> &data,
+                                    double bs, double depth)
+{
+    // Call to the prefilter disabling the ph contributions.
+    //return histPrefilterSLR(times, data, bs, depth, 0);
+
+    // Auxiliar containers.
+    SelectionMask sel_mask(data.size());
+    double rf = depth *1.5; // depth / 2 * 2.5
+    std::vector<double> y_vec;
+
+    // Detrend the residuals.
+    //detrend_resids = dpslr::math::detrend(times, data, 9);
+
+    // Fit in a scaled Chebyshev basis, as the raw times make the monomial fit ill-conditioned.
+    const auto fit = ChebyshevFit::fit(times, data, 9);
+    y_vec.resize(std::min(times.size(), data.size()));
+    fit.evaluate(times, y_vec);
+
+    for (std::size_t i = 0; i < y_vec.size(); i++)
+    {
+        double y_interp = y_vec[i];
+
+        if (data[i] >= y_interp - rf && data[i] <= y_interp + rf)
+            sel_mask.set(i);
+
+    }
+    return sel_mask;
+}
+
+SigmaClipResult sigmaClipFilter(SpanView<const double> values, SelectionMask &mask, double factor,
+                                unsigned max_iterations, ClipCenter center)
+{
+    SigmaClipResult result;
+    const std::size_t size = std::min(values.size(), mask.size());
+
+    // Compact columns with the accepted finite values and their indexes. The non finite ones are rejected at once.
+    std::vector<double> accepted;
+    std::vector<std::size_t> indexes = mask.toIndexes();
+    accepted.reserve(indexes.size());
+    std::size_t count = 0;
+    for (std::size_t idx : indexes)
+    {
+        if (idx < size && std::isfinite(values[idx]))
+        {
+            accepted.push_back(values[idx]);
+            indexes[count++] = idx;
+        }
+        else
+        {
+            mask.reset(idx);
+            result.rejected++;
+        }
+    }
+
+    // Running sums, shifted by the first value to keep the variance accurate when the values are far from zero.
+    const double shift = count ? accepted[0] : 0.;
+    double sum = 0.;
+    double sum_sq = 0.;
+    for (std::size_t k = 0; k < count; k++)
+    {
+        const double dev = accepted[k] - shift;
+        sum += dev;
+        sum_sq += dev * dev;
+    }
+    auto stats = [&sum, &sum_sq](std::size_t n, double& mean, double& stddev)
+    {
+        mean = sum / n;
+        stddev = std::sqrt(std::max(sum_sq / n - mean * mean, 0.));
+    };
+
+    if (count == 0)
+        result.converged = true;
+    while (count > 0 && result.iterations < max_iterations)
+    {
+        result.iterations++;
+        double mean, stddev;
+        stats(count, mean, stddev);
+        const double limit = factor * stddev;
+        if (!(limit > 0.))
+        {
+            // All the values are equal. Nothing is rejected.
+            result.converged = true;
+            break;
+        }
+
+        // The accepted values are kept at the front of the columns, and only the rejected ones are subtracted from
+        // the sums, so an iteration reads the accepted values once and does no work for the kept ones.
+        const double lower = (center == ClipCenter::MEAN ? mean + shift : 0.) - limit;
+        const double upper = lower + 2. * limit;
+        std::size_t kept = 0;
+        for (std::size_t k = 0; k < count; k++)
+        {
+            const double value = accepted[k];
+            if (value > lower && value < upper)
+            {
+                accepted[kept] = value;
+                indexes[kept++] = indexes[k];
+            }
+            else
+            {
+                const double dev = value - shift;
+                sum -= dev;
+                sum_sq -= dev * dev;
+                mask.reset(indexes[k]);
+            }
+        }
+
+        result.rejected += count - kept;
+        if (kept == count)
+        {
+            result.converged = true;
+            break;
+        }
+        count = kept;
+    }
+
+    // Statistics of the accepted values.
+    if (count > 0)
+    {
+        stats(count, result.mean, result.stddev);
+        result.mean += shift;
+    }
+
+    return result;
+}
+
+}
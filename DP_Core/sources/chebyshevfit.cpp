@@ -0,0 +1,321 @@
+#include "chebyshevfit.h"
+#include "parallelchunks.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+
+// Points evaluated together by the batched Clenshaw recurrence, and accumulated together into the normal equations.
+constexpr std::size_t kEvaluateBlock = 256;
+constexpr std::size_t kAccumulateBlock = 256;
+// Bins fitted by every task of fitBins and evaluateBins.
+constexpr std::size_t kBinsPerChunk = 8;
+// Relative size of a Cholesky pivot, with respect to the diagonal of A^T A, below which its column is considered
+// dependent.
+constexpr double kRankTolerance = 1e-10;
+
+}
+
+ChebyshevFit::ChebyshevFit(unsigned degree, double x_min, double x_max) :
+    m_degree(degree),
+    m_x_min(x_min),
+    m_x_max(x_max),
+    m_gram((degree + 1) * (degree + 1), 0.),
+    m_aty(degree + 1, 0.)
+{
+    if (x_max > x_min)
+    {
+        this->m_center = x_min + (x_max - x_min) / 2.;
+        this->m_inv_half_width = 2. / (x_max - x_min);
+    }
+    else
+    {
+        // A single abscissa. Only the constant term can be solved.
+        this->m_center = x_min;
+        this->m_inv_half_width = 1.;
+    }
+}
+
+void ChebyshevFit::add(double x, double y)
+{
+    this->add(SpanView<const double>(&x, 1), SpanView<const double>(&y, 1));
+}
+
+void ChebyshevFit::add(SpanView<const double> x, SpanView<const double> y)
+{
+    this->update(x, y, 1.);
+}
+
+void ChebyshevFit::remove(SpanView<const double> x, SpanView<const double> y)
+{
+    this->update(x, y, -1.);
+}
+
+void ChebyshevFit::update(SpanView<const double> x, SpanView<const double> y, double sign)
+{
+    if (this->m_gram.empty())
+        return;
+
+    const std::size_t n = this->m_degree + 1;
+    const std::size_t size = std::min(x.size(), y.size());
+    this->m_block.resize(n * kAccumulateBlock + 2 * kAccumulateBlock);
+    double* values = this->m_block.data();
+    double* t = values + n * kAccumulateBlock;
+    double* ys = t + kAccumulateBlock;
+
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < size; i++)
+    {
+        if (!std::isfinite(x[i]) || !std::isfinite(y[i]))
+            continue;
+        t[count] = this->scale(x[i]);
+        ys[count] = y[i];
+        if (++count == kAccumulateBlock)
+        {
+            this->basis(t, count, kAccumulateBlock, values);
+            this->accumulate(values, ys, count, kAccumulateBlock, sign);
+            count = 0;
+        }
+    }
+    if (count > 0)
+    {
+        this->basis(t, count, kAccumulateBlock, values);
+        this->accumulate(values, ys, count, kAccumulateBlock, sign);
+    }
+}
+
+void ChebyshevFit::reset()
+{
+    std::fill(this->m_gram.begin(), this->m_gram.end(), 0.);
+    std::fill(this->m_aty.begin(), this->m_aty.end(), 0.);
+    this->m_coefs.clear();
+    this->m_count = 0;
+}
+
+bool ChebyshevFit::solve()
+{
+    this->m_coefs.clear();
+    if (this->m_count == 0)
+        return false;
+
+    const std::size_t n = this->m_degree + 1;
+
+    // Cholesky factor (A^T A = L L^T, L stored by rows). The leading k x k block of the factor only depends on the
+    // first k basis columns, so a lower degree is solved by truncation when there are not enough points or the
+    // columns are dependent.
+    std::size_t used = std::min(n, this->m_count);
+    std::vector<double> chol(n * n, 0.);
+    for (std::size_t k = 0; k < used; k++)
+    {
+        for (std::size_t j = 0; j <= k; j++)
+        {
+            double sum = this->m_gram[j * n + k];
+            for (std::size_t i = 0; i < j; i++)
+                sum -= chol[k * n + i] * chol[j * n + i];
+            if (j < k)
+                chol[k * n + j] = sum / chol[j * n + j];
+            else if (sum > kRankTolerance * this->m_gram[k * n + k] && sum > 0.)
+                chol[k * n + k] = std::sqrt(sum);
+            else
+                used = k;
+        }
+    }
+
+    // Forward (L z = A^T y) and back (L^T c = z) substitutions.
+    std::vector<double> z(used);
+    for (std::size_t k = 0; k < used; k++)
+    {
+        double sum = this->m_aty[k];
+        for (std::size_t i = 0; i < k; i++)
+            sum -= chol[k * n + i] * z[i];
+        z[k] = sum / chol[k * n + k];
+    }
+    this->m_coefs.assign(n, 0.);
+    for (std::size_t k = used; k-- > 0;)
+    {
+        double sum = z[k];
+        for (std::size_t i = k + 1; i < used; i++)
+            sum -= chol[i * n + k] * this->m_coefs[i];
+        this->m_coefs[k] = sum / chol[k * n + k];
+    }
+
+    return true;
+}
+
+double ChebyshevFit::evaluate(double x) const
+{
+    if (this->m_coefs.empty())
+        return std::numeric_limits<double>::quiet_NaN();
+
+    // Clenshaw recurrence.
+    const double t = this->scale(x);
+    double b1 = 0.;
+    double b2 = 0.;
+    for (std::size_t k = this->m_coefs.size() - 1; k > 0; k--)
+    {
+        const double b = this->m_coefs[k] + 2. * t * b1 - b2;
+        b2 = b1;
+        b1 = b;
+    }
+    return this->m_coefs[0] + t * b1 - b2;
+}
+
+void ChebyshevFit::evaluate(SpanView<const double> x, SpanView<double> y) const
+{
+    const std::size_t size = std::min(x.size(), y.size());
+    if (this->m_coefs.empty())
+    {
+        std::fill(y.begin(), y.begin() + size, std::numeric_limits<double>::quiet_NaN());
+        return;
+    }
+
+    // The recurrence runs for a whole block of points at each coefficient, so the inner loops have no dependencies.
+    double t[kEvaluateBlock];
+    double b1[kEvaluateBlock];
+    double b2[kEvaluateBlock];
+    const double* coefs = this->m_coefs.data();
+    const std::size_t ncoefs = this->m_coefs.size();
+    for (std::size_t begin = 0; begin < size; begin += kEvaluateBlock)
+    {
+        const std::size_t count = std::min(kEvaluateBlock, size - begin);
+        const double* xs = x.data() + begin;
+        double* ys = y.data() + begin;
+
+        for (std::size_t j = 0; j < count; j++)
+        {
+            t[j] = (xs[j] - this->m_center) * this->m_inv_half_width;
+            b1[j] = 0.;
+            b2[j] = 0.;
+        }
+
+        for (std::size_t k = ncoefs - 1; k > 0; k--)
+        {
+            const double c = coefs[k];
+            for (std::size_t j = 0; j < count; j++)
+            {
+                const double b = c + 2. * t[j] * b1[j] - b2[j];
+                b2[j] = b1[j];
+                b1[j] = b;
+            }
+        }
+
+        for (std::size_t j = 0; j < count; j++)
+            ys[j] = coefs[0] + t[j] * b1[j] - b2[j];
+    }
+}
+
+double ChebyshevFit::scale(double x) const
+{
+    return (x - this->m_center) * this->m_inv_half_width;
+}
+
+ChebyshevFit ChebyshevFit::fit(SpanView<const double> x, SpanView<const double> y, unsigned degree)
+{
+    const std::size_t count = std::min(x.size(), y.size());
+    double x_min = std::numeric_limits<double>::infinity();
+    double x_max = -std::numeric_limits<double>::infinity();
+    for (std::size_t i = 0; i < count; i++)
+    {
+        if (std::isfinite(x[i]))
+        {
+            x_min = std::min(x_min, x[i]);
+            x_max = std::max(x_max, x[i]);
+        }
+    }
+    if (x_min > x_max)
+        x_min = x_max = 0.;
+
+    ChebyshevFit result(degree, x_min, x_max);
+    result.add(x.first(count), y.first(count));
+    result.solve();
+    return result;
+}
+
+std::vector<ChebyshevFit> ChebyshevFit::fitBins(SpanView<const double> x, SpanView<const double> y,
+                                                const std::vector<std::size_t> &offsets, unsigned degree,
+                                                int max_threads)
+{
+    const std::size_t nbins = offsets.empty() ? 0 : offsets.size() - 1;
+    std::vector<ChebyshevFit> fits(nbins);
+    parallelChunks(nbins, kBinsPerChunk, max_threads, [&](std::size_t, std::size_t begin, std::size_t end)
+    {
+        for (std::size_t bin = begin; bin < end; bin++)
+        {
+            const std::size_t first = offsets[bin];
+            const std::size_t count = offsets[bin + 1] - first;
+            fits[bin] = ChebyshevFit::fit(x.subspan(first, count), y.subspan(first, count), degree);
+        }
+    });
+    return fits;
+}
+
+void ChebyshevFit::evaluateBins(const std::vector<ChebyshevFit> &fits, SpanView<const double> x,
+                                const std::vector<std::size_t> &offsets, SpanView<double> y, int max_threads)
+{
+    const std::size_t nbins = std::min(fits.size(), offsets.empty() ? 0 : offsets.size() - 1);
+    parallelChunks(nbins, kBinsPerChunk, max_threads, [&](std::size_t, std::size_t begin, std::size_t end)
+    {
+        for (std::size_t bin = begin; bin < end; bin++)
+        {
+            const std::size_t first = offsets[bin];
+            const std::size_t count = offsets[bin + 1] - first;
+            fits[bin].evaluate(x.subspan(first, count), y.subspan(first, count));
+        }
+    });
+}
+
+void ChebyshevFit::basis(const double *t, std::size_t count, std::size_t stride, double *values) const
+{
+    double* t0 = values;
+    for (std::size_t j = 0; j < count; j++)
+        t0[j] = 1.;
+    if (this->m_degree == 0)
+        return;
+    double* t1 = values + stride;
+    for (std::size_t j = 0; j < count; j++)
+        t1[j] = t[j];
+    for (unsigned k = 2; k <= this->m_degree; k++)
+    {
+        double* tk = values + k * stride;
+        const double* tk1 = tk - stride;
+        const double* tk2 = tk1 - stride;
+        for (std::size_t j = 0; j < count; j++)
+            tk[j] = 2. * t[j] * tk1[j] - tk2[j];
+    }
+}
+
+void ChebyshevFit::accumulate(const double *values, const double *y, std::size_t count, std::size_t stride,
+                              double sign)
+{
+    // Every entry is a dot product over the block. Four partial sums keep the multiplications independent.
+    const std::size_t n = this->m_degree + 1;
+    const std::size_t count4 = count - count % 4;
+    auto dot = [count, count4](const double* a, const double* b)
+    {
+        double s0 = 0., s1 = 0., s2 = 0., s3 = 0.;
+        for (std::size_t j = 0; j < count4; j += 4)
+        {
+            s0 += a[j] * b[j];
+            s1 += a[j + 1] * b[j + 1];
+            s2 += a[j + 2] * b[j + 2];
+            s3 += a[j + 3] * b[j + 3];
+        }
+        for (std::size_t j = count4; j < count; j++)
+            s0 += a[j] * b[j];
+        return (s0 + s1) + (s2 + s3);
+    };
+
+    for (std::size_t r = 0; r < n; r++)
+    {
+        const double* vr = values + r * stride;
+        for (std::size_t c = r; c < n; c++)
+            this->m_gram[r * n + c] += sign * dot(vr, values + c * stride);
+        this->m_aty[r] += sign * dot(vr, y);
+    }
+
+    this->m_count = sign > 0 ? this->m_count + count : this->m_count - std::min(this->m_count, count);
+    this->m_coefs.clear();
+}
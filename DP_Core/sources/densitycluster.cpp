@@ -0,0 +1,362 @@
+#include "densitycluster.h"
+#include "parallelchunks.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace
+{
+
+using algorithm::DensityClusters;
+
+// Side of the grid cells in scaled units (the neighbour radius is 1), so the diagonal of a cell is 1.
+constexpr double kCellSide = 0.70710678118654752440;
+// Cells visited around a cell in every direction.
+constexpr long long kCellReach = 2;
+constexpr std::size_t kRanges = 2 * kCellReach + 1;
+// Grid columns processed by every task.
+constexpr std::size_t kColumnsPerChunk = 4;
+
+/**
+ * @brief Uniform grid over the scaled points, with the points sorted by cell (column, then row).
+ */
+struct CellGrid
+{
+    std::vector<std::size_t> order;         ///< Index of every sorted point in the input.
+    std::vector<double> xs;                 ///< Scaled coordinates of the sorted points.
+    std::vector<double> ys;
+    std::vector<long long> cell_rows;       ///< Row of every cell.
+    std::vector<std::size_t> offsets;       ///< Points [offsets[c], offsets[c + 1]) of every cell.
+    std::vector<long long> column_xs;       ///< Column of every non empty column.
+    std::vector<std::size_t> columns;       ///< Cells [columns[j], columns[j + 1]) of every non empty column.
+
+    inline std::size_t cellCount() const {return this->cell_rows.size();}
+    inline std::size_t columnCount() const {return this->column_xs.size();}
+    inline std::size_t cellSize(std::size_t c) const {return this->offsets[c + 1] - this->offsets[c];}
+
+    // Cells around every cell of the column j, as the ranges [reach[2k], reach[2k + 1]) of the neighbour columns k,
+    // in blocks of 2 * kRanges per cell. The rows of a column are sorted, so the ranges advance with the cell.
+    void columnReach(std::size_t j, std::vector<std::size_t>& reach) const
+    {
+        const std::size_t first = this->columns[j];
+        const std::size_t last = this->columns[j + 1];
+        reach.assign(2 * kRanges * (last - first), 0);
+        // The columns are sorted and different, so the neighbour ones are within kCellReach positions.
+        const std::size_t span = static_cast<std::size_t>(kCellReach);
+        const std::size_t lowest = j > span ? j - span : 0;
+        const std::size_t highest = std::min(j + span + 1, this->columnCount());
+        for (std::size_t m = lowest; m < highest; m++)
+        {
+            const long long dx = this->column_xs[m] - this->column_xs[j];
+            if (dx < -kCellReach || dx > kCellReach)
+                continue;
+            const std::size_t k = static_cast<std::size_t>(dx + kCellReach);
+            const std::size_t end = this->columns[m + 1];
+            std::size_t lower = this->columns[m];
+            std::size_t upper = lower;
+            for (std::size_t c = first; c < last; c++)
+            {
+                const long long row = this->cell_rows[c];
+                while (lower < end && this->cell_rows[lower] < row - kCellReach)
+                    lower++;
+                upper = std::max(upper, lower);
+                while (upper < end && this->cell_rows[upper] <= row + kCellReach)
+                    upper++;
+                reach[2 * kRanges * (c - first) + 2 * k] = lower;
+                reach[2 * kRanges * (c - first) + 2 * k + 1] = upper;
+            }
+        }
+    }
+
+    // Cells around the cell c of the column j, as the ranges of columnReach, searching the rows.
+    void cellReach(std::size_t j, std::size_t c, std::size_t* ranges) const
+    {
+        std::fill(ranges, ranges + 2 * kRanges, 0);
+        const std::size_t span = static_cast<std::size_t>(kCellReach);
+        const std::size_t lowest = j > span ? j - span : 0;
+        const std::size_t highest = std::min(j + span + 1, this->columnCount());
+        const long long row = this->cell_rows[c];
+        for (std::size_t m = lowest; m < highest; m++)
+        {
+            const long long dx = this->column_xs[m] - this->column_xs[j];
+            if (dx < -kCellReach || dx > kCellReach)
+                continue;
+            const std::size_t k = static_cast<std::size_t>(dx + kCellReach);
+            const auto first = this->cell_rows.begin() + static_cast<std::ptrdiff_t>(this->columns[m]);
+            const auto last = this->cell_rows.begin() + static_cast<std::ptrdiff_t>(this->columns[m + 1]);
+            const auto lower = std::lower_bound(first, last, row - kCellReach);
+            ranges[2 * k] = static_cast<std::size_t>(lower - this->cell_rows.begin());
+            ranges[2 * k + 1] = static_cast<std::size_t>(std::upper_bound(lower, last, row + kCellReach) -
+                                                         this->cell_rows.begin());
+        }
+    }
+
+    inline bool neighbours(std::size_t p, std::size_t q) const
+    {
+        const double dx = this->xs[p] - this->xs[q];
+        const double dy = this->ys[p] - this->ys[q];
+        return dx * dx + dy * dy <= 1.;
+    }
+};
+
+// Calls f(d) for every cell d in the ranges of a cell (see CellGrid::columnReach).
+template <typename F>
+inline void forNeighbours(const std::size_t* ranges, F&& f)
+{
+    for (std::size_t k = 0; k < kRanges; k++)
+        for (std::size_t d = ranges[2 * k]; d < ranges[2 * k + 1]; d++)
+            f(d);
+}
+
+CellGrid buildGrid(SpanView<const double> times, SpanView<const double> resids, double time_radius,
+                   double resid_radius)
+{
+    CellGrid grid;
+    const std::size_t size = std::min(times.size(), resids.size());
+    double min_time = std::numeric_limits<double>::infinity();
+    double min_resid = std::numeric_limits<double>::infinity();
+    for (std::size_t i = 0; i < size; i++)
+    {
+        if (std::isfinite(times[i]) && std::isfinite(resids[i]))
+        {
+            min_time = std::min(min_time, times[i]);
+            min_resid = std::min(min_resid, resids[i]);
+        }
+    }
+    auto scaledX = [&](std::size_t i){return (times[i] - min_time) / time_radius;};
+    auto scaledY = [&](std::size_t i){return (resids[i] - min_resid) / resid_radius;};
+    auto cellOf = [](double scaled){return static_cast<long long>(std::floor(scaled / kCellSide));};
+
+    // Column of every point. For points sorted in time they are already in order.
+    std::vector<std::pair<long long, std::size_t>> keys;
+    keys.reserve(size);
+    for (std::size_t i = 0; i < size; i++)
+        if (std::isfinite(times[i]) && std::isfinite(resids[i]))
+            keys.emplace_back(cellOf(scaledX(i)), i);
+    if (!std::is_sorted(keys.begin(), keys.end()))
+        std::sort(keys.begin(), keys.end());
+
+    // Rows of every column, sorted, and the cells.
+    const std::size_t npoints = keys.size();
+    grid.order.reserve(npoints);
+    grid.xs.reserve(npoints);
+    grid.ys.reserve(npoints);
+    std::vector<std::pair<long long, std::size_t>> rows;
+    for (std::size_t first = 0; first < npoints;)
+    {
+        const long long column = keys[first].first;
+        std::size_t last = first;
+        rows.clear();
+        for (; last < npoints && keys[last].first == column; last++)
+            rows.emplace_back(cellOf(scaledY(keys[last].second)), keys[last].second);
+        std::sort(rows.begin(), rows.end());
+
+        grid.column_xs.push_back(column);
+        grid.columns.push_back(grid.cellCount());
+        for (std::size_t k = 0; k < rows.size(); k++)
+        {
+            if (k == 0 || rows[k].first != rows[k - 1].first)
+            {
+                grid.cell_rows.push_back(rows[k].first);
+                grid.offsets.push_back(grid.order.size());
+            }
+            grid.order.push_back(rows[k].second);
+            grid.xs.push_back(scaledX(rows[k].second));
+            grid.ys.push_back(scaledY(rows[k].second));
+        }
+        first = last;
+    }
+    grid.offsets.push_back(npoints);
+    grid.columns.push_back(grid.cellCount());
+
+    return grid;
+}
+
+// Root of the set of a cell, halving the path.
+std::size_t findRoot(std::vector<std::size_t>& parents, std::size_t c)
+{
+    while (parents[c] != c)
+    {
+        parents[c] = parents[parents[c]];
+        c = parents[c];
+    }
+    return c;
+}
+
+}
+
+namespace algorithm{
+
+SelectionMask DensityClusters::selection(std::size_t min_size) const
+{
+    SelectionMask mask(this->labels.size());
+    for (std::size_t i = 0; i < this->labels.size(); i++)
+    {
+        const int label = this->labels[i];
+        if (label != kNoise && this->sizes[static_cast<std::size_t>(label)] >= min_size)
+            mask.set(i);
+    }
+    return mask;
+}
+
+DensityClusters densityClusters(SpanView<const double> times, SpanView<const double> resids, double time_radius,
+                                double resid_radius, std::size_t min_points, int max_threads)
+{
+    DensityClusters result;
+    result.labels.assign(std::min(times.size(), resids.size()), DensityClusters::kNoise);
+    if (!(time_radius > 0.) || !(resid_radius > 0.) || min_points == 0)
+        return result;
+
+    const CellGrid grid = buildGrid(times, resids, time_radius, resid_radius);
+    const std::size_t ncells = grid.cellCount();
+    const std::size_t ncolumns = grid.columnCount();
+
+    // Core points. All the points of a cell are neighbours, so the ones of a cell with min_points points are core
+    // points, and the ones of a cell with less than min_points points around are not.
+    std::vector<char> core(grid.order.size(), 0);
+    std::vector<char> core_cell(ncells, 0);
+    parallelChunks(ncolumns, kColumnsPerChunk, max_threads, [&](std::size_t, std::size_t begin, std::size_t end)
+    {
+        std::vector<std::size_t> reach;
+        for (std::size_t j = begin; j < end; j++)
+        {
+            grid.columnReach(j, reach);
+            for (std::size_t c = grid.columns[j]; c < grid.columns[j + 1]; c++)
+            {
+                if (grid.cellSize(c) >= min_points)
+                {
+                    std::fill(core.begin() + grid.offsets[c], core.begin() + grid.offsets[c + 1], 1);
+                    core_cell[c] = 1;
+                    continue;
+                }
+                const std::size_t* ranges = reach.data() + 2 * kRanges * (c - grid.columns[j]);
+                std::size_t around = 0;
+                for (std::size_t k = 0; k < kRanges; k++)
+                    around += grid.offsets[ranges[2 * k + 1]] - grid.offsets[ranges[2 * k]];
+                if (around < min_points)
+                    continue;
+
+                for (std::size_t p = grid.offsets[c]; p < grid.offsets[c + 1]; p++)
+                {
+                    std::size_t count = 0;
+                    forNeighbours(ranges, [&](std::size_t d)
+                    {
+                        for (std::size_t q = grid.offsets[d]; count < min_points && q < grid.offsets[d + 1]; q++)
+                            count += grid.neighbours(p, q);
+                    });
+                    core[p] = count >= min_points;
+                    core_cell[c] |= core[p];
+                }
+            }
+        }
+    });
+
+    // Links between the cells with core points that hold a pair of core neighbours, found by the cell with the
+    // lower index. The cells with core points are few, so their neighbours are searched one by one.
+    std::vector<std::vector<std::pair<std::size_t, std::size_t>>> chunk_links(chunkCount(ncolumns, kColumnsPerChunk));
+    parallelChunks(ncolumns, kColumnsPerChunk, max_threads, [&](std::size_t chunk, std::size_t begin, std::size_t end)
+    {
+        std::size_t ranges[2 * kRanges];
+        for (std::size_t j = begin; j < end; j++)
+        {
+            for (std::size_t c = grid.columns[j]; c < grid.columns[j + 1]; c++)
+            {
+                if (!core_cell[c])
+                    continue;
+                grid.cellReach(j, c, ranges);
+                forNeighbours(ranges, [&](std::size_t d)
+                {
+                    if (d <= c || !core_cell[d])
+                        return;
+                    bool linked = false;
+                    for (std::size_t p = grid.offsets[c]; !linked && p < grid.offsets[c + 1]; p++)
+                        for (std::size_t q = grid.offsets[d]; core[p] && !linked && q < grid.offsets[d + 1]; q++)
+                            linked = core[q] && grid.neighbours(p, q);
+                    if (linked)
+                        chunk_links[chunk].emplace_back(c, d);
+                });
+            }
+        }
+    });
+
+    // Clusters of cells, numbered in cell order.
+    std::vector<std::size_t> parents(ncells);
+    for (std::size_t c = 0; c < ncells; c++)
+        parents[c] = c;
+    for (const auto& links : chunk_links)
+        for (const auto& link : links)
+            parents[findRoot(parents, link.second)] = findRoot(parents, link.first);
+    std::vector<int> cell_labels(ncells, DensityClusters::kNoise);
+    std::vector<int> root_labels(ncells, DensityClusters::kNoise);
+    for (std::size_t c = 0; c < ncells; c++)
+    {
+        if (!core_cell[c])
+            continue;
+        int& label = root_labels[findRoot(parents, c)];
+        if (label == DensityClusters::kNoise)
+            label = static_cast<int>(result.sizes.size()), result.sizes.push_back(0);
+        cell_labels[c] = label;
+    }
+
+    // Cells around the cells with core points, the only ones that can have points in a cluster.
+    std::vector<char> near_core(ncells, 0);
+    for (std::size_t j = 0; j < ncolumns; j++)
+    {
+        std::size_t ranges[2 * kRanges];
+        for (std::size_t c = grid.columns[j]; c < grid.columns[j + 1]; c++)
+        {
+            if (!core_cell[c])
+                continue;
+            grid.cellReach(j, c, ranges);
+            forNeighbours(ranges, [&](std::size_t d){near_core[d] = 1;});
+        }
+    }
+
+    // Labels of the points: the cluster of their cell for the core points, and the one of the closest core
+    // neighbour for the others.
+    parallelChunks(ncolumns, kColumnsPerChunk, max_threads, [&](std::size_t, std::size_t begin, std::size_t end)
+    {
+        std::size_t ranges[2 * kRanges];
+        for (std::size_t j = begin; j < end; j++)
+        {
+            for (std::size_t c = grid.columns[j]; c < grid.columns[j + 1]; c++)
+            {
+                if (!near_core[c])
+                    continue;
+                grid.cellReach(j, c, ranges);
+                for (std::size_t p = grid.offsets[c]; p < grid.offsets[c + 1]; p++)
+                {
+                    int label = core[p] ? cell_labels[c] : DensityClusters::kNoise;
+                    double closest = std::numeric_limits<double>::infinity();
+                    forNeighbours(ranges, [&](std::size_t d)
+                    {
+                        if (core[p] || !core_cell[d])
+                            return;
+                        for (std::size_t q = grid.offsets[d]; q < grid.offsets[d + 1]; q++)
+                        {
+                            const double dx = grid.xs[p] - grid.xs[q];
+                            const double dy = grid.ys[p] - grid.ys[q];
+                            const double dist = dx * dx + dy * dy;
+                            if (core[q] && dist <= 1. && dist < closest)
+                            {
+                                closest = dist;
+                                label = cell_labels[d];
+                            }
+                        }
+                    });
+                    result.labels[grid.order[p]] = label;
+                }
+            }
+        }
+    });
+
+    for (int label : result.labels)
+        if (label != DensityClusters::kNoise)
+            result.sizes[static_cast<std::size_t>(label)]++;
+
+    return result;
+}
+
+}
@@ -0,0 +1,312 @@
+#include "kdepeak.h"
+#include "parallelchunks.h"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+
+namespace
+{
+
+using algorithm::KdePeak;
+using Complex = std::complex<double>;
+
+// Grid points per bandwidth, and bandwidths of zero padding at every side (the FFT convolution is circular).
+constexpr double kGridPerBandwidth = 1.;
+constexpr double kPaddingBandwidths = 5.;
+// The gains of the kernel transform below exp(-kMaxExponent) are set to zero.
+constexpr double kMaxExponent = 300.;
+// Largest grid. Wider value ranges use a coarser grid.
+constexpr std::size_t kMaxGridSize = std::size_t(1) << 16;
+// Bins processed by every task of kdePeakBins.
+constexpr std::size_t kBinsPerChunk = 8;
+
+constexpr double kPi = 3.14159265358979323846;
+
+/**
+ * @brief Self-contained iterative radix-2 complex FFT, with the tables of the last size kept for reuse.
+ */
+class Fft
+{
+public:
+
+    // Size must be a power of two.
+    void transform(std::vector<Complex>& data, bool inverse)
+    {
+        const std::size_t size = data.size();
+        this->prepare(size);
+
+        // Bit reversal permutation.
+        for (std::size_t i = 0; i < size; i++)
+            if (i < this->m_reversed[i])
+                std::swap(data[i], data[this->m_reversed[i]]);
+
+        // Butterflies. The twiddles of a stage of length len are the ones of the full size with stride size / len.
+        for (std::size_t len = 2; len <= size; len <<= 1)
+        {
+            const std::size_t half = len / 2;
+            const std::size_t stride = size / len;
+            for (std::size_t start = 0; start < size; start += len)
+            {
+                for (std::size_t k = 0; k < half; k++)
+                {
+                    // The product is written out, as the operator of std::complex also handles infinities and is
+                    // not inlined without -ffast-math.
+                    const Complex& tw = this->m_twiddles[k * stride];
+                    const double wr = tw.real();
+                    const double wi = inverse ? -tw.imag() : tw.imag();
+                    const Complex x = data[start + k + half];
+                    const Complex u = data[start + k];
+                    const Complex v(x.real() * wr - x.imag() * wi, x.real() * wi + x.imag() * wr);
+                    data[start + k] = u + v;
+                    data[start + k + half] = u - v;
+                }
+            }
+        }
+    }
+
+private:
+
+    void prepare(std::size_t size)
+    {
+        if (this->m_reversed.size() == size)
+            return;
+
+        unsigned bits = 0;
+        while ((std::size_t(1) << bits) < size)
+            bits++;
+        this->m_reversed.resize(size);
+        for (std::size_t i = 0; i < size; i++)
+        {
+            std::size_t rev = 0;
+            for (unsigned b = 0; b < bits; b++)
+                rev |= ((i >> b) & 1) << (bits - 1 - b);
+            this->m_reversed[i] = rev;
+        }
+        this->m_twiddles.resize(size / 2);
+        for (std::size_t k = 0; k < size / 2; k++)
+            this->m_twiddles[k] = std::polar(1., -2. * kPi * k / size);
+    }
+
+    std::vector<std::size_t> m_reversed;
+    std::vector<Complex> m_twiddles;
+};
+
+// Grid of the values of a bin.
+struct GridSpec
+{
+    std::size_t count = 0;      ///< Finite values.
+    double origin = 0.;
+    double step = 0.;
+    std::size_t size = 0;
+};
+
+// Grid covering the finite values of [begin, end) plus the padding.
+GridSpec gridSpec(SpanView<const double> values, std::size_t begin, std::size_t end, double bandwidth)
+{
+    GridSpec spec;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+    for (std::size_t i = begin; i < end; i++)
+    {
+        if (std::isfinite(values[i]))
+        {
+            spec.count++;
+            min = std::min(min, values[i]);
+            max = std::max(max, values[i]);
+        }
+    }
+    if (spec.count == 0 || !(bandwidth > 0.))
+        return spec;
+
+    spec.origin = min - kPaddingBandwidths * bandwidth;
+    const double span = max - min + 2. * kPaddingBandwidths * bandwidth;
+    spec.step = bandwidth / kGridPerBandwidth;
+    spec.size = 2;
+    while (spec.size < kMaxGridSize && static_cast<double>(spec.size - 1) * spec.step < span)
+        spec.size <<= 1;
+    if (static_cast<double>(spec.size - 1) * spec.step < span)
+        spec.step = span / static_cast<double>(spec.size - 1);
+    return spec;
+}
+
+// Linear binning of the values into the real (part 0) or imaginary (part 1) components of the grid: every value is
+// split between its two closest grid points.
+void binValues(SpanView<const double> values, std::size_t begin, std::size_t end, const GridSpec& spec,
+               std::vector<Complex>& grid, int part)
+{
+    // The components of std::complex are laid out as an array of two values.
+    double* data = reinterpret_cast<double*>(grid.data()) + part;
+    for (std::size_t i = begin; i < end; i++)
+    {
+        if (!std::isfinite(values[i]))
+            continue;
+        const double pos = (values[i] - spec.origin) / spec.step;
+        const std::size_t idx = std::min(static_cast<std::size_t>(pos), spec.size - 2);
+        const double frac = pos - static_cast<double>(idx);
+        data[2 * idx] += 1. - frac;
+        data[2 * idx + 2] += frac;
+    }
+}
+
+// Convolution of the grid with the Gaussian kernel. The transform of a unit area Gaussian is exp(-2 pi^2 h^2 f^2),
+// real and even, so the real and imaginary components are convolved independently. The linear binning already
+// smooths the values like a kernel of variance step^2 / 6, which is discounted from the bandwidth.
+void smooth(std::vector<Complex>& grid, double step, double bandwidth, Fft& fft)
+{
+    const std::size_t size = grid.size();
+    const double variance = std::max(bandwidth * bandwidth - step * step / 6., 0.);
+    const double factor = -2. * kPi * kPi * variance / (static_cast<double>(size) * size * step * step);
+
+    fft.transform(grid, false);
+    for (std::size_t k = 0; k < size; k++)
+    {
+        // The negligible gains are set to zero, so the grid does not get denormal values.
+        const double freq = static_cast<double>(k <= size / 2 ? k : size - k);
+        const double exponent = factor * freq * freq;
+        grid[k] = exponent > -kMaxExponent ? grid[k] * (std::exp(exponent) / static_cast<double>(size)) : Complex();
+    }
+    fft.transform(grid, true);
+}
+
+// Peak of the real (part 0) or imaginary (part 1) component of the smoothed grid.
+KdePeak findPeak(const std::vector<Complex>& grid, const GridSpec& spec, int part)
+{
+    KdePeak peak;
+    peak.count = spec.count;
+    const double* data = reinterpret_cast<const double*>(grid.data()) + part;
+    const std::size_t size = spec.size;
+    auto at = [data](std::size_t k){return data[2 * k];};
+
+    // Highest grid point. Near the top the density is close to a Gaussian, so it is refined with a parabola
+    // through the logarithms of the three highest points, which is exact for a Gaussian peak.
+    std::size_t top = 0;
+    for (std::size_t k = 1; k < size; k++)
+        if (at(k) > at(top))
+            top = k;
+    const double b = at(top);
+    double offset = 0.;
+    double height = b;
+    if (top > 0 && top + 1 < size && at(top - 1) > 0. && at(top + 1) > 0.)
+    {
+        const double la = std::log(at(top - 1));
+        const double lb = std::log(b);
+        const double lc = std::log(at(top + 1));
+        const double curvature = la - 2. * lb + lc;
+        if (curvature < 0.)
+        {
+            offset = 0.5 * (la - lc) / curvature;
+            height = std::exp(lb - 0.25 * (la - lc) * offset);
+        }
+    }
+
+    // Half maximum crossings, interpolated linearly between the grid points.
+    const double half = height / 2.;
+    std::size_t left = top;
+    while (left > 0 && at(left) > half)
+        left--;
+    std::size_t right = top;
+    while (right + 1 < size && at(right) > half)
+        right++;
+    auto crossing = [&at, half](std::size_t inside, std::size_t outside)
+    {
+        const double yi = at(inside);
+        const double yo = at(outside);
+        const double frac = yi > yo ? (yi - half) / (yi - yo) : 0.;
+        return static_cast<double>(inside) + frac * (static_cast<double>(outside) - static_cast<double>(inside));
+    };
+    const double left_pos = left < top ? crossing(left + 1, left) : static_cast<double>(left);
+    const double right_pos = right > top ? crossing(right - 1, right) : static_cast<double>(right);
+
+    // The grid holds the sum of the kernels times the step.
+    peak.location = spec.origin + (static_cast<double>(top) + offset) * spec.step;
+    peak.width = (right_pos - left_pos) * spec.step;
+    peak.density = height / (static_cast<double>(spec.count) * spec.step);
+    return peak;
+}
+
+// Peaks of the bins a and b (b can be empty), using the grid and the FFT of the calling task. Two bins with the same
+// grid step share a single transform, one in the real component and the other in the imaginary one.
+void computePeaks(SpanView<const double> values, std::size_t a_begin, std::size_t a_end, std::size_t b_begin,
+                  std::size_t b_end, double bandwidth, KdePeak& a_peak, KdePeak* b_peak,
+                  std::vector<Complex>& grid, Fft& fft)
+{
+    GridSpec a_spec = gridSpec(values, a_begin, a_end, bandwidth);
+    GridSpec b_spec = b_peak ? gridSpec(values, b_begin, b_end, bandwidth) : GridSpec();
+    a_peak = KdePeak();
+    a_peak.count = a_spec.count;
+    if (b_peak)
+    {
+        *b_peak = KdePeak();
+        b_peak->count = b_spec.count;
+    }
+
+    const bool a_valid = a_spec.size > 0;
+    const bool b_valid = b_spec.size > 0;
+    if (a_valid && b_valid && a_spec.step == b_spec.step)
+    {
+        const std::size_t size = std::max(a_spec.size, b_spec.size);
+        a_spec.size = b_spec.size = size;
+        grid.assign(size, Complex());
+        binValues(values, a_begin, a_end, a_spec, grid, 0);
+        binValues(values, b_begin, b_end, b_spec, grid, 1);
+        smooth(grid, a_spec.step, bandwidth, fft);
+        a_peak = findPeak(grid, a_spec, 0);
+        *b_peak = findPeak(grid, b_spec, 1);
+        return;
+    }
+
+    if (a_valid)
+    {
+        grid.assign(a_spec.size, Complex());
+        binValues(values, a_begin, a_end, a_spec, grid, 0);
+        smooth(grid, a_spec.step, bandwidth, fft);
+        a_peak = findPeak(grid, a_spec, 0);
+    }
+    if (b_valid)
+    {
+        grid.assign(b_spec.size, Complex());
+        binValues(values, b_begin, b_end, b_spec, grid, 0);
+        smooth(grid, b_spec.step, bandwidth, fft);
+        *b_peak = findPeak(grid, b_spec, 0);
+    }
+}
+
+}
+
+namespace algorithm{
+
+KdePeak kdePeak(SpanView<const double> values, double bandwidth)
+{
+    std::vector<Complex> grid;
+    Fft fft;
+    KdePeak peak;
+    computePeaks(values, 0, values.size(), 0, 0, bandwidth, peak, nullptr, grid, fft);
+    return peak;
+}
+
+std::vector<KdePeak> kdePeakBins(SpanView<const double> values, const std::vector<std::size_t> &offsets,
+                                 double bandwidth, int max_threads)
+{
+    // Every task processes its bins in pairs (see computePeaks).
+    const std::size_t nbins = offsets.empty() ? 0 : offsets.size() - 1;
+    std::vector<KdePeak> result(nbins);
+    parallelChunks(nbins, kBinsPerChunk, max_threads, [&](std::size_t, std::size_t begin, std::size_t end)
+    {
+        std::vector<Complex> grid;
+        Fft fft;
+        auto first = [&](std::size_t bin){return std::min(offsets[bin], values.size());};
+        auto last = [&](std::size_t bin){return std::min(offsets[bin + 1], values.size());};
+        for (std::size_t bin = begin; bin < end; bin += 2)
+        {
+            if (bin + 1 < end)
+                computePeaks(values, first(bin), last(bin), first(bin + 1), last(bin + 1), bandwidth, result[bin],
+                             &result[bin + 1], grid, fft);
+            else
+                computePeaks(values, first(bin), last(bin), 0, 0, bandwidth, result[bin], nullptr, grid, fft);
+        }
+    });
+    return result;
+}
+
+}
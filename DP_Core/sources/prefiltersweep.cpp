@@ -0,0 +1,343 @@
+#include "prefiltersweep.h"
+#include "algorithms.h"
+#include "parallelchunks.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+
+// Time bins processed by every task.
+constexpr std::size_t kBinsPerChunk = 4;
+
+// Count, mean and sum of squared deviations of a set of values, mergeable (Chan et al.).
+struct Moments
+{
+    double count = 0.;
+    double mean = 0.;
+    double m2 = 0.;
+
+    void merge(const Moments& other)
+    {
+        if (other.count == 0.)
+            return;
+        const double total = this->count + other.count;
+        const double delta = other.mean - this->mean;
+        this->mean += delta * other.count / total;
+        this->m2 += other.m2 + delta * delta * this->count * other.count / total;
+        this->count = total;
+    }
+};
+
+// Histogram bin of a value, as histCountsPrivate<ClosedOpenBin> computes it (-1 if it is in none).
+long long histogramBin(double value, double min_edge, double div, std::size_t nbins)
+{
+    const double pos = (value - min_edge) / div;
+    long long bin = static_cast<long long>(std::floor(std::min(std::max(pos, -1.), static_cast<double>(nbins))));
+    double lower = min_edge + bin * div;
+    if (value < lower)
+        lower = min_edge + --bin * div;
+    else if (!(value >= lower && value < lower + div))
+        lower = min_edge + ++bin * div;
+    const long long last_bin = static_cast<long long>(nbins) - 1;
+    if (bin == last_bin + 1 && value >= min_edge + last_bin * div && value < min_edge + last_bin * div + div)
+        lower = min_edge + --bin * div;
+    if (bin < 0 || bin >= static_cast<long long>(nbins) || !(value >= lower && value < lower + div))
+        return -1;
+    return bin;
+}
+
+template <typename T>
+void sortUnique(std::vector<T>& values)
+{
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+}
+
+}
+
+void PrefilterSweep::addPass(const std::vector<double> &times, const std::vector<double> &resids)
+{
+    this->m_times.push_back(times);
+    this->m_resids.push_back(resids);
+}
+
+void PrefilterSweep::clearPasses()
+{
+    this->m_times.clear();
+    this->m_resids.clear();
+}
+
+std::vector<PrefilterSweep::Result> PrefilterSweep::run(const Grid &grid, int max_threads) const
+{
+    Grid axes = grid;
+    sortUnique(axes.bin_sizes);
+    sortUnique(axes.depths);
+    sortUnique(axes.min_phs);
+    sortUnique(axes.divisions);
+    const std::size_t nsizes = axes.bin_sizes.size();
+    const std::size_t ndepths = axes.depths.size();
+    const std::size_t nmins = axes.min_phs.size();
+    const std::size_t ndivs = axes.divisions.size();
+
+    // Configurations of a bin size, indexed as (depth, min_ph, divisions).
+    const std::size_t nlocal = ndepths * nmins * ndivs;
+    auto localIndex = [nmins, ndivs](std::size_t d, std::size_t p, std::size_t v){return (d * nmins + p) * ndivs + v;};
+
+    std::vector<Result> results(nsizes * nlocal);
+    for (std::size_t s = 0; s < nsizes; s++)
+        for (std::size_t d = 0; d < ndepths; d++)
+            for (std::size_t p = 0; p < nmins; p++)
+                for (std::size_t v = 0; v < ndivs; v++)
+                    results[s * nlocal + localIndex(d, p, v)].params =
+                        {axes.bin_sizes[s], axes.depths[d], axes.min_phs[p], axes.divisions[v]};
+
+    // Histogram widths (depth / divisions) and minimum counts (min_ph / divisions), as the prefilter uses them. The
+    // configurations with the same width share the histogram, and the ones with the same width and minimum count
+    // share the kept range.
+    constexpr std::size_t kInvalid = std::numeric_limits<std::size_t>::max();
+    std::vector<double> widths;
+    for (double depth : axes.depths)
+        for (unsigned div : axes.divisions)
+            if (depth > 0 && div > 0)
+                widths.push_back(depth / div);
+    sortUnique(widths);
+    std::vector<std::vector<unsigned>> width_mins(widths.size());
+    std::vector<std::size_t> config_width(nlocal, kInvalid);
+    std::vector<unsigned> config_min(nlocal, 0);
+    for (std::size_t d = 0; d < ndepths; d++)
+    {
+        for (std::size_t p = 0; p < nmins; p++)
+        {
+            for (std::size_t v = 0; v < ndivs; v++)
+            {
+                const double depth = axes.depths[d];
+                const unsigned div = axes.divisions[v];
+                if (!(depth > 0) || div == 0)
+                    continue;
+                const std::size_t l = localIndex(d, p, v);
+                config_width[l] = static_cast<std::size_t>(
+                            std::lower_bound(widths.begin(), widths.end(), depth / div) - widths.begin());
+                config_min[l] = axes.min_phs[p] / div;
+                width_mins[config_width[l]].push_back(config_min[l]);
+            }
+        }
+    }
+    for (auto& mins : width_mins)
+        sortUnique(mins);
+
+    for (std::size_t s = 0; s < nsizes; s++)
+    {
+        const double bs = axes.bin_sizes[s];
+        Result* size_results = results.data() + s * nlocal;
+
+        // Time bins of all the passes.
+        std::vector<TimeBin> bins;
+        if (bs > 0)
+        {
+            for (std::size_t pass = 0; pass < this->m_times.size(); pass++)
+            {
+                const auto offsets = algorithm::extractBinOffsets(this->m_times[pass], this->m_resids[pass], bs);
+                for (std::size_t b = 0; b + 1 < offsets.size(); b++)
+                    bins.push_back({pass, offsets[b], offsets[b + 1] - offsets[b]});
+            }
+        }
+        const std::size_t nbins = bins.size();
+
+        // Selection of a time bin: its kept range, and the count and sums of the kept residuals.
+        struct Selection
+        {
+            KeptRange range;
+            double count = 0.;
+            double sum = 0.;
+            double sum_sq = 0.;
+        };
+
+        // Kept range of every configuration and time bin, and moments of every configuration and chunk of bins.
+        std::vector<KeptRange> kept(nlocal * nbins);
+        std::vector<Moments> chunk_moments(chunkCount(nbins, kBinsPerChunk) * nlocal);
+
+        parallelChunks(nbins, kBinsPerChunk, max_threads, [&](std::size_t chunk, std::size_t begin, std::size_t end)
+        {
+            std::vector<double> sorted;
+            std::vector<double> sums;
+            std::vector<double> sums_sq;
+            std::vector<std::size_t> starts;
+            std::vector<std::size_t> ends;
+            std::vector<std::size_t> counts;
+            std::vector<std::size_t> gaps;
+            std::vector<std::vector<Selection>> width_selections(widths.size());
+            Moments* moments = chunk_moments.data() + chunk * nlocal;
+
+            for (std::size_t bin = begin; bin < end; bin++)
+            {
+                // Sorted residuals of the time bin, with prefix sums of their deviations from the median.
+                const TimeBin& tbin = bins[bin];
+                const double* resids = this->m_resids[tbin.pass].data() + tbin.first;
+                const std::size_t n = tbin.count;
+                sorted.assign(resids, resids + n);
+                std::sort(sorted.begin(), sorted.end());
+                const double shift = sorted[n / 2];
+                sums.assign(n + 1, 0.);
+                sums_sq.assign(n + 1, 0.);
+                for (std::size_t k = 0; k < n; k++)
+                {
+                    const double dev = sorted[k] - shift;
+                    sums[k + 1] = sums[k] + dev;
+                    sums_sq[k + 1] = sums_sq[k] + dev * dev;
+                }
+
+                // Histogram of every width, with the same size and edges as histPrefilterBinSLR. The histogram bin k
+                // is [starts[k], ends[k]) of the sorted residuals. As the edges are rounded, two neighbour bins can
+                // overlap or leave a gap by a few ulps: the overlapped residuals are counted in the bin where
+                // histCountsPrivate places them, and the ones in a gap are left out of the selection.
+                const double min_edge = sorted.front();
+                const long double rg_width = std::abs(sorted.front()) + std::abs(sorted.back());
+                for (std::size_t w = 0; w < widths.size(); w++)
+                {
+                    std::vector<Selection>& selections = width_selections[w];
+                    selections.assign(width_mins[w].size(), Selection());
+                    const std::size_t hist_size = static_cast<std::size_t>(std::floor(rg_width / widths[w]));
+                    if (hist_size == 0)
+                        continue;
+
+                    const double div = (sorted.back() - min_edge) / hist_size;
+                    starts.resize(hist_size);
+                    ends.resize(hist_size);
+                    counts.resize(hist_size);
+                    gaps.clear();
+                    std::size_t lower = 0;
+                    std::size_t upper = 0;
+                    for (std::size_t k = 0; k < hist_size; k++)
+                    {
+                        const double bin_min = min_edge + k * div;
+                        while (lower < n && sorted[lower] < bin_min)
+                            lower++;
+                        upper = std::max(upper, lower);
+                        while (upper < n && sorted[upper] < bin_min + div)
+                            upper++;
+                        starts[k] = lower;
+                        ends[k] = upper;
+                        counts[k] = upper - lower;
+                        if (k > 0 && ends[k - 1] < lower)
+                            gaps.push_back(k - 1);
+                        for (std::size_t i = lower; k > 0 && i < ends[k - 1]; i++)
+                        {
+                            if (histogramBin(sorted[i], min_edge, div, hist_size) == static_cast<long long>(k))
+                                counts[k - 1]--;
+                            else
+                                counts[k]--;
+                        }
+                    }
+                    const std::size_t top = static_cast<std::size_t>(
+                                std::max_element(counts.begin(), counts.end()) - counts.begin());
+
+                    // Run of histogram bins around the maximum for every minimum count.
+                    for (std::size_t m = 0; m < width_mins[w].size(); m++)
+                    {
+                        const unsigned min_ph = width_mins[w][m];
+                        if (counts[top] < min_ph)
+                            continue;
+                        std::size_t sel_first = top;
+                        std::size_t sel_last = top;
+                        while (sel_first > 0 && counts[sel_first - 1] >= min_ph)
+                            sel_first--;
+                        while (sel_last + 1 < hist_size && counts[sel_last + 1] >= min_ph)
+                            sel_last++;
+
+                        Selection& selection = selections[m];
+                        const std::size_t first = starts[sel_first];
+                        const std::size_t last = std::max(first, ends[sel_last]);
+                        selection.range = {static_cast<std::uint32_t>(first), static_cast<std::uint32_t>(last)};
+                        selection.count = static_cast<double>(last - first);
+                        selection.sum = sums[last] - sums[first];
+                        selection.sum_sq = sums_sq[last] - sums_sq[first];
+                        for (auto it = std::lower_bound(gaps.begin(), gaps.end(), sel_first);
+                             it != gaps.end() && *it < sel_last; ++it)
+                        {
+                            const std::size_t gap_first = ends[*it];
+                            const std::size_t gap_last = starts[*it + 1];
+                            selection.count -= static_cast<double>(gap_last - gap_first);
+                            selection.sum -= sums[gap_last] - sums[gap_first];
+                            selection.sum_sq -= sums_sq[gap_last] - sums_sq[gap_first];
+                        }
+                    }
+                }
+
+                // Kept range and moments of every configuration.
+                for (std::size_t l = 0; l < nlocal; l++)
+                {
+                    const std::size_t w = config_width[l];
+                    if (w == kInvalid)
+                        continue;
+                    const auto& mins = width_mins[w];
+                    const std::size_t m = static_cast<std::size_t>(
+                                std::lower_bound(mins.begin(), mins.end(), config_min[l]) - mins.begin());
+                    const Selection& selection = width_selections[w][m];
+                    kept[l * nbins + bin] = selection.range;
+                    if (selection.count == 0.)
+                        continue;
+
+                    Moments bin_moments;
+                    bin_moments.count = selection.count;
+                    bin_moments.mean = shift + selection.sum / selection.count;
+                    bin_moments.m2 = std::max(selection.sum_sq - selection.sum * selection.sum / selection.count, 0.);
+                    moments[l].merge(bin_moments);
+                }
+            }
+        });
+
+        // Totals of every configuration, merging the chunks in order.
+        for (std::size_t l = 0; l < nlocal; l++)
+        {
+            Moments total;
+            for (std::size_t chunk = 0; chunk * nlocal < chunk_moments.size(); chunk++)
+                total.merge(chunk_moments[chunk * nlocal + l]);
+            Result& result = size_results[l];
+            result.kept = static_cast<std::size_t>(total.count);
+            result.mean = total.count > 0 ? total.mean : 0.;
+            result.rms = total.count > 0 ? std::sqrt(total.m2 / total.count) : 0.;
+        }
+
+        // Stability: mean Jaccard index with the neighbours in depth and min_ph.
+        auto jaccard = [&kept, nbins](std::size_t a, std::size_t b)
+        {
+            double common = 0.;
+            double all = 0.;
+            for (std::size_t bin = 0; bin < nbins; bin++)
+            {
+                const KeptRange& ra = kept[a * nbins + bin];
+                const KeptRange& rb = kept[b * nbins + bin];
+                const double inter = std::max<double>(0., static_cast<double>(std::min(ra.last, rb.last)) -
+                                                          static_cast<double>(std::max(ra.first, rb.first)));
+                common += inter;
+                all += static_cast<double>(ra.last - ra.first) + static_cast<double>(rb.last - rb.first) - inter;
+            }
+            return all > 0. ? common / all : 1.;
+        };
+        parallelChunks(nlocal, 1, max_threads, [&](std::size_t, std::size_t begin, std::size_t end)
+        {
+            for (std::size_t l = begin; l < end; l++)
+            {
+                const std::size_t d = l / (nmins * ndivs);
+                const std::size_t p = (l / ndivs) % nmins;
+                const std::size_t v = l % ndivs;
+                double sum = 0.;
+                unsigned neighbours = 0;
+                if (d > 0)
+                    sum += jaccard(l, localIndex(d - 1, p, v)), neighbours++;
+                if (d + 1 < ndepths)
+                    sum += jaccard(l, localIndex(d + 1, p, v)), neighbours++;
+                if (p > 0)
+                    sum += jaccard(l, localIndex(d, p - 1, v)), neighbours++;
+                if (p + 1 < nmins)
+                    sum += jaccard(l, localIndex(d, p + 1, v)), neighbours++;
+                size_results[l].stability = neighbours ? sum / neighbours : std::numeric_limits<double>::quiet_NaN();
+            }
+        });
+    }
+
+    return results;
+}
@@ -0,0 +1,348 @@
+#include "robuststats.h"
+#include "parallelchunks.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+using algorithm::RobustStats;
+
+// Bins processed by every task of robustStatsBins.
+constexpr std::size_t kBinsPerChunk = 16;
+
+constexpr double kNaN = std::numeric_limits<double>::quiet_NaN();
+
+// Copies the finite values (selected in the mask, if any) of [begin, end) into the scratch buffer.
+void gather(SpanView<const double> values, const SelectionMask* mask, std::size_t begin, std::size_t end,
+            std::vector<double>& scratch)
+{
+    scratch.clear();
+    if (mask)
+    {
+        for (std::size_t i = begin; i < end; i++)
+            if (mask->test(i) && std::isfinite(values[i]))
+                scratch.push_back(values[i]);
+    }
+    else
+    {
+        for (std::size_t i = begin; i < end; i++)
+            if (std::isfinite(values[i]))
+                scratch.push_back(values[i]);
+    }
+}
+
+// Median of the values, reordering them. After the call, the values before the middle are not greater than it.
+double selectMedian(double* first, std::size_t count)
+{
+    if (count == 0)
+        return kNaN;
+    double* middle = first + count / 2;
+    std::nth_element(first, middle, first + count);
+    if (count % 2)
+        return *middle;
+    return (*std::max_element(first, middle) + *middle) / 2.;
+}
+
+double selectQuantile(double* first, std::size_t count, double q)
+{
+    if (count == 0 || !(q >= 0. && q <= 1.))
+        return kNaN;
+    const double pos = q * (count - 1);
+    const std::size_t lower = static_cast<std::size_t>(pos);
+    std::nth_element(first, first + lower, first + count);
+    const double low = first[lower];
+    if (lower + 1 >= count || pos == lower)
+        return low;
+    const double high = *std::min_element(first + lower + 1, first + count);
+    return low + (pos - lower) * (high - low);
+}
+
+std::size_t trimCount(std::size_t count, double fraction)
+{
+    if (!(fraction > 0.))
+        return 0;
+    const std::size_t trim = static_cast<std::size_t>(std::floor(fraction * count));
+    return std::min(trim, count ? (count - 1) / 2 : 0);
+}
+
+// All the statistics of the values, reordering them.
+RobustStats computeStats(double* first, std::size_t count, double fraction, bool trimmed, bool mad)
+{
+    RobustStats stats;
+    stats.count = count;
+    if (count == 0)
+        return stats;
+
+    // The median leaves the lower half before the middle, so the trimming limits are selected inside every half.
+    stats.median = selectMedian(first, count);
+    const std::size_t half = count / 2;
+
+    if (trimmed)
+    {
+        const std::size_t trim = trimCount(count, fraction);
+        double low = 0.;
+        double high = 0.;
+        if (trim > 0)
+        {
+            std::nth_element(first, first + trim, first + half);
+            std::nth_element(first + half, first + count - trim - 1, first + count);
+            low = first[trim];
+            high = first[count - trim - 1];
+        }
+        double sum = 0.;
+        for (std::size_t k = trim; k < count - trim; k++)
+            sum += first[k];
+        stats.trimmed_mean = sum / (count - 2 * trim);
+        stats.winsorized_mean = (sum + trim * (low + high)) / count;
+    }
+
+    if (mad)
+    {
+        const double median = stats.median;
+        for (std::size_t k = 0; k < count; k++)
+            first[k] = std::abs(first[k] - median);
+        stats.mad = selectMedian(first, count);
+    }
+
+    return stats;
+}
+
+std::vector<RobustStats> statsBins(SpanView<const double> values, const SelectionMask* mask,
+                                   const std::vector<std::size_t> &offsets, double fraction, int max_threads)
+{
+    const std::size_t nbins = offsets.empty() ? 0 : offsets.size() - 1;
+    std::vector<RobustStats> result(nbins);
+    parallelChunks(nbins, kBinsPerChunk, max_threads, [&](std::size_t, std::size_t begin, std::size_t end)
+    {
+        std::vector<double> scratch;
+        for (std::size_t bin = begin; bin < end; bin++)
+        {
+            gather(values, mask, offsets[bin], std::min(offsets[bin + 1], values.size()), scratch);
+            result[bin] = computeStats(scratch.data(), scratch.size(), fraction, true, true);
+        }
+    });
+    return result;
+}
+
+}
+
+namespace algorithm{
+
+double median(SpanView<const double> values)
+{
+    std::vector<double> scratch;
+    gather(values, nullptr, 0, values.size(), scratch);
+    return selectMedian(scratch.data(), scratch.size());
+}
+
+double median(SpanView<const double> values, const SelectionMask &mask)
+{
+    std::vector<double> scratch;
+    gather(values, &mask, 0, std::min(values.size(), mask.size()), scratch);
+    return selectMedian(scratch.data(), scratch.size());
+}
+
+double quantile(SpanView<const double> values, double q)
+{
+    std::vector<double> scratch;
+    gather(values, nullptr, 0, values.size(), scratch);
+    return selectQuantile(scratch.data(), scratch.size(), q);
+}
+
+double quantile(SpanView<const double> values, const SelectionMask &mask, double q)
+{
+    std::vector<double> scratch;
+    gather(values, &mask, 0, std::min(values.size(), mask.size()), scratch);
+    return selectQuantile(scratch.data(), scratch.size(), q);
+}
+
+double medianAbsoluteDeviation(SpanView<const double> values)
+{
+    std::vector<double> scratch;
+    gather(values, nullptr, 0, values.size(), scratch);
+    return computeStats(scratch.data(), scratch.size(), 0., false, true).mad;
+}
+
+double medianAbsoluteDeviation(SpanView<const double> values, const SelectionMask &mask)
+{
+    std::vector<double> scratch;
+    gather(values, &mask, 0, std::min(values.size(), mask.size()), scratch);
+    return computeStats(scratch.data(), scratch.size(), 0., false, true).mad;
+}
+
+double trimmedMean(SpanView<const double> values, double fraction)
+{
+    return robustStats(values, fraction).trimmed_mean;
+}
+
+double trimmedMean(SpanView<const double> values, const SelectionMask &mask, double fraction)
+{
+    return robustStats(values, mask, fraction).trimmed_mean;
+}
+
+double winsorizedMean(SpanView<const double> values, double fraction)
+{
+    return robustStats(values, fraction).winsorized_mean;
+}
+
+double winsorizedMean(SpanView<const double> values, const SelectionMask &mask, double fraction)
+{
+    return robustStats(values, mask, fraction).winsorized_mean;
+}
+
+RobustStats robustStats(SpanView<const double> values, double fraction)
+{
+    std::vector<double> scratch;
+    gather(values, nullptr, 0, values.size(), scratch);
+    return computeStats(scratch.data(), scratch.size(), fraction, true, true);
+}
+
+RobustStats robustStats(SpanView<const double> values, const SelectionMask &mask, double fraction)
+{
+    std::vector<double> scratch;
+    gather(values, &mask, 0, std::min(values.size(), mask.size()), scratch);
+    return computeStats(scratch.data(), scratch.size(), fraction, true, true);
+}
+
+std::vector<RobustStats> robustStatsBins(SpanView<const double> values, const std::vector<std::size_t> &offsets,
+                                         double fraction, int max_threads)
+{
+    return statsBins(values, nullptr, offsets, fraction, max_threads);
+}
+
+std::vector<RobustStats> robustStatsBins(SpanView<const double> values, const SelectionMask &mask,
+                                         const std::vector<std::size_t> &offsets, double fraction, int max_threads)
+{
+    return statsBins(values.first(std::min(values.size(), mask.size())), &mask, offsets, fraction, max_threads);
+}
+
+QuantileSketch::QuantileSketch(double q) :
+    m_q(std::min(std::max(q, 0.), 1.))
+{
+    this->reset();
+}
+
+void QuantileSketch::reset()
+{
+    const double q = this->m_q;
+    this->m_count = 0;
+    for (int i = 0; i < 5; i++)
+    {
+        this->m_heights[i] = 0.;
+        this->m_positions[i] = i + 1.;
+    }
+    this->m_desired[0] = 1.;
+    this->m_desired[1] = 1. + 2. * q;
+    this->m_desired[2] = 1. + 4. * q;
+    this->m_desired[3] = 3. + 2. * q;
+    this->m_desired[4] = 5.;
+    this->m_increments[0] = 0.;
+    this->m_increments[1] = q / 2.;
+    this->m_increments[2] = q;
+    this->m_increments[3] = (1. + q) / 2.;
+    this->m_increments[4] = 1.;
+}
+
+void QuantileSketch::add(double value)
+{
+    if (!std::isfinite(value))
+        return;
+
+    double* h = this->m_heights;
+    double* n = this->m_positions;
+
+    // The first five values are the initial heights.
+    if (this->m_count < 5)
+    {
+        h[this->m_count++] = value;
+        if (this->m_count == 5)
+            std::sort(h, h + 5);
+        return;
+    }
+    this->m_count++;
+
+    // Cell of the value, extending the extreme markers if needed.
+    int cell;
+    if (value < h[0])
+    {
+        h[0] = value;
+        cell = 0;
+    }
+    else if (value >= h[4])
+    {
+        h[4] = std::max(h[4], value);
+        cell = 3;
+    }
+    else
+    {
+        cell = 0;
+        while (value >= h[cell + 1])
+            cell++;
+    }
+
+    for (int i = cell + 1; i < 5; i++)
+        n[i] += 1.;
+    for (int i = 0; i < 5; i++)
+        this->m_desired[i] += this->m_increments[i];
+
+    // Moves the central markers one position towards their desired positions, if they are off by one or more.
+    for (int i = 1; i < 4; i++)
+    {
+        const double d = this->m_desired[i] - n[i];
+        if ((d >= 1. && n[i + 1] - n[i] > 1.) || (d <= -1. && n[i - 1] - n[i] < -1.))
+        {
+            const double step = d > 0 ? 1. : -1.;
+            const double height = this->parabolic(i, step);
+            h[i] = h[i - 1] < height && height < h[i + 1] ? height : this->linear(i, step);
+            n[i] += step;
+        }
+    }
+}
+
+void QuantileSketch::add(SpanView<const double> values)
+{
+    for (double value : values)
+        this->add(value);
+}
+
+void QuantileSketch::add(SpanView<const double> values, const SelectionMask &mask)
+{
+    const std::size_t size = std::min(values.size(), mask.size());
+    for (std::size_t i = 0; i < size; i++)
+        if (mask.test(i))
+            this->add(values[i]);
+}
+
+double QuantileSketch::value() const
+{
+    if (this->m_count == 0)
+        return kNaN;
+    if (this->m_count <= 5)
+    {
+        // Exact quantile of the stored values.
+        double values[5];
+        std::copy(this->m_heights, this->m_heights + this->m_count, values);
+        return selectQuantile(values, this->m_count, this->m_q);
+    }
+    return this->m_heights[2];
+}
+
+double QuantileSketch::parabolic(int i, double d) const
+{
+    const double* h = this->m_heights;
+    const double* n = this->m_positions;
+    return h[i] + d / (n[i + 1] - n[i - 1]) *
+            ((n[i] - n[i - 1] + d) * (h[i + 1] - h[i]) / (n[i + 1] - n[i]) +
+             (n[i + 1] - n[i] - d) * (h[i] - h[i - 1]) / (n[i] - n[i - 1]));
+}
+
+double QuantileSketch::linear(int i, double d) const
+{
+    const int j = i + static_cast<int>(d);
+    return this->m_heights[i] + d * (this->m_heights[j] - this->m_heights[i]) /
+            (this->m_positions[j] - this->m_positions[i]);
+}
+
+}
@@ -0,0 +1,234 @@
+#include "selectionmask.h"
+
+#include <QtGlobal>
+
+#include <algorithm>
+
+namespace
+{
+
+using Word = SelectionMask::Word;
+
+inline unsigned popcount(Word word)
+{
+#if defined(__GNUC__)
+    return static_cast<unsigned>(__builtin_popcountll(word));
+#else
+    word = word - ((word >> 1) & 0x5555555555555555ULL);
+    word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+    word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return static_cast<unsigned>((word * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+// Index of the lowest set bit. The word must not be zero.
+inline unsigned lowestBit(Word word)
+{
+#if defined(__GNUC__)
+    return static_cast<unsigned>(__builtin_ctzll(word));
+#else
+    unsigned idx = 0;
+    while (!(word & Word(1)))
+    {
+        word >>= 1;
+        idx++;
+    }
+    return idx;
+#endif
+}
+
+}
+
+SelectionMask::SelectionMask(std::size_t size, bool value) :
+    m_words(SelectionMask::wordCount(size), value ? ~Word(0) : Word(0)),
+    m_size(size)
+{
+    this->clearTail();
+}
+
+SelectionMask SelectionMask::fromIndexes(const std::vector<std::size_t> &indexes, std::size_t size)
+{
+    SelectionMask mask(size);
+    for (std::size_t idx : indexes)
+        if (idx < size)
+            mask.set(idx);
+    return mask;
+}
+
+std::vector<std::size_t> SelectionMask::toIndexes() const
+{
+    std::vector<std::size_t> indexes;
+    indexes.reserve(this->count());
+    for (std::size_t w = 0; w < this->m_words.size(); w++)
+    {
+        Word word = this->m_words[w];
+        while (word)
+        {
+            indexes.push_back(w * kWordBits + lowestBit(word));
+            word &= word - 1;
+        }
+    }
+    return indexes;
+}
+
+SelectionMask SelectionMask::fromFlags(SpanView<const std::uint8_t> flags, FilterFlag flag)
+{
+    const std::uint8_t value = static_cast<std::uint8_t>(flag);
+    SelectionMask mask(flags.size());
+    for (std::size_t w = 0; w < mask.m_words.size(); w++)
+    {
+        const std::size_t begin = w * kWordBits;
+        const std::size_t count = std::min(kWordBits, flags.size() - begin);
+        Word word = 0;
+        for (std::size_t j = 0; j < count; j++)
+            word |= Word(flags[begin + j] == value) << j;
+        mask.m_words[w] = word;
+    }
+    return mask;
+}
+
+SelectionMask SelectionMask::fromFlags(const std::vector<Tracking::RangeData> &ranges, FilterFlag flag)
+{
+    SelectionMask mask(ranges.size());
+    for (std::size_t i = 0; i < ranges.size(); i++)
+        if (ranges[i].flag == flag)
+            mask.set(i);
+    return mask;
+}
+
+void SelectionMask::applyFlags(SpanView<std::uint8_t> flags, FilterFlag selected, FilterFlag unselected) const
+{
+    Q_ASSERT(flags.size() == this->m_size);
+    const std::uint8_t values[2] = {static_cast<std::uint8_t>(unselected), static_cast<std::uint8_t>(selected)};
+    // Only the words covering both the mask and the flags, so a shorter span is never written past its end.
+    const std::size_t size = std::min(flags.size(), this->m_size);
+    for (std::size_t w = 0; w < wordCount(size); w++)
+    {
+        const std::size_t begin = w * kWordBits;
+        const std::size_t count = std::min(kWordBits, size - begin);
+        const Word word = this->m_words[w];
+        for (std::size_t j = 0; j < count; j++)
+            flags[begin + j] = values[(word >> j) & Word(1)];
+    }
+}
+
+void SelectionMask::applyFlags(std::vector<Tracking::RangeData> &ranges, FilterFlag selected,
+                               FilterFlag unselected) const
+{
+    Q_ASSERT(ranges.size() == this->m_size);
+    const std::size_t size = std::min(ranges.size(), this->m_size);
+    for (std::size_t i = 0; i < size; i++)
+        ranges[i].flag = this->test(i) ? selected : unselected;
+}
+
+void SelectionMask::fill(bool value)
+{
+    std::fill(this->m_words.begin(), this->m_words.end(), value ? ~Word(0) : Word(0));
+    this->clearTail();
+}
+
+void SelectionMask::resize(std::size_t size, bool value)
+{
+    const std::size_t old_size = this->m_size;
+    this->m_words.resize(SelectionMask::wordCount(size), value ? ~Word(0) : Word(0));
+    this->m_size = size;
+
+    // The tail bits of the old last word are zero, so they are only set when growing with true.
+    if (value && size > old_size && old_size % kWordBits)
+        this->m_words[old_size / kWordBits] |= ~Word(0) << (old_size % kWordBits);
+    this->clearTail();
+}
+
+std::size_t SelectionMask::count() const
+{
+    std::size_t total = 0;
+    for (Word word : this->m_words)
+        total += popcount(word);
+    return total;
+}
+
+bool SelectionMask::any() const
+{
+    return std::any_of(this->m_words.begin(), this->m_words.end(), [](Word word){return word != 0;});
+}
+
+std::size_t SelectionMask::rank(std::size_t idx) const
+{
+    idx = std::min(idx, this->m_size);
+    const std::size_t full_words = idx / kWordBits;
+    std::size_t total = 0;
+    for (std::size_t w = 0; w < full_words; w++)
+        total += popcount(this->m_words[w]);
+    if (idx % kWordBits)
+        total += popcount(this->m_words[full_words] & ((Word(1) << (idx % kWordBits)) - 1));
+    return total;
+}
+
+std::size_t SelectionMask::select(std::size_t k) const
+{
+    for (std::size_t w = 0; w < this->m_words.size(); w++)
+    {
+        Word word = this->m_words[w];
+        const unsigned bits = popcount(word);
+        if (k >= bits)
+        {
+            k -= bits;
+            continue;
+        }
+        for (; k > 0; k--)
+            word &= word - 1;
+        return w * kWordBits + lowestBit(word);
+    }
+    return this->m_size;
+}
+
+SelectionMask &SelectionMask::operator&=(const SelectionMask &other)
+{
+    const std::size_t nwords = std::min(this->m_words.size(), other.m_words.size());
+    Word* a = this->m_words.data();
+    const Word* b = other.m_words.data();
+    for (std::size_t w = 0; w < nwords; w++)
+        a[w] &= b[w];
+    std::fill(this->m_words.begin() + nwords, this->m_words.end(), Word(0));
+    return *this;
+}
+
+SelectionMask &SelectionMask::operator|=(const SelectionMask &other)
+{
+    const std::size_t nwords = std::min(this->m_words.size(), other.m_words.size());
+    Word* a = this->m_words.data();
+    const Word* b = other.m_words.data();
+    for (std::size_t w = 0; w < nwords; w++)
+        a[w] |= b[w];
+    this->clearTail();
+    return *this;
+}
+
+SelectionMask &SelectionMask::andNot(const SelectionMask &other)
+{
+    const std::size_t nwords = std::min(this->m_words.size(), other.m_words.size());
+    Word* a = this->m_words.data();
+    const Word* b = other.m_words.data();
+    for (std::size_t w = 0; w < nwords; w++)
+        a[w] &= ~b[w];
+    return *this;
+}
+
+SelectionMask &SelectionMask::invert()
+{
+    for (Word& word : this->m_words)
+        word = ~word;
+    this->clearTail();
+    return *this;
+}
+
+bool SelectionMask::operator==(const SelectionMask &other) const
+{
+    return this->m_size == other.m_size && this->m_words == other.m_words;
+}
+
+void SelectionMask::clearTail()
+{
+    if (this->m_size % kWordBits)
+        this->m_words.back() &= (Word(1) << (this->m_size % kWordBits)) - 1;
+}
@@ -33,6 +33,8 @@
 
 #include <Tracking/trackingfilemanager.h>
 #include <datafilter.h>
+#include <selectionmask.h>
+#include <algorithms.h>
 #include <LibDegorasSLR/ILRS/algorithms/data/statistics_data.h>
 
     MainWindow::MainWindow(QWidget *parent) :
@@ -274,7 +276,7 @@ void MainWindow::on_actionLoad_triggered()
     }
 
     // 3. Dialog: getOpenFileName + filter string "Description (*.ext)"
-    QString filter = "Tracking Files (*.dptr)";
+    QString filter = "Tracking Files (*.dptr *.dptb)";
     QString filePath = QFileDialog::getOpenFileName(this, "Open Tracking File", storedDir, filter);
 
     // 4. Load Data
@@ -448,14 +450,21 @@ void MainWindow::applyFilter(FilterOptions f)
 
     ui->filterPlot->pushCurrentStateToUndo();
     ui->histogramPlot->pushCurrentStateToUndo();
-    auto future = QtConcurrent::run([this, f, paramWindowSize, paramAlpha] {
+
+    // The threshold filter works on a copy of the samples and their fit errors, and only the kept samples are set
+    // in the plot when it finishes.
+    QVector<QPointF> thresh_samples;
+    QVector<QPointF> thresh_errors;
+    if(f == FilterOptions::TreshFilter){
+        thresh_samples = ui->filterPlot->getSelectedSamples();
+        thresh_errors = ui->filterPlot->getFitErrors();
+    }
+
+    // The inputs are captured by value and the kept samples returned by the future, so the worker never touches
+    // the locals of this function.
+    auto future = QtConcurrent::run([this, f, paramWindowSize, paramAlpha, thresh_samples, thresh_errors] {
         if(f == FilterOptions::TreshFilter){
-            int i = 0;
-            int changed_count;
-            do {
-                QMetaObject::invokeMethod(this, &MainWindow::threshFilter, Qt::BlockingQueuedConnection, &changed_count);
-                i++;
-            } while(changed_count > 0 && i < 20);
+            return threshFilter(thresh_samples, thresh_errors, 20);
         } else{
             auto selectedSamples = ui->filterPlot->getSelectedSamples();
             if(f == FilterOptions::MedianFilter){
@@ -471,40 +480,56 @@ void MainWindow::applyFilter(FilterOptions f)
                 ui->filterPlot->setSamples(res);
             }
         }
+        return QVector<QPointF>();
     });
 
-    QFutureWatcher<void> fw;
-    connect(&fw, &QFutureWatcher<void>::finished, &pd, &QProgressDialog::accept);
+    QFutureWatcher<QVector<QPointF>> fw;
+    connect(&fw, &QFutureWatcher<QVector<QPointF>>::finished, &pd, &QProgressDialog::accept);
     fw.setFuture(future);
     pd.exec();
+    // The dialog can still be closed with Escape before the filter finishes.
+    future.waitForFinished();
+
+    if(f == FilterOptions::TreshFilter){
+        const QVector<QPointF> kept = future.result();
+        if(kept.size() != thresh_samples.size())
+            ui->filterPlot->setSamples(kept);
+    }
 
     ui->gb_tools->setEnabled(true);
     onFilterChanged();
 }
 
-int MainWindow::threshFilter()
+QVector<QPointF> MainWindow::threshFilter(QVector<QPointF> samples, const QVector<QPointF> &fit_errors,
+                                          unsigned max_iterations)
 {
-    auto thresh_samples = ui->histogramPlot->getThreshSamples();
-    auto samples = ui->filterPlot->getSelectedSamples();
+    // Same order as the fit errors.
+    std::stable_sort(samples.begin(), samples.end(), [](const auto& a, const auto& b){return a.x() < b.x();});
+    if (samples.size() != fit_errors.size())
+        return samples;
 
-    if (thresh_samples.size() != samples.size())
-    {
-        decltype(samples) selected_samples;
-        std::copy_if(std::make_move_iterator(samples.begin()), std::make_move_iterator(samples.end()),
-                     std::back_inserter(selected_samples), [&thresh_samples](const auto& p)
-                     {
-                         auto it = std::find_if(thresh_samples.begin(), thresh_samples.end(),
-                                                [&p](const auto& t){return p.x() == t.x();});
-                         return it != thresh_samples.end();
-                     });
-        ui->filterPlot->setSamples(selected_samples);
-    }
-    return samples.size() - thresh_samples.size();
+    std::vector<double> errors(static_cast<std::size_t>(fit_errors.size()));
+    for (qsizetype i = 0; i < fit_errors.size(); i++)
+        errors[static_cast<std::size_t>(i)] = fit_errors[i].y();
+
+    // Same limits as the ErrorPlot threshold markers.
+    SelectionMask mask(errors.size(), true);
+    algorithm::sigmaClipFilter(errors, mask, 2.5, max_iterations, algorithm::ClipCenter::ZERO);
+
+    QVector<QPointF> selected_samples;
+    selected_samples.reserve(static_cast<qsizetype>(mask.count()));
+    for (std::size_t i = 0; i < errors.size(); i++)
+        if (mask.test(i))
+            selected_samples.append(samples[static_cast<qsizetype>(i)]);
+    return selected_samples;
 }
 
 void MainWindow::on_pb_rmsFilter_clicked()
 {
-    threshFilter();
+    auto samples = ui->filterPlot->getSelectedSamples();
+    auto selected_samples = threshFilter(samples, ui->filterPlot->getFitErrors(), 1);
+    if (selected_samples.size() != samples.size())
+        ui->filterPlot->setSamples(selected_samples);
     onFilterChanged();
 }
 
@@ -580,7 +605,7 @@ void MainWindow::on_actionSave_triggered()
     QString initialPath = QDir(storedDir).filePath(currentFileName);
 
     // 4. Dialog: getSaveFileName + filter string "Description (*.ext)"
-    QString filter = "Tracking Files (*.dptr)";
+    QString filter = "Tracking Files (*.dptr);;Binary Tracking Files (*.dptb)";
     QString filePath = QFileDialog::getSaveFileName(this,
                                                     "Save Tracking File",
                                                     initialPath, // Use last stored save path if possible
@@ -600,7 +625,8 @@ void MainWindow::on_actionSave_triggered()
 
         // 6. Manually ensure the extension is present
         // (Some OS file dialogs don't auto-append the extension)
-        if (!filePath.endsWith(".dptr", Qt::CaseInsensitive)) {
+        // The format (json or binary) is selected by the extension.
+        if (!filePath.endsWith(".dptr", Qt::CaseInsensitive) && !filePath.endsWith(".dptb", Qt::CaseInsensitive)) {
             filePath += ".dptr";
         }
 
@@ -612,29 +638,40 @@ void MainWindow::on_actionSave_triggered()
             validTimes.insert(static_cast<unsigned long long>(std::round(p.x())));
         }
 
-        long double prev_start = -1.L;
-        long double offset = 0.L;
+        DayRollover rollover;
+        auto& ranges = this->m_trackingData->data.ranges;
+        SelectionMask valid_mask(ranges.size());
 
-        for (auto& shot : this->m_trackingData->data.ranges)
+        for (std::size_t i = 0; i < ranges.size(); i++)
         {
-            if (shot.start_time < prev_start)
-            {
-                offset += 86400.L;
-            }
-            prev_start = shot.start_time;
-
             // Reconstruct the time key to match the plot data
-            unsigned long long time = static_cast<unsigned long long>((shot.start_time + offset) * 1e9);
-
-            if (validTimes.count(time)) {
-                shot.flag = Tracking::RangeData::FilterFlag::DATA;
-            } else {
-                shot.flag = Tracking::RangeData::FilterFlag::NOISE;
-            }
+            unsigned long long time = static_cast<unsigned long long>(rollover(ranges[i].start_time).nanoseconds());
+            valid_mask.set(i, validTimes.count(time) != 0);
         }
 
-        // 8. Perform the write operation
-        TrackingFileManager::writeTrackingPrivate(this->m_trackingData->data, filePath);
+        // Selected shots are data, the rest noise.
+        valid_mask.applyFlags(ranges);
+
+        // 8. Perform the write operation. Big passes take a while to serialize, so keep the UI responsive.
+        QProgressDialog pd("Saving tracking file...", "", 0, 0, this);
+        pd.setCancelButton(nullptr);
+
+        const Tracking& track = this->m_trackingData->data;
+        auto future = QtConcurrent::run([&track, filePath] {
+            return TrackingFileManager::writeTrackingPrivate(track, filePath);
+        });
+
+        QFutureWatcher<DegorasInformation> fw;
+        connect(&fw, &QFutureWatcher<DegorasInformation>::finished, &pd, &QProgressDialog::accept);
+        fw.setFuture(future);
+        pd.exec();
+        future.waitForFinished();
+
+        DegorasInformation errors = future.result();
+        if (errors.hasError()) {
+            errors.showErrors("Filter Tool", DegorasInformation::WARNING, "Error saving file.", this);
+            return;
+        }
 
         // -----------------------------
         // 9. Update internal path variable
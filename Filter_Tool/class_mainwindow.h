@@ -245,9 +245,16 @@ private:
     /**
      * @brief Implements the threshold filtering logic.
      *
-     * @return The number of points discarded/filtered out.
+     * Rejects the samples whose fit error is not inside +/- 2.5*STD of the errors, iteratively (see
+     * algorithm::sigmaClipFilter). It does not access the UI, so it can run out of the GUI thread.
+     *
+     * @param samples The selected samples.
+     * @param fit_errors The fit errors of the samples, in the order of the samples sorted by time (Plot::getFitErrors).
+     * @param max_iterations Maximum number of rejection iterations.
+     * @return The samples that are kept, sorted by time.
      */
-    int threshFilter();
+    static QVector<QPointF> threshFilter(QVector<QPointF> samples, const QVector<QPointF>& fit_errors,
+                                         unsigned max_iterations);
 
     /**
      * @brief Sets up default key sequences for specific keyboard shortcuts for QActions and QPushButtons in UI.
@@ -2,7 +2,7 @@
 #include <qwt/qwt_curve_fitter.h>
 #include <qwt/qwt_series_data.h>
 #include <qwt/qwt_point_data.h>
-#include <LibDegorasBase/Statistics/fitting.h>
+#include <chebyshevfit.h>
 #include <window_message_box.h>
 #include <cmath>
 
@@ -488,13 +488,12 @@ void Plot::updateFit()
     fitt_data->clear();
 
     auto curve_samples = curve_data->samples();
-    // Sort samples by X (Time) to ensure fit works correctly
-    std::sort(curve_samples.begin(), curve_samples.end(), [](const auto& a, const auto& b){return a.x() < b.x();});
+    // Sort samples by X (Time) to ensure fit works correctly. The sort is stable, so the fit errors can be matched
+    // with the samples by sorting them again (see MainWindow::threshFilter).
+    std::stable_sort(curve_samples.begin(), curve_samples.end(),
+                     [](const auto& a, const auto& b){return a.x() < b.x();});
 
     QVector<QPointF> oY;
-    // removed unused oY_original variable for clarity, though you can keep it if used elsewhere
-
-    std::vector<double> xbin, ybin;
 
     // Safety check
     if(curve_samples.isEmpty()) {
@@ -502,37 +501,34 @@ void Plot::updateFit()
         return;
     }
 
+    // Split the samples in bins of bin_size seconds, starting a new bin when the time passes the bin start.
+    std::vector<double> xs, ys;
+    std::vector<std::size_t> offsets{0};
+    xs.reserve(curve_samples.size());
+    ys.reserve(curve_samples.size());
     double time_orig = curve_samples.front().x();
 
     for (const auto& p : std::as_const(curve_samples))
     {
         if (p.x() - time_orig > this->bin_size * 1e9)
         {
-            if (!xbin.empty() && !ybin.empty()) {
-                auto coefs = dpbase::stats::polynomialFit(xbin, ybin, 9);
-                for (auto it_x = xbin.begin(), it_y = ybin.begin(); it_x != xbin.end() && it_y != ybin.end(); ++it_x, ++it_y)
-                {
-                    oY.append({*it_x, dpbase::stats::applyPolynomial(coefs, *it_x)});
-                }
-            }
-            xbin.clear();
-            ybin.clear();
+            offsets.push_back(xs.size());
             time_orig = p.x();
         }
 
-        xbin.push_back(p.x());
-        ybin.push_back(p.y());
+        xs.push_back(p.x());
+        ys.push_back(p.y());
     }
+    offsets.push_back(xs.size());
 
-    // Process the last bin
-    if (!xbin.empty() && !ybin.empty())
-    {
-        auto coefs = dpbase::stats::polynomialFit(xbin, ybin, 9);
-        for (auto it_x = xbin.begin(), it_y = ybin.begin(); it_x != xbin.end() && it_y != ybin.end(); ++it_x, ++it_y)
-        {
-            oY.append({*it_x, dpbase::stats::applyPolynomial(coefs, *it_x)});
-        }
-    }
+    // Fit and evaluate all the bins at once.
+    std::vector<double> fit_ys(xs.size());
+    const auto fits = ChebyshevFit::fitBins(xs, ys, offsets, 9);
+    ChebyshevFit::evaluateBins(fits, xs, offsets, fit_ys);
+
+    oY.reserve(static_cast<qsizetype>(xs.size()));
+    for (std::size_t i = 0; i < xs.size(); i++)
+        oY.append({xs[i], fit_ys[i]});
 
     fitt_data->append(oY);
 
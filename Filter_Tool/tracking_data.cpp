@@ -9,6 +9,7 @@
 #include <algorithm>
 
 #include <window_message_box.h>
+#include <Tracking/rangecolumns.h>
 
 TrackingData::TrackingData(QString path_file, bool reset_tracing)
 {
@@ -19,7 +20,7 @@ TrackingData::TrackingData(QString path_file, bool reset_tracing)
     {
         QTextStream in(&file);
 
-        if (this->file_name.contains("dptr"))
+        if (this->file_name.contains("dptr") || this->file_name.contains("dptb"))
         {
             qInfo() << "New DP Tracking file";
             this->dp_tracking = true;
@@ -30,25 +31,24 @@ TrackingData::TrackingData(QString path_file, bool reset_tracing)
                 errors.showErrors("Filter Tool", DegorasInformation::WARNING, "");
                 return;
             }
+            // Calibrations that can not be found do not prevent filtering the ranges.
+            DegorasInformation calib_errors = TrackingFileManager::unresolvedCalibrations(this->data);
+            if (calib_errors.hasError())
+                calib_errors.showErrors("Filter Tool", DegorasInformation::WARNING, "");
 
             this->mean_cal = this->data.cal_val_overall;
             qint64 mjd = this->data.date_start.date().toJulianDay();// + dpslr::utils::kJulianToModifiedJulian;
-            long double prev_start = -1.L;
-            long double offset = 0.L;
+            DayRollover rollover;
 
             for (const auto& shot : this->data.ranges)
             {
-                if (shot.start_time < prev_start)
-                {
-                    offset += 86400.L;
-                }
-                prev_start = shot.start_time;
-
-                double resid = shot.tof_2w - shot.pre_2w - shot.trop_corr_2w - static_cast<long long>(this->data.cal_val_overall);
+                const unsigned long long time = static_cast<unsigned long long>(rollover(shot.start_time).nanoseconds());
+                double resid = RangeColumns::residual(shot.tof_2w, shot.pre_2w, shot.trop_corr_2w,
+                                                      this->data.residualCalibration());
                 if (reset_tracing || shot.flag == Tracking::RangeData::FilterFlag::DATA )
-                    this->list_echoes.append(new Echo(static_cast<unsigned long long>((shot.start_time + offset) * 1e9), static_cast<long long>(shot.tof_2w), static_cast<long long>(resid), static_cast<long long>(resid*0.0299792458), {}, {}, true, mjd));
+                    this->list_echoes.append(new Echo(time, static_cast<long long>(shot.tof_2w), static_cast<long long>(resid), static_cast<long long>(resid*0.0299792458), {}, {}, true, mjd));
                 else if (shot.flag == Tracking::RangeData::FilterFlag::NOISE)
-                    this->list_noise.append(new Echo( static_cast<unsigned long long>((shot.start_time + offset) * 1e9), static_cast<long long>(shot.tof_2w), static_cast<long long>(resid), static_cast<long long>(resid*0.0299792458), {}, {}, true, mjd));
+                    this->list_noise.append(new Echo(time, static_cast<long long>(shot.tof_2w), static_cast<long long>(resid), static_cast<long long>(resid*0.0299792458), {}, {}, true, mjd));
             }
             this->satel_name = this->data.obj_name;
         }